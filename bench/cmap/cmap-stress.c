@@ -0,0 +1,144 @@
+// Checks that readers of a ConcurrentMap never see a torn entry while a
+// writer keeps updating it: one writer thread adds and erases keys, along
+// with a record per key in a separate array as an NF would keep its values
+// in a vector, while reader threads look keys up. Build it with the
+// Makefile next to it; see ReadMe.md.
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libvig/unverified/concurrent-map.h"
+
+#define CAPACITY 256
+// Most of the capacity, so that probe chains get long
+#define KEYS 200
+#define READERS 3
+
+// What erased keys are overwritten with, see the key rules in
+// concurrent-map.h: their memory stays readable but may change
+#define ERASED_KEY 0xDEADBEEF
+
+struct record {
+  uint32_t key;
+  uint32_t key_copy;
+};
+
+static uint32_t keys[KEYS];
+static struct record records[KEYS];
+static struct ConcurrentMap *map;
+static volatile bool stop;
+
+static bool key_eq(void *a, void *b)
+{
+  return *(uint32_t *)a == *(uint32_t *)b;
+}
+
+// Few distinct hashes, so that lookups go through many colliding slots
+static unsigned key_hash(void *key)
+{
+  return (*(uint32_t *)key * 2654435761u) >> 28;
+}
+
+// xorshift64*, one state per thread
+static uint32_t rng_next(uint64_t *state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return (uint32_t)((*state * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+struct reader_stats {
+  uint64_t lookups;
+  uint64_t found;
+  uint64_t bad;
+};
+
+static void *reader(void *arg)
+{
+  struct reader_stats *stats = arg;
+  uint64_t rng_state = (uintptr_t)arg | 1;
+
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+    uint32_t key = rng_next(&rng_state) % KEYS;
+    int value;
+    struct record record = { 0, 0 };
+    int found;
+    unsigned seq;
+    do {
+      seq = cmap_read_begin(map);
+      found = cmap_get(map, &key, &value);
+      if (found && 0 <= value && value < KEYS) {
+        record.key = __atomic_load_n(&records[value].key, __ATOMIC_RELAXED);
+        record.key_copy =
+            __atomic_load_n(&records[value].key_copy, __ATOMIC_RELAXED);
+      }
+    } while (cmap_read_retry(map, seq));
+
+    stats->lookups++;
+    if (found) {
+      stats->found++;
+      if (value != (int)key || record.key != key || record.key_copy != key) {
+        stats->bad++;
+      }
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t updates = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+
+  if (!cmap_allocate(key_eq, key_hash, CAPACITY, &map)) {
+    fprintf(stderr, "Could not allocate the map\n");
+    return 1;
+  }
+
+  pthread_t threads[READERS];
+  struct reader_stats stats[READERS] = { { 0 } };
+  for (int i = 0; i < READERS; i++) {
+    pthread_create(&threads[i], NULL, reader, &stats[i]);
+  }
+
+  bool present[KEYS] = { false };
+  uint64_t rng_state = 7;
+  for (uint64_t i = 0; i < updates; i++) {
+    uint32_t key = rng_next(&rng_state) % KEYS;
+    if (!present[key]) {
+      cmap_write_begin(map);
+      keys[key] = key;
+      __atomic_store_n(&records[key].key, key, __ATOMIC_RELAXED);
+      __atomic_store_n(&records[key].key_copy, key, __ATOMIC_RELAXED);
+      cmap_put(map, &keys[key], key);
+      cmap_write_end(map);
+    } else {
+      void *trash;
+      cmap_write_begin(map);
+      cmap_erase(map, &key, &trash);
+      __atomic_store_n(&keys[key], ERASED_KEY, __ATOMIC_RELAXED);
+      __atomic_store_n(&records[key].key, ERASED_KEY, __ATOMIC_RELAXED);
+      __atomic_store_n(&records[key].key_copy, ERASED_KEY, __ATOMIC_RELAXED);
+      cmap_write_end(map);
+    }
+    present[key] = !present[key];
+  }
+
+  __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+  uint64_t lookups = 0, found = 0, bad = 0;
+  for (int i = 0; i < READERS; i++) {
+    pthread_join(threads[i], NULL);
+    lookups += stats[i].lookups;
+    found += stats[i].found;
+    bad += stats[i].bad;
+  }
+
+  printf("%" PRIu64 " updates, %d readers: %" PRIu64 " lookups, %" PRIu64
+         " found, %" PRIu64 " inconsistent\n",
+         updates, READERS, lookups, found, bad);
+  return bad == 0 ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+#!/bin/bash
+. ./config.sh
+
+# Benchmarks a DPDK NF on this machine alone, without the tester: DPDK's pcap
+# driver replays synthetic traffic from gen-pcap.py to the NF, in a loop and
+# from memory, and drops whatever the NF sends.
+# The NF runs twice: once to measure its throughput through its telemetry
+# (see nf-telemetry.h), then once built with VIGOR_PROFILE to measure how many
+# cycles nf_process takes (see nf-profile.h), since profiling slows it down.
+# There are no NICs nor PCIe transfers, so this is an upper bound of what the
+# testbench measures, meant to compare versions of an NF, not to replace it.
+
+# Parameters:
+# $1: Folder name containing a DPDK NAT-like app, e.g. "/home/solal/vnds/vignat"
+MIDDLEBOX=$1
+
+# Traffic, can be overridden from the environment, see util/gen-pcap.py
+FLOWS=${FLOWS:-60000}
+PACKETS=${PACKETS:-65536}
+# Churn only holds within one pass of the file, see util/gen-pcap.py; with
+# churn, make PACKETS large enough for the warm-up and measurement to fit in
+# one pass, which local.sh warns about otherwise
+CHURN=${CHURN:-0}
+SIZES=${SIZES:-64}
+# EAL core list of the NF; only NFs built with NF_MULTICORE take more than
+# one, and since the pcap driver has one queue, nf.c then dispatches packets
+# in software
+CORES=${CORES:-$MB_CPU}
+# Seconds of traffic before measuring, and of measurement
+WARMUP=${WARMUP:-5}
+DURATION=${DURATION:-10}
+# Flow expiration time in seconds; with churn, make it short enough for the
+# replaced flows to expire, or the NF's tables fill up
+EXPIRATION_TIME=${EXPIRATION_TIME:-60}
+# Buffers per device; the pcap driver keeps the whole file in the mempool
+MEMPOOL_SIZE=${MEMPOOL_SIZE:-$((PACKETS + 32768))}
+
+if [ -z $MIDDLEBOX ]; then
+    echo "[local] No app specified" 1>&2
+    exit 1
+fi
+
+RESULTS_FILE="benchmark-local.results"
+FORWARD_PCAP="$(pwd)/local-forward.pcap"
+REVERSE_PCAP="$(pwd)/local-reverse.pcap"
+
+pushd $MIDDLEBOX >> /dev/null
+  # Without -s, make prints 'Entering directory..' messages, idk why
+  LAYER="$(make -s _print-layer)"
+  # One packet per flow, played once at startup like bench.lua's heat-up
+  REVERSE_PACKETS=0
+  if [ "$(make -s _print-needsreverse)" = "true" ]; then REVERSE_PACKETS=32; fi
+popd >> /dev/null
+
+echo "[local] Generating $PACKETS packets of $FLOWS flows at layer $LAYER..."
+./util/gen-pcap.py --layer $LAYER --flows $FLOWS --packets $PACKETS \
+                   --churn $CHURN --sizes $SIZES "$FORWARD_PCAP" || exit 2
+./util/gen-pcap.py --layer $LAYER --flows 32 --packets $REVERSE_PACKETS \
+                   "$REVERSE_PCAP" || exit 2
+
+# convert s to us
+export EXPIRATION_TIME="$(echo "$EXPIRATION_TIME * 1000 * 1000" | bc)"
+# Without tx_pcap nor tx_iface, the pcap driver drops what it sends
+export NF_DPDK_ARGS="-l $CORES --no-pci \
+  --vdev net_pcap0,rx_pcap=$FORWARD_PCAP,infinite_rx=1 \
+  --vdev net_pcap1,rx_pcap=$REVERSE_PCAP"
+export NF_IO_ARGS="--mempool-size $MEMPOOL_SIZE"
+
+# Starts the NF with its output in the given log file, and waits until it
+# runs; sets NF_PID and MAKE_PID
+start_nf() {
+  pushd $MIDDLEBOX >> /dev/null
+    echo "[local] Running $MIDDLEBOX..."
+    make run > "$1" 2>&1 &
+    MAKE_PID=$!
+    # nf.c creates the telemetry segment right before processing packets
+    NF_PID=''
+    while [ -z "$NF_PID" ]; do
+      if ! kill -0 $MAKE_PID 2>/dev/null; then
+        echo "[local] The NF did not start, see $1" 1>&2
+        exit 3
+      fi
+      sleep 1
+      NF_PID=$(grep -o 'segment /vigor-[0-9]*' "$1" | grep -o '[0-9]*$')
+    done
+  popd >> /dev/null
+}
+
+stop_nf() {
+  sudo kill -INT $NF_PID
+  wait $MAKE_PID
+  # Interrupted NFs do not remove their segment
+  sudo rm -f /dev/shm/vigor-$NF_PID
+}
+
+# Number of cores in the given EAL core list, e.g. 3 for "0-1,4"
+core_count() {
+  echo "$1" | tr ',' '\n' | awk -F- '{ n += ($NF - $1 + 1) } END { print n }'
+}
+
+# Rate of the given counter over the telemetry output on stdin, in Mpps
+rate() {
+  awk -v name=$1 '$1 == name { sub("/s", "", $2); printf "%.3f", $2 / 1000000 }'
+}
+
+echo "[local] Measuring throughput..."
+start_nf "$MIDDLEBOX/benchmark-local.log"
+sleep $WARMUP
+TELEMETRY="$(../nf-telemetry.py $NF_PID $DURATION 1)"
+stop_nf
+RX_MPPS=$(echo "$TELEMETRY" | rate rx)
+TX_MPPS=$(echo "$TELEMETRY" | rate tx)
+if [ -z "$RX_MPPS" -o "$RX_MPPS" = "0.000" ]; then
+    echo "[local] The NF did not receive anything, see $MIDDLEBOX/benchmark-local.log" 1>&2
+    exit 4
+fi
+# Passes over the file, rounded up, from the start until the end of the
+# measurement
+PASSES=$(echo "($RX_MPPS * 1000000 * ($WARMUP + $DURATION) + $PACKETS - 1) / $PACKETS" | bc)
+if [ "$CHURN" != "0" -a "$PASSES" -gt 1 ]; then
+    echo "[local] Warning: the NF went through the file about $PASSES times, and churn only holds within one pass; increase PACKETS" 1>&2
+fi
+
+echo "[local] Measuring nf_process cycles..."
+PROFILE_LOG="$MIDDLEBOX/benchmark-local-profile.log"
+VIGOR_PROFILE=true start_nf "$PROFILE_LOG"
+sleep $(( WARMUP + DURATION ))
+sudo kill -USR1 $NF_PID
+# Cores print their histograms when they process their next packet
+sleep 1
+stop_nf
+
+# Each core's histograms; the summary is that of the first core
+TSC_HZ=$(grep -o -m 1 '[0-9]* Hz TSC' "$PROFILE_LOG" | cut -d ' ' -f 1)
+TOTAL=$(grep -m 1 '^total ' "$PROFILE_LOG")
+
+# TSC cycles of all of the NF's cores per received packet, and the mean and
+# percentiles of nf_process, from TSC cycles to ns
+CYCLES=$(echo "scale=1; $TSC_HZ * $(core_count $CORES) / ($RX_MPPS * 1000000)" | bc)
+LATENCIES=$(echo "$TOTAL" | awk -v hz=$TSC_HZ \
+  '{ for (i = 3; i <= NF; i++) printf "\t%.1f", $i * 1000000000 / hz }')
+
+echo -e "#flows\tchurn\tsizes\trx (Mpps)\ttx (Mpps)\tcycles/packet\tmean (ns)\tp50 (ns)\tp90 (ns)\tp99 (ns)\tp99.9 (ns)\tp99.99 (ns)\tmax (ns)" > "$RESULTS_FILE"
+echo -e "$FLOWS\t$CHURN\t$SIZES\t$RX_MPPS\t$TX_MPPS\t$CYCLES$LATENCIES" >> "$RESULTS_FILE"
+# Then all the histograms, in TSC cycles
+sed -n '/^Cycles per stage/,/^total /s/^/#/p' "$PROFILE_LOG" >> "$RESULTS_FILE"
+
+rm -f "$FORWARD_PCAP" "$REVERSE_PCAP"
@@ -0,0 +1,179 @@
+// Measures the lookup and update rates of the libVig LPM implementations on
+// a RIB dump. Build it with the Makefile next to it, which produces one
+// binary per implementation; see ReadMe.md.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef LPM_DIR_16_8_8
+#include "libvig/unverified/lpm-dir-16-8-8.h"
+#define LPM_NAME "dir-16-8-8"
+#else
+#include "libvig/verified/lpm-dir-24-8.h"
+#define LPM_NAME "dir-24-8"
+#endif
+
+struct route {
+  uint32_t prefix;
+  uint8_t prefixlen;
+  uint16_t next_hop;
+};
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// xorshift64*, so that both binaries see the same addresses for the same
+// seed whatever the libc
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+static uint32_t rng_next(void)
+{
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (uint32_t)((rng_state * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+// One route per line: "a.b.c.d/len [next-hop]". Lines that do not start
+// with an IPv4 prefix (comments, IPv6 routes, ...) are skipped. Routes
+// without a next hop get one derived from their position in the file.
+static struct route* read_rib(const char *path, size_t *count_out)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    exit(1);
+  }
+
+  size_t capacity = 1024;
+  size_t count = 0;
+  struct route *routes = malloc(capacity * sizeof(struct route));
+  char line[256];
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    unsigned a, b, c, d, len, next_hop;
+    int fields = sscanf(line, "%u.%u.%u.%u/%u %u",
+                        &a, &b, &c, &d, &len, &next_hop);
+    if (fields < 5 || a > 255 || b > 255 || c > 255 || d > 255 ||
+        len > lpm_PLEN_MAX) {
+      continue;
+    }
+    if (fields < 6 || next_hop > MAX_NEXT_HOP_VALUE) {
+      next_hop = count % MAX_NEXT_HOP_VALUE;
+    }
+
+    if (count == capacity) {
+      capacity *= 2;
+      routes = realloc(routes, capacity * sizeof(struct route));
+    }
+    routes[count].prefix = (a << 24) | (b << 16) | (c << 8) | d;
+    routes[count].prefixlen = (uint8_t)len;
+    routes[count].next_hop = (uint16_t)next_hop;
+    count++;
+  }
+
+  fclose(file);
+  *count_out = count;
+  return routes;
+}
+
+// Looks up every address and returns a checksum of the results, so that the
+// lookups are not optimized away and so that implementations can be checked
+// against each other.
+static uint64_t run_lookups(struct lpm *lpm, uint32_t *addresses,
+                            size_t count, double *seconds_out)
+{
+  uint64_t checksum = 0;
+  double start = now_seconds();
+  for (size_t i = 0; i < count; i++) {
+    checksum = checksum * 31 + (uint32_t)lpm_lookup_elem(lpm, addresses[i]);
+  }
+  *seconds_out = now_seconds() - start;
+  return checksum;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <rib-file> [lookups]\n", argv[0]);
+    return 1;
+  }
+
+  size_t lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000;
+
+  size_t route_count;
+  struct route *routes = read_rib(argv[1], &route_count);
+  if (route_count == 0) {
+    fprintf(stderr, "No IPv4 route in %s\n", argv[1]);
+    return 1;
+  }
+
+  struct lpm *lpm;
+  if (!lpm_allocate(&lpm)) {
+    fprintf(stderr, "Could not allocate the LPM table\n");
+    return 1;
+  }
+
+  printf("Implementation: %s\n", LPM_NAME);
+  printf("Routes: %zu\n", route_count);
+
+  double start = now_seconds();
+  for (size_t i = 0; i < route_count; i++) {
+    if (!lpm_update_elem(lpm, routes[i].prefix, routes[i].prefixlen,
+                         routes[i].next_hop)) {
+      fprintf(stderr, "Could not insert route %zu\n", i);
+      return 1;
+    }
+  }
+  double seconds = now_seconds() - start;
+  printf("Insert: %.3f Mupdates/s\n", route_count / seconds / 1e6);
+
+  // Uniformly random addresses, and addresses that fall in a random route,
+  // which is closer to what a router on the path of that RIB sees.
+  uint32_t *addresses = malloc(lookups * sizeof(uint32_t));
+  if (addresses == NULL) {
+    fprintf(stderr, "Could not allocate %zu addresses\n", lookups);
+    return 1;
+  }
+
+  for (size_t i = 0; i < lookups; i++) {
+    addresses[i] = rng_next();
+  }
+  uint64_t checksum = run_lookups(lpm, addresses, lookups, &seconds);
+  printf("Lookup (random addresses): %.2f Mlookups/s, checksum %016" PRIx64
+         "\n", lookups / seconds / 1e6, checksum);
+
+  for (size_t i = 0; i < lookups; i++) {
+    struct route *route = &routes[rng_next() % route_count];
+    uint32_t host_mask = route->prefixlen == 0 ?
+                         0xFFFFFFFFu :
+                         (uint32_t)((1ull << (lpm_PLEN_MAX -
+                                              route->prefixlen)) - 1);
+    addresses[i] = route->prefix | (rng_next() & host_mask);
+  }
+  checksum = run_lookups(lpm, addresses, lookups, &seconds);
+  printf("Lookup (routed addresses): %.2f Mlookups/s, checksum %016" PRIx64
+         "\n", lookups / seconds / 1e6, checksum);
+
+  start = now_seconds();
+  size_t deleted = 0;
+  for (size_t i = 0; i < route_count; i++) {
+    // Duplicate prefixes in the dump were replaced, not added
+    deleted += lpm_delete_elem(lpm, routes[i].prefix, routes[i].prefixlen);
+  }
+  seconds = now_seconds() - start;
+  printf("Delete: %.3f Mupdates/s (%zu distinct prefixes)\n",
+         deleted / seconds / 1e6, deleted);
+
+  lpm_free(lpm);
+  free(addresses);
+  free(routes);
+  return 0;
+}
@@ -0,0 +1,72 @@
+#!/bin/bash
+. ./config.sh
+
+# Measures the power drawn by the middlebox's CPU package while the NF is idle
+# and during the "latency" scenario, along with that scenario's latencies,
+# with busy polling and then with adaptive RX (see rx_idle_wait in nf.c).
+# Power comes from RAPL, so the middlebox needs an Intel CPU exposing it.
+
+# Parameters:
+# $1: Folder name containing a DPDK NAT-like app, e.g. "/home/solal/vnds/vignat"
+MIDDLEBOX=$1
+
+# Adaptive RX settings, can be overridden from the environment
+IDLE_TIMEOUT=${IDLE_TIMEOUT:-1000} # microseconds
+IDLE_MAX_SLEEP=${IDLE_MAX_SLEEP:-10} # milliseconds
+# How long to measure idle power
+IDLE_DURATION=${IDLE_DURATION:-30} # seconds
+
+RAPL_DIR=/sys/class/powercap/intel-rapl:$(lscpu -p=CPU,SOCKET | grep "^$MB_CPU," | cut -d, -f2)
+
+if [ -z $MIDDLEBOX ]; then
+    echo "[power] No app specified" 1>&2
+    exit 1
+fi
+
+if [ ! -d $RAPL_DIR ]; then
+    echo "[power] No RAPL package domain at $RAPL_DIR" 1>&2
+    exit 2
+fi
+
+energy() {
+  sudo cat $RAPL_DIR/energy_uj
+}
+
+# $1, $2: energy before and after in microjoules, $3: duration in seconds
+power() {
+  local range=$(sudo cat $RAPL_DIR/max_energy_range_uj)
+  echo "scale=2; (($2 - $1 + $range) % $range) / $3 / 1000000" | bc
+}
+
+RESULTS_FILE="power-latency.results"
+echo -e "#mode\tidle power (W)\tloaded power (W)\tlatency results" > "$RESULTS_FILE"
+
+for MODE in busy adaptive; do
+  if [ $MODE = "adaptive" ]; then
+    # Passed on to nf.c by the NF's makefile
+    export NF_IO_ARGS="--idle-timeout $IDLE_TIMEOUT --idle-max-sleep $IDLE_MAX_SLEEP"
+  else
+    export NF_IO_ARGS=""
+  fi
+
+  echo "[power] Measuring with $MODE RX..."
+  ./init-machines.sh
+  ./clean.sh $MIDDLEBOX
+  ./init-network.sh $MIDDLEBOX
+  ./run-middlebox.sh $MIDDLEBOX latency
+
+  START=$(energy)
+  sleep $IDLE_DURATION
+  IDLE_POWER=$(power $START $(energy) $IDLE_DURATION)
+
+  LATENCY_FILE="benchmark-latency-$MODE.results"
+  rm -f "$LATENCY_FILE"
+  START=$(energy)
+  START_TIME=$(date +%s)
+  ./run-benchmark.sh $MIDDLEBOX latency "$LATENCY_FILE"
+  LOADED_POWER=$(power $START $(energy) $(( $(date +%s) - START_TIME )))
+
+  ./clean.sh $MIDDLEBOX
+
+  echo -e "$MODE\t$IDLE_POWER\t$LOADED_POWER\t$LATENCY_FILE" >> "$RESULTS_FILE"
+done
@@ -0,0 +1,40 @@
+#!/bin/bash
+. ./config.sh
+
+# Benchmarks the throughput of a DPDK NAT-like app for each combination of
+# queue size, mempool size and mempool cache size below, to pick the defaults
+# in nf.c. Each combination is a full "throughput" run, see bench.sh.
+
+# Parameters:
+# $1: Folder name containing a DPDK NAT-like app, e.g. "/home/solal/vnds/vignat"
+MIDDLEBOX=$1
+
+# Space-separated values to try, can be overridden from the environment.
+# RX and TX queues get the same size; a mempool size of 0 means nf.c's default.
+QUEUE_SIZES=${QUEUE_SIZES:-"96 512 1024 2048"}
+MEMPOOL_SIZES=${MEMPOOL_SIZES:-"0 16384"}
+MEMPOOL_CACHE_SIZES=${MEMPOOL_CACHE_SIZES:-"0 256"}
+
+if [ -z $MIDDLEBOX ]; then
+    echo "[sweep] No app specified" 1>&2
+    exit 1
+fi
+
+RESULTS_FILE="sweep-sizes.results"
+echo -e "#queue size\tmempool size\tcache size\t#flows\trate (Mbps)\tmedianLat (ns)\tstdevLat (ns)" > "$RESULTS_FILE"
+
+for QUEUE_SIZE in $QUEUE_SIZES; do
+  for MEMPOOL_SIZE in $MEMPOOL_SIZES; do
+    for CACHE_SIZE in $MEMPOOL_CACHE_SIZES; do
+      echo "[sweep] Queue size $QUEUE_SIZE, mempool size $MEMPOOL_SIZE, cache size $CACHE_SIZE"
+      # Passed on to nf.c by the NF's makefile
+      export NF_IO_ARGS="--rx-queue-size $QUEUE_SIZE --tx-queue-size $QUEUE_SIZE --mempool-size $MEMPOOL_SIZE --mempool-cache-size $CACHE_SIZE"
+      ./bench.sh "$MIDDLEBOX" throughput
+
+      grep -v '^#' benchmark-throughput.results | \
+        sed "s/^/$QUEUE_SIZE\t$MEMPOOL_SIZE\t$CACHE_SIZE\t/" >> "$RESULTS_FILE"
+      mv "$MIDDLEBOX/benchmark-throughput.log" \
+         "$MIDDLEBOX/sweep-$QUEUE_SIZE-$MEMPOOL_SIZE-$CACHE_SIZE.log" 2>/dev/null
+    done
+  done
+done
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+# Generates a pcap file of synthetic UDP traffic for local.sh, with the same
+# packets bench.lua sends: the flow number goes in the Ethernet addresses, the
+# source IP or the source UDP port, depending on the layer of the NF. Beyond
+# 65536 flows at layer 4, the higher bits of the flow number go in the source
+# IP instead of leaving it at 255.255.255.255.
+#
+# Flows are sent round-robin, which is as unfriendly to caches as it gets.
+# With churn, that fraction of the packets each start a new flow, which from
+# then on replaces the oldest one in the round-robin.
+# Churn only holds within one pass of the file: replayed in a loop, as
+# local.sh does, the file starts over with its first flows, which replace all
+# of the current ones at once, and are only new again if the NF expired them.
+#
+# Usage: gen-pcap.py [options] <output file>, see --help
+
+import argparse
+import random
+import struct
+
+# Standard pcap format, microsecond timestamps, Ethernet frames
+PCAP_HEADER = struct.Struct('=IHHiIII')
+PCAP_RECORD = struct.Struct('=IIII')
+ETHER_HEADER = struct.Struct('!6s6sH')
+IPV4_HEADER = struct.Struct('!BBHHHBBHII')
+UDP_HEADER = struct.Struct('!HHHH')
+
+ETHER_CRC_LEN = 4
+MIN_FRAME_SIZE = 64
+MAX_FRAME_SIZE = 1518
+
+
+def mac(value):
+  return value.to_bytes(6, 'big')
+
+
+def ipv4_checksum(header):
+  total = sum(struct.unpack('!10H', header))
+  while total > 0xFFFF:
+    total = (total & 0xFFFF) + (total >> 16)
+  return ~total & 0xFFFF
+
+
+def packet(layer, flow, size):
+  """The frame of the given flow, of the given size including the CRC"""
+  ether_src, ether_dst = 0xFFFFFFFFFFFF, 0
+  ip_src, udp_src = 0xFFFFFFFF, 65535
+  if layer == 2:
+    ether_src, ether_dst = flow, 0xFF0000000000 + flow
+  elif layer == 3:
+    ip_src = flow
+  else:
+    ip_src, udp_src = 0xFFFFFFFF - (flow >> 16), flow & 0xFFFF
+
+  ip_length = size - ETHER_CRC_LEN - ETHER_HEADER.size
+  udp_length = ip_length - IPV4_HEADER.size
+  ip = IPV4_HEADER.pack(0x45, 0, ip_length, 0, 0, 64, 17, 0, ip_src, 0)
+  ip = IPV4_HEADER.pack(0x45, 0, ip_length, 0, 0, 64, 17, ipv4_checksum(ip),
+                        ip_src, 0)
+  # The UDP checksum is optional, as in bench.lua
+  udp = UDP_HEADER.pack(udp_src, 0, udp_length, 0)
+  payload = bytes(udp_length - UDP_HEADER.size)
+  return ETHER_HEADER.pack(mac(ether_dst), mac(ether_src), 0x0800) + ip + \
+      udp + payload
+
+
+def flows(count, packets, churn):
+  """The flow of each packet"""
+  # The round-robin goes over flows [oldest, oldest + count)
+  oldest = 0
+  current = 0
+  new_flows = 0.0
+  for _ in range(packets):
+    new_flows += churn
+    if new_flows >= 1:
+      new_flows -= 1
+      oldest += 1
+      current = max(current, oldest)
+      yield oldest + count - 1
+      continue
+    yield current
+    current += 1
+    if current == oldest + count:
+      current = oldest
+
+
+def parse_sizes(text):
+  """'size:weight,...' to lists of sizes and weights, weights default to 1"""
+  sizes, weights = [], []
+  for item in text.split(','):
+    size, _, weight = item.partition(':')
+    size, weight = int(size), float(weight or 1)
+    if not MIN_FRAME_SIZE <= size <= MAX_FRAME_SIZE:
+      raise argparse.ArgumentTypeError(
+          'sizes must be between {} and {}'.format(MIN_FRAME_SIZE,
+                                                   MAX_FRAME_SIZE))
+    sizes.append(size)
+    weights.append(weight)
+  return sizes, weights
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description='Generates synthetic UDP traffic for local.sh')
+  parser.add_argument('output', help='pcap file to write')
+  parser.add_argument('--layer', type=int, choices=[2, 3, 4], default=2,
+                      help='layer at which flows are meaningful, default 2')
+  parser.add_argument('--flows', type=int, default=60000,
+                      help='concurrent flows, default 60000')
+  parser.add_argument('--packets', type=int, default=65536,
+                      help='packets in the file, can be 0, default 65536')
+  parser.add_argument('--churn', type=float, default=0.0,
+                      help='fraction of the packets that start a new flow, '
+                           'within one pass of the file, default 0')
+  parser.add_argument('--sizes', type=parse_sizes, default='64',
+                      help='frame sizes including the CRC with their '
+                           'weights, e.g. 64:7,594:4,1518:1 for IMIX, '
+                           'default 64')
+  parser.add_argument('--seed', type=int, default=0,
+                      help='seed of the size mix, default 0')
+  args = parser.parse_args()
+  if args.flows < 1 or args.packets < 0 or not 0 <= args.churn < 1:
+    parser.error('need at least one flow, and 0 <= churn < 1')
+
+  sizes, weights = args.sizes
+  sizes = random.Random(args.seed).choices(sizes, weights, k=args.packets)
+  with open(args.output, 'wb') as f:
+    f.write(PCAP_HEADER.pack(0xA1B2C3D4, 2, 4, 0, 0, 65535, 1))
+    for n, (flow, size) in enumerate(
+        zip(flows(args.flows, args.packets, args.churn), sizes)):
+      frame = packet(args.layer, flow, size)
+      f.write(PCAP_RECORD.pack(n // 1000000, n % 1000000, len(frame),
+                               len(frame)))
+      f.write(frame)
+
+
+if __name__ == '__main__':
+  main()
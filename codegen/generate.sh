@@ -20,7 +20,7 @@ for FILE_PATH in $@; do
   PREPROC_FILE_PATH=$FILE_PATH.preproc.c
   gcc -E $FILE_PATH -I $CODEGENDIR/.. -I $CODEGENDIR/../libvig/models/dpdk > $PREPROC_FILE_PATH
   swap $FILE_PATH $PREPROC_FILE_PATH
-  $CODEGENDIR/_build/main.byte $FILE_PATH
+  $CODEGENDIR/_build/main.byte -map-keys "${NF_MAP_KEYS:-}" $FILE_PATH
   swap $FILE_PATH $PREPROC_FILE_PATH
   rm $PREPROC_FILE_PATH
   # Check the generated file if possible
@@ -705,6 +705,22 @@ let gen_allocation containers =
      )
      containers []) ^
   "#endif//KLEE_VERIFICATION\n" ^
+  (* The NF calls the map operations specialized for each key type
+     directly, see libvig/unverified/map-specialized.h; the generic ones,
+     which e.g. the expirator calls, forward to them *)
+  (match concat_flatten_map ""
+           (fun (name, cnt) ->
+              match cnt with
+              | Map (typ, _, _) ->
+                ["  map_specialize(ret->" ^ name ^ ", &" ^ typ ^
+                 "_map_ops);\n"]
+              | _ -> [])
+           containers [] with
+   | "" -> ""
+   | specializations ->
+     "#if defined(SPECIALIZED_MAPS) && !defined(KLEE_VERIFICATION)\n" ^
+     specializations ^
+     "#endif//SPECIALIZED_MAPS\n") ^
   "  allocated_nf_state = ret;\n" ^
   "  return ret;\n" ^
   "}\n"
@@ -836,7 +852,8 @@ let () =
   fprintf cout "#include \"libvig/models/verified/vector-control.h\"\n";
   fprintf cout "#include \"libvig/models/verified/lpm-dir-24-8-control.h\"\n";
   fprintf cout "#endif//KLEE_VERIFICATION\n";
-  fprintf cout "struct State* allocated_nf_state = NULL;\n";
+  fprintf cout "// One state per core, see nf.h\n";
+  fprintf cout "PER_CORE struct State* allocated_nf_state = NULL;\n";
   fprintf cout "%s\n" (gen_inv_c_functions constraints containers);
   fprintf cout "%s\n" (gen_allocation containers);
   fprintf cout "#ifdef KLEE_VERIFICATION\n";
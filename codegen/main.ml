@@ -400,6 +400,188 @@ let gen_hash compinfo =
   "  return hash;\n" ^
   "}"
 
+(* Keys whose fields are all plain integers (possibly in arrays or nested
+   structs) and that are 8 or 16 bytes long can be hashed and compared as
+   whole words, with the padding masked out since its contents are
+   unspecified: one crc32 per 8 bytes and a single 128-bit compare instead of
+   one operation per field. Returns the mask of each 8-byte word. *)
+let packed_word_masks compinfo =
+  let rec is_int t =
+    match t with
+    | TInt _ -> true
+    | TNamed ({ttype;_}, _) -> is_int ttype
+    | TArray (elem_t, Some _, _) -> is_int elem_t
+    | _ -> false
+  in
+  let rec field_bytes compinfo base =
+    List.fold_left (fun acc field ->
+        match acc with
+        | None -> None
+        | Some bytes ->
+          let start, width =
+            bitsOffset (TComp (compinfo, [])) (Field (field, NoOffset))
+          in
+          match unrollType field.ftype with
+          | _ when field.fbitfield <> None -> None
+          | TComp (nested, _) ->
+            begin match field_bytes nested (base + start / 8) with
+              | Some nested_bytes -> Some (nested_bytes @ bytes)
+              | None -> None
+            end
+          | t when is_int t -> Some ((base + start / 8, width / 8)::bytes)
+          | _ -> None
+      ) (Some []) compinfo.cfields
+  in
+  let size = (bitsSizeOf (TComp (compinfo, []))) / 8 in
+  let word_mask bytes w =
+    List.fold_left (fun mask (start, len) ->
+        let rec set_bytes mask i =
+          if i < start + len then
+            let mask =
+              if i / 8 = w then
+                Int64.logor mask (Int64.shift_left 0xffL ((i mod 8) * 8))
+              else mask
+            in
+            set_bytes mask (i + 1)
+          else mask
+        in
+        set_bytes mask start
+      ) 0L bytes
+  in
+  match field_bytes compinfo 0 with
+  | Some bytes when size = 8 || size = 16 ->
+    let rec words w =
+      if w < size / 8 then (word_mask bytes w)::(words (w + 1)) else []
+    in
+    Some (words 0)
+  | _ -> None
+
+let packed_keys_cond = "defined(PACKED_KEYS) && !defined(KLEE_VERIFICATION)"
+
+let mask_literal mask = sprintf "0x%016LxULL" mask
+
+let gen_packed_eq_function compinfo masks =
+  "bool " ^ (eq_fun_name compinfo) ^ "(void* a, void* b)\n" ^
+  "{\n" ^
+  (match masks with
+   | [mask] ->
+     "  uint64_t word_a;\n" ^
+     "  uint64_t word_b;\n" ^
+     "  memcpy(&word_a, a, sizeof(word_a));\n" ^
+     "  memcpy(&word_b, b, sizeof(word_b));\n" ^
+     "  return ((word_a ^ word_b) & " ^ (mask_literal mask) ^ ") == 0;\n"
+   | [mask0; mask1] ->
+     "  __m128i diff = _mm_xor_si128(_mm_loadu_si128((__m128i*) a),\n" ^
+     "                               _mm_loadu_si128((__m128i*) b));\n" ^
+     "  return _mm_testz_si128(diff,\n" ^
+     "                         _mm_set_epi64x((long long) " ^
+     (mask_literal mask1) ^ ",\n" ^
+     "                                        (long long) " ^
+     (mask_literal mask0) ^ "));\n"
+   | _ -> failwith "Unsupported packed key size") ^
+  "}"
+
+let gen_packed_hash compinfo masks =
+  let word_count = string_of_int (List.length masks) in
+  "unsigned " ^ (hash_fun_name compinfo) ^ "(void* obj)\n" ^
+  "{\n" ^
+  "  uint64_t words[" ^ word_count ^ "];\n" ^
+  "  memcpy(words, obj, sizeof(words));\n" ^
+  "\n" ^
+  "  unsigned long long hash = 0;\n" ^
+  (String.concat "" (List.mapi (fun i mask ->
+       "  hash = __builtin_ia32_crc32di(hash, words[" ^ (string_of_int i) ^
+       "] & " ^ (mask_literal mask) ^ ");\n"
+     ) masks)) ^
+  "  return (unsigned) hash;\n" ^
+  "}"
+
+let hash_bulk_fun_name compinfo = compinfo.cname ^ "_hash_bulk"
+
+let hash_bulk_signature compinfo =
+  "void " ^ (hash_bulk_fun_name compinfo) ^
+  "(void** keys, unsigned n, unsigned* hashes_out)"
+
+let gen_hash_bulk_decl compinfo =
+  (hash_bulk_signature compinfo) ^ ";"
+
+(* Computes the same hashes as the scalar function. Packed keys are hashed
+   HASH_BULK_LANES at a time, as independent crc32 chains, so that the
+   latency of each crc32 is hidden behind the others. *)
+let gen_hash_bulk compinfo masks =
+  let scalar_loop =
+    "  for (; i < n; i++) {\n" ^
+    "    hashes_out[i] = " ^ (hash_fun_name compinfo) ^ "(keys[i]);\n" ^
+    "  }\n"
+  in
+  (hash_bulk_signature compinfo) ^ "\n" ^
+  "{\n" ^
+  "  unsigned i = 0;\n" ^
+  (match masks with
+   | Some masks ->
+     let word_count = string_of_int (List.length masks) in
+     "  static const uint64_t masks[" ^ word_count ^ "] = { " ^
+     (String.concat ", " (List.map mask_literal masks)) ^ " };\n" ^
+     "  for (; i + HASH_BULK_LANES <= n; i += HASH_BULK_LANES) {\n" ^
+     "    uint64_t words[HASH_BULK_LANES][" ^ word_count ^ "];\n" ^
+     "    unsigned long long hashes[HASH_BULK_LANES];\n" ^
+     "    for (unsigned lane = 0; lane < HASH_BULK_LANES; lane++) {\n" ^
+     "      memcpy(words[lane], keys[i + lane], sizeof(words[lane]));\n" ^
+     "      hashes[lane] = 0;\n" ^
+     "    }\n" ^
+     "    for (unsigned w = 0; w < " ^ word_count ^ "; w++) {\n" ^
+     "      for (unsigned lane = 0; lane < HASH_BULK_LANES; lane++) {\n" ^
+     "        hashes[lane] = __builtin_ia32_crc32di(hashes[lane],\n" ^
+     "                                              words[lane][w] & masks[w]);\n" ^
+     "      }\n" ^
+     "    }\n" ^
+     "    for (unsigned lane = 0; lane < HASH_BULK_LANES; lane++) {\n" ^
+     "      hashes_out[i + lane] = (unsigned) hashes[lane];\n" ^
+     "    }\n" ^
+     "  }\n"
+   | None -> "") ^
+  scalar_loop ^
+  "}"
+
+let specialized_maps_cond =
+  "defined(SPECIALIZED_MAPS) && !defined(KLEE_VERIFICATION)"
+
+let map_ops_name compinfo = compinfo.cname ^ "_map_ops"
+
+(* Records used as map keys, from -map-keys: only they get the specialized
+   map operations *)
+let map_keys = ref []
+
+let is_map_key compinfo = List.mem compinfo.cname !map_keys
+
+let map_op_names = ["get"; "get_with_hash"; "put"; "erase"]
+
+(* Map operations specialized for this key type, see
+   libvig/unverified/map-specialized.h *)
+let gen_map_ops_decl compinfo =
+  "#  include \"libvig/verified/map.h\"\n" ^
+  "int " ^ compinfo.cname ^
+  "_map_get(struct Map* map, void* key, int* value_out);\n" ^
+  "int " ^ compinfo.cname ^
+  "_map_get_with_hash(struct Map* map, void* key, unsigned hash,\n" ^
+  "                   int* value_out);\n" ^
+  "void " ^ compinfo.cname ^
+  "_map_put(struct Map* map, void* key, int value);\n" ^
+  "void " ^ compinfo.cname ^
+  "_map_erase(struct Map* map, void* key, void** trash);\n" ^
+  "extern const struct MapOps " ^ (map_ops_name compinfo) ^ ";"
+
+(* NF code calls <Type>_map_get and co. on maps of this key type, which are
+   the generic operations for VeriFast and KLEE *)
+let gen_generic_map_ops_defs compinfo =
+  String.concat "\n" (List.map (fun op ->
+      "#  define " ^ compinfo.cname ^ "_map_" ^ op ^ " map_" ^ op
+    ) map_op_names)
+
+let gen_map_ops compinfo =
+  "#  define MAP_KEY_TYPE " ^ compinfo.cname ^ "\n" ^
+  "#  include \"libvig/unverified/map-specialized.h\""
+
 let gen_hash_dummy compinfo =
   let strdescrs = (strdescrs_name compinfo) in
   let nests = (nest_descrs_name compinfo) in
@@ -575,18 +757,57 @@ let gen_log_fun_decl compinfo =
   "  p(\"}\");\n"
 
 
+(* The packed versions and the bulk hash are only compiled with
+   -DPACKED_KEYS, so that the field-by-field versions are still the ones
+   VeriFast checks. *)
 let fill_impl_file compinfo impl_fname header_fname =
   let cout = open_out impl_fname in
+  let masks = packed_word_masks compinfo in
   ignore (P.fprintf cout "#include \"%s\"\n\n" header_fname);
   ignore (P.fprintf cout "#include <stdint.h>\n\n");
-  ignore (P.fprintf cout "%s\n\n" (gen_eq_function compinfo));
+  begin match masks with
+    | Some _ ->
+      ignore (P.fprintf cout "#if %s\n" packed_keys_cond);
+      ignore (P.fprintf cout "#  include <string.h>\n");
+      ignore (P.fprintf cout "#  include <smmintrin.h>\n");
+      ignore (P.fprintf cout "#endif\n\n")
+    | None -> ()
+  end;
+  begin match masks with
+    | Some masks ->
+      ignore (P.fprintf cout "#if %s\n\n" packed_keys_cond);
+      ignore (P.fprintf cout "%s\n\n" (gen_packed_eq_function compinfo masks));
+      ignore (P.fprintf cout "#else\n\n");
+      ignore (P.fprintf cout "%s\n\n" (gen_eq_function compinfo));
+      ignore (P.fprintf cout "#endif\n\n")
+    | None ->
+      ignore (P.fprintf cout "%s\n\n" (gen_eq_function compinfo))
+  end;
   ignore (P.fprintf cout "%s\n\n" (gen_alloc_function compinfo));
   ignore (P.fprintf cout "#ifdef KLEE_VERIFICATION\n");
   ignore (P.fprintf cout "%s\n" (gen_str_field_descrs compinfo));
   ignore (P.fprintf cout "%s\n\n" (gen_hash_dummy compinfo));
   ignore (P.fprintf cout "#else//KLEE_VERIFICATION\n\n");
-  ignore (P.fprintf cout "%s\n\n" (gen_hash compinfo));
+  begin match masks with
+    | Some masks ->
+      ignore (P.fprintf cout "#ifdef PACKED_KEYS\n\n");
+      ignore (P.fprintf cout "%s\n\n" (gen_packed_hash compinfo masks));
+      ignore (P.fprintf cout "#else//PACKED_KEYS\n\n");
+      ignore (P.fprintf cout "%s\n\n" (gen_hash compinfo));
+      ignore (P.fprintf cout "#endif//PACKED_KEYS\n\n")
+    | None ->
+      ignore (P.fprintf cout "%s\n\n" (gen_hash compinfo))
+  end;
   ignore (P.fprintf cout "#endif//KLEE_VERIFICATION\n\n");
+  ignore (P.fprintf cout "#if %s\n\n" packed_keys_cond);
+  ignore (P.fprintf cout "#define HASH_BULK_LANES 4\n\n");
+  ignore (P.fprintf cout "%s\n\n" (gen_hash_bulk compinfo masks));
+  ignore (P.fprintf cout "#endif\n\n");
+  if is_map_key compinfo then begin
+    ignore (P.fprintf cout "#if %s\n" specialized_maps_cond);
+    ignore (P.fprintf cout "%s\n" (gen_map_ops compinfo));
+    ignore (P.fprintf cout "#endif\n\n")
+  end;
   close_out cout;
   ()
 
@@ -614,6 +835,16 @@ let fill_header_file compinfo header_fname orig_fname def_headers =
   ignore (P.fprintf cout "%s\n\n" (gen_predicate compinfo));
   ignore (P.fprintf cout "%s\n\n" (gen_logical_hash compinfo));
   ignore (P.fprintf cout "%s\n\n" (gen_hash_decl compinfo));
+  ignore (P.fprintf cout "#if %s\n" packed_keys_cond);
+  ignore (P.fprintf cout "%s\n" (gen_hash_bulk_decl compinfo));
+  ignore (P.fprintf cout "#endif\n\n");
+  if is_map_key compinfo then begin
+    ignore (P.fprintf cout "#if %s\n" specialized_maps_cond);
+    ignore (P.fprintf cout "%s\n" (gen_map_ops_decl compinfo));
+    ignore (P.fprintf cout "#else\n");
+    ignore (P.fprintf cout "%s\n" (gen_generic_map_ops_defs compinfo));
+    ignore (P.fprintf cout "#endif\n\n")
+  end;
   ignore (P.fprintf cout "%s\n\n" (gen_eq_function_decl compinfo));
   ignore (P.fprintf cout "%s\n\n" (gen_alloc_function_decl compinfo));
   ignore (P.fprintf cout "%s\n\n" (gen_log_fun_decl compinfo));
@@ -689,7 +920,13 @@ let main () =
   E.colorFlag := true;
   Cabs2cil.doCollapseCallCast := true;
   let usageMsg = "Usage: main.byte [options] source-files" in
-  Arg.parse [] Ciloptions.recordFile usageMsg;
+  let argSpecs = [
+    ("-map-keys",
+     Arg.String (fun keys ->
+         map_keys := Str.split (Str.regexp "[ ,]+") keys),
+     "<records> the records used as map keys, see NF_MAP_KEYS in Makefile")
+  ] in
+  Arg.parse argSpecs Ciloptions.recordFile usageMsg;
   Ciloptions.fileNames := List.rev !Ciloptions.fileNames;
   let files = List.map parseOneFile !Ciloptions.fileNames in
   let one =
@@ -5,6 +5,8 @@
 #include <stdint.h>
 
 #define RTE_MEMZONE_NAMESIZE 32
+#define RTE_MEMPOOL_NAMESIZE (RTE_MEMZONE_NAMESIZE - 3)
+#define RTE_MEMPOOL_CACHE_MAX_SIZE 512
 
 struct rte_mempool {
   char name[RTE_MEMZONE_NAMESIZE];
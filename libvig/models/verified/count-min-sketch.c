@@ -0,0 +1,45 @@
+#include "klee/klee.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include "libvig/unverified/count-min-sketch.h"
+
+struct CountMinSketch {
+  char dummy;
+};
+
+int cms_allocate(uint8_t width_log2, vigor_time_t period,
+                 struct CountMinSketch **sketch_out) {
+  klee_trace_ret();
+  //VV should be u8, but too lazy to add that to klee
+  klee_trace_param_u16(width_log2, "width_log2");
+  klee_trace_param_i64(period, "period");
+  klee_trace_param_ptr(sketch_out, sizeof(struct CountMinSketch*),
+                       "sketch_out");
+  int allocation_succeeded = klee_int("cms_alloc_success");
+  if (!allocation_succeeded)
+    return 0;
+  *sketch_out = malloc(sizeof(struct CountMinSketch));
+  return 1;
+}
+
+void cms_free(struct CountMinSketch *sketch) {
+  klee_assert(0);//Not supported
+}
+
+uint32_t cms_add(struct CountMinSketch *sketch, uint32_t key,
+                 vigor_time_t time) {
+  klee_trace_ret();
+  klee_trace_param_u64((uint64_t)sketch, "sketch");
+  klee_trace_param_u32(key, "key");
+  klee_trace_param_i64(time, "time");
+  return klee_int("cms_add_result");
+}
+
+uint32_t cms_estimate(struct CountMinSketch *sketch, uint32_t key,
+                      vigor_time_t time) {
+  klee_trace_ret();
+  klee_trace_param_u64((uint64_t)sketch, "sketch");
+  klee_trace_param_u32(key, "key");
+  klee_trace_param_i64(time, "time");
+  return klee_int("cms_estimate_result");
+}
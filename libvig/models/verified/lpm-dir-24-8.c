@@ -38,6 +38,15 @@ int lpm_update_elem(struct lpm *lpm, uint32_t prefix,
   return klee_int("lpm_update_elem_result");
 }
 
+int lpm_delete_elem(struct lpm *lpm, uint32_t prefix, uint8_t prefixlen) {
+  klee_trace_ret();
+  klee_trace_param_u64((uint64_t)lpm, "lpm");
+  klee_trace_param_u32(prefix, "prefix");
+  //VV should be u8, but too lazy to add that to klee
+  klee_trace_param_u16(prefixlen, "prefixlen");
+  return klee_int("lpm_delete_elem_result");
+}
+
 int lpm_lookup_elem(struct lpm *lpm, uint32_t prefix) {
   klee_trace_ret();
   klee_trace_param_u64((uint64_t)lpm, "lpm");
@@ -0,0 +1,137 @@
+#include <stdlib.h>
+
+#include "libvig/unverified/concurrent-map.h"
+#include "libvig/verified/map-layout.h"
+
+#ifdef CAPACITY_POW2
+#  define CMAP_LOOP(k, capacity) ((k) & ((capacity) - 1))
+#else
+#  define CMAP_LOOP(k, capacity) ((k) % (capacity))
+#endif
+
+#define CMAP_READ(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+struct ConcurrentMap {
+  // Odd while the writer is updating the map
+  unsigned seq;
+  // Only accessed by the writer
+  unsigned write_depth;
+  struct Map* map;
+};
+
+int cmap_allocate(map_keys_equality* keq, map_key_hash* khash,
+                  unsigned capacity, struct ConcurrentMap** map_out)
+{
+  struct ConcurrentMap* cmap =
+    (struct ConcurrentMap*) malloc(sizeof(struct ConcurrentMap));
+  if (cmap == NULL) {
+    return 0;
+  }
+
+  cmap->map = NULL;
+  if (!map_allocate(keq, khash, capacity, &cmap->map)) {
+    free(cmap);
+    return 0;
+  }
+
+  cmap->seq = 0;
+  cmap->write_depth = 0;
+  *map_out = cmap;
+  return 1;
+}
+
+unsigned cmap_read_begin(struct ConcurrentMap* map)
+{
+  for (;;) {
+    unsigned seq = __atomic_load_n(&map->seq, __ATOMIC_ACQUIRE);
+    if ((seq & 1) == 0) {
+      return seq;
+    }
+    __builtin_ia32_pause();
+  }
+}
+
+bool cmap_read_retry(struct ConcurrentMap* map, unsigned seq)
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&map->seq, __ATOMIC_RELAXED) != seq;
+}
+
+void cmap_write_begin(struct ConcurrentMap* map)
+{
+  if (map->write_depth++ == 0) {
+    __atomic_store_n(&map->seq, map->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+  }
+}
+
+void cmap_write_end(struct ConcurrentMap* map)
+{
+  if (--map->write_depth == 0) {
+    __atomic_store_n(&map->seq, map->seq + 1, __ATOMIC_RELEASE);
+  }
+}
+
+// Same probing as map_impl_get, except that the key pointer of a slot is
+// only dereferenced once the read section is known to be consistent so far:
+// a torn slot could otherwise hold a pointer that was never a key.
+int cmap_get(struct ConcurrentMap* map, void* key, int* value_out)
+{
+  struct Map* m = map->map;
+  unsigned hash = m->khash(key);
+  unsigned start = CMAP_LOOP(hash, m->capacity);
+
+  for (;;) {
+    unsigned seq = cmap_read_begin(map);
+    int found = 0;
+    int value = 0;
+    bool torn = false;
+
+    for (unsigned i = 0; i < m->capacity; ++i) {
+      unsigned index = CMAP_LOOP(start + i, m->capacity);
+      int bb = CMAP_READ(m->busybits[index]);
+      unsigned kh = CMAP_READ(m->khs[index]);
+      int chn = CMAP_READ(m->chns[index]);
+      void* kp = CMAP_READ(m->keyps[index]);
+      if (bb != 0 && kh == hash) {
+        if (cmap_read_retry(map, seq)) {
+          torn = true;
+          break;
+        }
+        if (m->keys_eq(kp, key)) {
+          value = CMAP_READ(m->vals[index]);
+          found = 1;
+          break;
+        }
+      } else if (chn == 0) {
+        break;
+      }
+    }
+
+    if (!torn && !cmap_read_retry(map, seq)) {
+      if (found) {
+        *value_out = value;
+      }
+      return found;
+    }
+  }
+}
+
+void cmap_put(struct ConcurrentMap* map, void* key, int value)
+{
+  cmap_write_begin(map);
+  map_put(map->map, key, value);
+  cmap_write_end(map);
+}
+
+void cmap_erase(struct ConcurrentMap* map, void* key, void** trash)
+{
+  cmap_write_begin(map);
+  map_erase(map->map, key, trash);
+  cmap_write_end(map);
+}
+
+unsigned cmap_size(struct ConcurrentMap* map)
+{
+  return map_size(map->map);
+}
@@ -0,0 +1,55 @@
+#ifndef _CONCURRENT_MAP_H_INCLUDED_
+#define _CONCURRENT_MAP_H_INCLUDED_
+
+#include <stdbool.h>
+
+#include "libvig/verified/map.h"
+
+// A Map that a single writer can update while any number of readers, on
+// other lcores, look it up without taking a lock, e.g. a backend table read
+// on every packet and updated only on heartbeats.
+//
+// It is a seqlock around a regular Map: the writer bumps a sequence counter
+// to an odd value before modifying the map and back to an even value after,
+// and readers retry their lookup if the counter was odd or changed in the
+// meantime. Readers never block the writer nor each other; a reader only
+// retries if it overlapped an update, which is rare for read-mostly tables.
+//
+// The keys are stored by reference, as with Map: the writer must not modify
+// or reuse the memory of a key while it is in the map, and memory of erased
+// keys must stay readable (which vectors guarantee), since a concurrent
+// reader may still compare against it before retrying.
+//
+// Not covered by the VeriFast proof.
+
+struct ConcurrentMap;
+
+int cmap_allocate(map_keys_equality* keq, map_key_hash* khash,
+                  unsigned capacity, struct ConcurrentMap** map_out);
+
+// Readers, on any lcore
+int cmap_get(struct ConcurrentMap* map, void* key, int* value_out);
+
+// Writer, on a single lcore
+void cmap_put(struct ConcurrentMap* map, void* key, int value);
+void cmap_erase(struct ConcurrentMap* map, void* key, void** trash);
+unsigned cmap_size(struct ConcurrentMap* map);
+
+// Read sections, to read other state updated along with the map (e.g. the
+// vector holding the values the map indexes) consistently with it:
+//   unsigned seq;
+//   do {
+//     seq = cmap_read_begin(map);
+//     ... cmap_get and reads of the other state ...
+//   } while (cmap_read_retry(map, seq));
+// cmap_get can be used in a read section, but not in a write section, where
+// it would wait for the section to end: the writer can read the map as is.
+unsigned cmap_read_begin(struct ConcurrentMap* map);
+bool cmap_read_retry(struct ConcurrentMap* map, unsigned seq);
+
+// Write sections, for the writer to update other state along with the map.
+// cmap_put and cmap_erase open their own section if none is open.
+void cmap_write_begin(struct ConcurrentMap* map);
+void cmap_write_end(struct ConcurrentMap* map);
+
+#endif//_CONCURRENT_MAP_H_INCLUDED_
@@ -0,0 +1,30 @@
+#include "libvig/unverified/containers-free.h"
+
+#include <stdlib.h>
+
+#include "libvig/verified/double-chain-layout.h"
+#include "libvig/verified/map-layout.h"
+#include "libvig/verified/vector-layout.h"
+
+void map_free(struct Map* map)
+{
+  free(map->busybits);
+  free(map->keyps);
+  free(map->khs);
+  free(map->chns);
+  free(map->vals);
+  free(map);
+}
+
+void vector_free(struct Vector* vector)
+{
+  free(vector->data);
+  free(vector);
+}
+
+void dchain_free(struct DoubleChain* chain)
+{
+  free(chain->cells);
+  free(chain->timestamps);
+  free(chain);
+}
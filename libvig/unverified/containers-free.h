@@ -0,0 +1,17 @@
+#ifndef _CONTAINERS_FREE_H_INCLUDED_
+#define _CONTAINERS_FREE_H_INCLUDED_
+
+#include "libvig/verified/double-chain.h"
+#include "libvig/verified/map.h"
+#include "libvig/verified/vector.h"
+
+// Frees a container and everything it allocated, e.g. to back out of a
+// partial initialization. Keys the map points to are not freed, they belong
+// to whoever put them, usually a vector.
+//
+// Not covered by the VeriFast proof, which never frees containers.
+void map_free(struct Map* map);
+void vector_free(struct Vector* vector);
+void dchain_free(struct DoubleChain* chain);
+
+#endif//_CONTAINERS_FREE_H_INCLUDED_
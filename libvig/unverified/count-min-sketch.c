@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "count-min-sketch.h"
+
+struct CountMinSketch {
+  uint32_t *counters; // cms_DEPTH rows of 2^width_log2 counters
+  uint8_t width_log2;
+  vigor_time_t period;
+  vigor_time_t period_start;
+};
+
+// Odd 64-bit multipliers, one per row
+static const uint64_t cms_seeds[cms_DEPTH] = {
+  0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full,
+  0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull
+};
+
+static inline uint32_t* cms_counter(struct CountMinSketch *sketch,
+                                    unsigned row, uint32_t key)
+{
+  uint64_t hash = ((uint64_t)key + 1) * cms_seeds[row];
+  uint32_t column = (uint32_t)(hash >> (64 - sketch->width_log2));
+  return &sketch->counters[((size_t)row << sketch->width_log2) + column];
+}
+
+static void cms_roll_period(struct CountMinSketch *sketch, vigor_time_t time)
+{
+  if (time - sketch->period_start < sketch->period) {
+    return;
+  }
+
+  memset(sketch->counters, 0,
+         sizeof(uint32_t) * ((size_t)cms_DEPTH << sketch->width_log2));
+  sketch->period_start = time;
+}
+
+int cms_allocate(uint8_t width_log2, vigor_time_t period,
+                 struct CountMinSketch **sketch_out)
+{
+  if (width_log2 == 0 || width_log2 > cms_MAX_WIDTH_LOG2 || period <= 0) {
+    return 0;
+  }
+
+  struct CountMinSketch* sketch =
+    (struct CountMinSketch*) malloc(sizeof(struct CountMinSketch));
+  if (sketch == NULL) {
+    return 0;
+  }
+
+  sketch->counters = (uint32_t*) calloc((size_t)cms_DEPTH << width_log2,
+                                        sizeof(uint32_t));
+  if (sketch->counters == NULL) {
+    free(sketch);
+    return 0;
+  }
+
+  sketch->width_log2 = width_log2;
+  sketch->period = period;
+  sketch->period_start = 0;
+  *sketch_out = sketch;
+  return 1;
+}
+
+void cms_free(struct CountMinSketch *sketch)
+{
+  free(sketch->counters);
+  free(sketch);
+}
+
+uint32_t cms_add(struct CountMinSketch *sketch, uint32_t key,
+                 vigor_time_t time)
+{
+  cms_roll_period(sketch, time);
+
+  uint32_t* counters[cms_DEPTH];
+  uint32_t min = UINT32_MAX;
+  for (unsigned row = 0; row < cms_DEPTH; row++) {
+    counters[row] = cms_counter(sketch, row, key);
+    if (*counters[row] < min) {
+      min = *counters[row];
+    }
+  }
+
+  if (min == UINT32_MAX) {
+    return min;
+  }
+
+  // Conservative update: the other counters already overestimate the key
+  for (unsigned row = 0; row < cms_DEPTH; row++) {
+    if (*counters[row] == min) {
+      *counters[row] = min + 1;
+    }
+  }
+  return min + 1;
+}
+
+uint32_t cms_estimate(struct CountMinSketch *sketch, uint32_t key,
+                      vigor_time_t time)
+{
+  cms_roll_period(sketch, time);
+
+  uint32_t min = UINT32_MAX;
+  for (unsigned row = 0; row < cms_DEPTH; row++) {
+    uint32_t count = *cms_counter(sketch, row, key);
+    if (count < min) {
+      min = count;
+    }
+  }
+  return min;
+}
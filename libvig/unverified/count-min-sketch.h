@@ -0,0 +1,37 @@
+#ifndef _COUNT_MIN_SKETCH_H_INCLUDED_
+#define _COUNT_MIN_SKETCH_H_INCLUDED_
+
+#include <stdint.h>
+
+include "libvig/verified/vigor-time.h"
+
+// Count-min sketch over 32-bit keys, e.g. IPv4 addresses: a fixed-size
+// approximation of "how many times was this key added", which may
+// overestimate but never underestimates. Counts are per period: the first
+// addition after a period has elapsed clears the sketch.
+//
+// It uses cms_DEPTH rows of 2^width_log2 counters, each row with its own
+// multiply-shift hash, and conservative updates (only the counters holding
+// the minimum are incremented), which keeps the overestimation low.
+
+#define cms_DEPTH 4
+#define cms_MAX_WIDTH_LOG2 20
+
+struct CountMinSketch;
+
+// Returns 1 on success, 0 on allocation failure or invalid arguments.
+// period is in nanoseconds.
+int cms_allocate(uint8_t width_log2, vigor_time_t period,
+                 struct CountMinSketch **sketch_out);
+
+void cms_free(struct CountMinSketch *sketch);
+
+// Adds one occurrence of key, and returns the new estimate for it.
+uint32_t cms_add(struct CountMinSketch *sketch, uint32_t key,
+                 vigor_time_t time);
+
+// Returns the estimated number of occurrences of key in the current period.
+uint32_t cms_estimate(struct CountMinSketch *sketch, uint32_t key,
+                      vigor_time_t time);
+
+#endif//_COUNT_MIN_SKETCH_H_INCLUDED_
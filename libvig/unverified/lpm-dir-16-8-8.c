@@ -0,0 +1,448 @@
+#ifdef LPM_DIR_16_8_8
+
+#include "lpm-dir-16-8-8.h"
+#include "lpm-epoch.h"
+#include "lpm-rule-trie.h"
+
+struct lpm {
+  uint16_t* lpm_16;
+  uint16_t* groups;
+  // Number of groups the pool has room for
+  uint32_t  groups_capacity;
+  // First group that has never been handed out
+  uint32_t  groups_index;
+  // Stack of groups that can be handed out again
+  uint16_t* free_groups;
+  uint32_t  free_groups_count;
+  // Released groups that readers may still be looking at; they join
+  // free_groups once the readers moved on
+  struct lpm_limbo limbo;
+  // Readers, and pools replaced by a bigger one that readers may still hold
+  struct lpm_epoch epoch;
+  // Rules currently installed, the tables are derived from it
+  struct lpm_rule_node* rules;
+};
+
+static uint32_t lpm_mask_from_prefixlen(uint8_t prefixlen)
+{
+  return prefixlen == 0 ? 0 : 0xFFFFFFFFu << (lpm_PLEN_MAX - prefixlen);
+}
+
+static inline bool lpm_entry_flag(uint16_t entry)
+{
+  return entry != INVALID && (entry & lpm_24_FLAG_MASK) != 0;
+}
+
+static inline uint16_t lpm_entry_group(uint16_t entry)
+{
+  return (uint16_t)(entry & lpm_24_VAL_MASK);
+}
+
+// Index, in the table of the level that ends at level_end, of the entry
+// that covers address.
+static inline uint32_t lpm_entry_index(uint32_t address, uint8_t level_end)
+{
+  if (level_end == lpm_16_PLEN_MAX) {
+    return address >> (lpm_PLEN_MAX - lpm_16_PLEN_MAX);
+  }
+  return (address >> (lpm_PLEN_MAX - level_end)) & (lpm_GROUP_SIZE - 1);
+}
+
+// See lpm-dir-24-8.c: single 16-bit accesses, and a release store
+// publishes everything written before it.
+static inline uint16_t lpm_entry_read(uint16_t *entry)
+{
+  return __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+}
+
+static inline void lpm_entry_write(uint16_t *entry, uint16_t value)
+{
+  __atomic_store_n(entry, value, __ATOMIC_RELEASE);
+}
+
+static inline uint16_t* lpm_group(struct lpm *_lpm, uint16_t group)
+{
+  return _lpm->groups + (uint32_t)group * lpm_GROUP_SIZE;
+}
+
+// Replaces the pool by a copy twice as big. Readers may still hold the old
+// one, so it is only freed once the readers moved on.
+static bool lpm_groups_grow(struct lpm *_lpm)
+{
+  if (_lpm->groups_capacity >= lpm_GROUP_MAX_COUNT ||
+      _lpm->epoch.retired_count == lpm_EPOCH_MAX_RETIRED) {
+    return false;
+  }
+
+  uint32_t new_capacity = _lpm->groups_capacity * 2;
+  if (new_capacity > lpm_GROUP_MAX_COUNT) {
+    new_capacity = lpm_GROUP_MAX_COUNT;
+  }
+
+  // The group stacks are private to the writer, growing them early is
+  // harmless if a later allocation fails.
+  uint16_t* free_groups = (uint16_t*) realloc(_lpm->free_groups,
+                                              new_capacity *
+                                              sizeof(uint16_t));
+  if (free_groups == 0) {
+    return false;
+  }
+  _lpm->free_groups = free_groups;
+
+  if (!lpm_limbo_resize(&_lpm->limbo, new_capacity)) {
+    return false;
+  }
+
+  uint16_t* groups = (uint16_t*) malloc(new_capacity * lpm_GROUP_SIZE *
+                                        sizeof(uint16_t));
+  if (groups == 0) {
+    return false;
+  }
+
+  uint16_t* old_groups = _lpm->groups;
+  memcpy(groups, old_groups,
+         _lpm->groups_capacity * lpm_GROUP_SIZE * sizeof(uint16_t));
+  __atomic_store_n(&_lpm->groups, groups, __ATOMIC_RELEASE);
+
+  // Checked above, cannot fail
+  lpm_epoch_retire(&_lpm->epoch, old_groups);
+  _lpm->groups_capacity = new_capacity;
+  return true;
+}
+
+static bool lpm_groups_allocate(struct lpm *_lpm, uint16_t *group_out)
+{
+  if (_lpm->free_groups_count > 0) {
+    _lpm->free_groups_count--;
+    *group_out = _lpm->free_groups[_lpm->free_groups_count];
+    return true;
+  }
+
+  if (_lpm->groups_index == _lpm->groups_capacity &&
+      !lpm_groups_grow(_lpm)) {
+    return false;
+  }
+
+  *group_out = (uint16_t)_lpm->groups_index;
+  _lpm->groups_index++;
+  return true;
+}
+
+// Makes sure the next count allocations succeed without growing the pool,
+// so that painting never has to deal with failures nor with the pool
+// moving under the entry pointers it holds.
+static bool lpm_groups_reserve(struct lpm *_lpm, uint32_t count)
+{
+  while (_lpm->free_groups_count < count) {
+    uint16_t group;
+    if (_lpm->groups_index == _lpm->groups_capacity &&
+        !lpm_groups_grow(_lpm)) {
+      return false;
+    }
+    group = (uint16_t)_lpm->groups_index;
+    _lpm->groups_index++;
+
+    _lpm->free_groups[_lpm->free_groups_count] = group;
+    _lpm->free_groups_count++;
+  }
+  return true;
+}
+
+// Releases a group and, for the second level, the groups it points to.
+static void lpm_groups_release(struct lpm *_lpm, uint16_t group,
+                               uint8_t level_end)
+{
+  if (level_end < lpm_PLEN_MAX) {
+    uint16_t* entries = lpm_group(_lpm, group);
+    for (uint32_t i = 0; i < lpm_GROUP_SIZE; i++) {
+      if (lpm_entry_flag(entries[i])) {
+        lpm_groups_release(_lpm, lpm_entry_group(entries[i]),
+                           level_end + lpm_GROUP_BITS);
+      }
+    }
+  }
+
+  lpm_limbo_add(&_lpm->limbo, &_lpm->epoch, group);
+}
+
+// Recycles the groups and frees the pools the readers are done with
+static void lpm_groups_reclaim(struct lpm *_lpm)
+{
+  uint64_t safe = lpm_epoch_safe(&_lpm->epoch);
+  lpm_limbo_reclaim(&_lpm->limbo, safe, _lpm->free_groups,
+                    &_lpm->free_groups_count);
+  lpm_epoch_reclaim(&_lpm->epoch, safe);
+}
+
+static void lpm_paint(struct lpm *_lpm, uint16_t *table, uint8_t level_end,
+                      struct lpm_rule_node *node, uint32_t prefix,
+                      uint8_t depth, uint16_t inherited, bool full);
+
+// Makes the entry for the node at a level boundary (depth == level_end)
+// point to a group holding the routes under the node.
+static void lpm_paint_group(struct lpm *_lpm, uint16_t *entry,
+                            uint8_t level_end, struct lpm_rule_node *node,
+                            uint32_t prefix, uint16_t inherited, bool full)
+{
+  uint16_t value = *entry;
+
+  if (lpm_entry_flag(value)) {
+    lpm_paint(_lpm, lpm_group(_lpm, lpm_entry_group(value)),
+              level_end + lpm_GROUP_BITS, node, prefix, level_end,
+              inherited, full);
+  } else {
+    uint16_t group = 0;
+    // Reserved by the caller of lpm_repaint, cannot fail
+    lpm_groups_allocate(_lpm, &group);
+
+    // A reused group still points to the groups it pointed to before,
+    // which have been released with it already.
+    uint16_t* entries = lpm_group(_lpm, group);
+    for (uint32_t i = 0; i < lpm_GROUP_SIZE; i++) {
+      entries[i] = INVALID;
+    }
+
+    lpm_paint(_lpm, entries, level_end + lpm_GROUP_BITS,
+              node, prefix, level_end, inherited, true);
+    lpm_entry_write(entry, (uint16_t)(group | lpm_24_FLAG_MASK));
+  }
+}
+
+// Writes the routes of the addresses under node (prefix/depth) into table,
+// the table of the level that ends at level_end. Unless full is set,
+// subtrees rooted at a rule are skipped: the rules above them do not
+// affect their addresses. An entry at a level boundary points to a group
+// iff the node for it has children.
+static void lpm_paint(struct lpm *_lpm, uint16_t *table, uint8_t level_end,
+                      struct lpm_rule_node *node, uint32_t prefix,
+                      uint8_t depth, uint16_t inherited, bool full)
+{
+  uint16_t route = lpm_rule_node_route(node, inherited);
+
+  if (depth == level_end && level_end < lpm_PLEN_MAX &&
+      lpm_rule_node_has_children(node)) {
+    lpm_paint_group(_lpm, &table[lpm_entry_index(prefix, level_end)],
+                    level_end, node, prefix, inherited, full);
+    return;
+  }
+
+  if (!lpm_rule_node_has_children(node)) {
+    uint32_t first_index = lpm_entry_index(prefix, level_end);
+    uint32_t last_index = first_index + (1u << (level_end - depth));
+    for (uint32_t i = first_index; i < last_index; i++) {
+      uint16_t old_value = table[i];
+      lpm_entry_write(&table[i], route);
+      if (level_end < lpm_PLEN_MAX && lpm_entry_flag(old_value)) {
+        lpm_groups_release(_lpm, lpm_entry_group(old_value),
+                           level_end + lpm_GROUP_BITS);
+      }
+    }
+    return;
+  }
+
+  for (unsigned bit = 0; bit < 2; bit++) {
+    struct lpm_rule_node* child = node->children[bit];
+    if (!full && child != NULL && child->has_route) {
+      continue;
+    }
+    lpm_paint(_lpm, table, level_end, child,
+              prefix | (bit << (31 - depth)), depth + 1, route, full);
+  }
+}
+
+// Brings the tables in line with the trie after the rule for
+// prefix/prefixlen changed. Walks down to the rule through the existing
+// groups; if a level boundary on the way gains its first or loses its last
+// longer rule, the group for it is created or released instead.
+static void lpm_repaint(struct lpm *_lpm, uint32_t prefix, uint8_t prefixlen)
+{
+  uint16_t* table = _lpm->lpm_16;
+  uint8_t level_end = lpm_16_PLEN_MAX;
+  struct lpm_rule_node* node = _lpm->rules;
+  uint16_t inherited = INVALID;
+
+  for (uint8_t depth = 0; ; depth++) {
+    if (depth == prefixlen) {
+      lpm_paint(_lpm, table, level_end, node, prefix, depth, inherited,
+                false);
+      return;
+    }
+
+    if (depth == level_end) {
+      uint16_t* entry = &table[lpm_entry_index(prefix, level_end)];
+      if (!lpm_rule_node_has_children(node) || !lpm_entry_flag(*entry)) {
+        lpm_paint(_lpm, table, level_end, node,
+                  prefix & lpm_mask_from_prefixlen(depth), depth, inherited,
+                  false);
+        return;
+      }
+      table = lpm_group(_lpm, lpm_entry_group(*entry));
+      level_end += lpm_GROUP_BITS;
+    }
+
+    inherited = lpm_rule_node_route(node, inherited);
+    node = lpm_rule_node_child(node, lpm_rule_prefix_bit(prefix, depth));
+  }
+}
+
+int lpm_allocate(struct lpm **lpm_out)
+{
+  struct lpm* _lpm = (struct lpm*) malloc(sizeof(struct lpm));
+  if (_lpm == 0) {
+    return 0;
+  }
+
+  uint16_t* lpm_16 = (uint16_t*) malloc(lpm_16_MAX_ENTRIES *
+                                        sizeof(uint16_t));
+  if (lpm_16 == 0) {
+    goto err_lpm;
+  }
+
+  uint16_t* groups = (uint16_t*) malloc(lpm_GROUP_INITIAL_COUNT *
+                                        lpm_GROUP_SIZE * sizeof(uint16_t));
+  if (groups == 0) {
+    goto err_lpm_16;
+  }
+
+  uint16_t* free_groups = (uint16_t*) malloc(lpm_GROUP_INITIAL_COUNT *
+                                             sizeof(uint16_t));
+  if (free_groups == 0) {
+    goto err_groups;
+  }
+
+  _lpm->limbo.groups = 0;
+  _lpm->limbo.epochs = 0;
+  _lpm->limbo.count = 0;
+  if (!lpm_limbo_resize(&_lpm->limbo, lpm_GROUP_INITIAL_COUNT)) {
+    goto err_limbo;
+  }
+
+  struct lpm_rule_node* rules;
+  if (!lpm_rule_trie_allocate(&rules)) {
+    goto err_limbo;
+  }
+
+  for (uint32_t i = 0; i < lpm_16_MAX_ENTRIES; i++) {
+    lpm_16[i] = INVALID;
+  }
+
+  _lpm->lpm_16 = lpm_16;
+  _lpm->groups = groups;
+  _lpm->groups_capacity = lpm_GROUP_INITIAL_COUNT;
+  _lpm->groups_index = 0;
+  _lpm->free_groups = free_groups;
+  _lpm->free_groups_count = 0;
+  lpm_epoch_init(&_lpm->epoch);
+  _lpm->rules = rules;
+
+  *lpm_out = _lpm;
+  return 1;
+
+err_limbo:
+  lpm_limbo_free(&_lpm->limbo);
+  free(free_groups);
+err_groups:
+  free(groups);
+err_lpm_16:
+  free(lpm_16);
+err_lpm:
+  free(_lpm);
+  return 0;
+}
+
+void lpm_free(struct lpm *_lpm)
+{
+  lpm_rule_trie_free(_lpm->rules);
+  lpm_epoch_free(&_lpm->epoch);
+  lpm_limbo_free(&_lpm->limbo);
+  free(_lpm->free_groups);
+  free(_lpm->groups);
+  free(_lpm->lpm_16);
+  free(_lpm);
+}
+
+int lpm_lookup_elem(struct lpm *_lpm, uint32_t prefix)
+{
+  uint16_t value = lpm_entry_read(&_lpm->lpm_16[prefix >> 16]);
+
+  if (lpm_entry_flag(value)) {
+    //the pool is loaded after the entry: a group is never published before
+    //the pool that holds it.
+    uint16_t *groups = __atomic_load_n(&_lpm->groups, __ATOMIC_ACQUIRE);
+
+    uint32_t index = (uint32_t)lpm_entry_group(value) * lpm_GROUP_SIZE +
+                     ((prefix >> 8) & 0xFF);
+    value = lpm_entry_read(&groups[index]);
+
+    if (lpm_entry_flag(value)) {
+      index = (uint32_t)lpm_entry_group(value) * lpm_GROUP_SIZE +
+              (prefix & 0xFF);
+      value = lpm_entry_read(&groups[index]);
+    }
+  }
+
+  return value;
+}
+
+int lpm_update_elem(struct lpm *_lpm, uint32_t prefix,
+                    uint8_t prefixlen, uint16_t value)
+{
+  if (prefixlen > lpm_PLEN_MAX || value > MAX_NEXT_HOP_VALUE) {
+    return 0;
+  }
+
+  lpm_groups_reclaim(_lpm);
+
+  uint32_t masked_ip = prefix & lpm_mask_from_prefixlen(prefixlen);
+
+  //A rule longer than /16 may need a group on each of the two lower levels
+  if (prefixlen > lpm_16_PLEN_MAX && !lpm_groups_reserve(_lpm, 2)) {
+    printf("No more available groups for lpm!\n");
+    fflush(stdout);
+    return 0;
+  }
+
+  if (!lpm_rule_trie_insert(_lpm->rules, masked_ip, prefixlen, value)) {
+    return 0;
+  }
+
+  lpm_repaint(_lpm, masked_ip, prefixlen);
+  lpm_epoch_advance(&_lpm->epoch);
+  return 1;
+}
+
+int lpm_delete_elem(struct lpm *_lpm, uint32_t prefix, uint8_t prefixlen)
+{
+  if (prefixlen > lpm_PLEN_MAX) {
+    return 0;
+  }
+
+  lpm_groups_reclaim(_lpm);
+
+  uint32_t masked_ip = prefix & lpm_mask_from_prefixlen(prefixlen);
+
+  if (!lpm_rule_trie_remove(_lpm->rules, masked_ip, prefixlen)) {
+    return 0;
+  }
+
+  lpm_repaint(_lpm, masked_ip, prefixlen);
+  lpm_epoch_advance(&_lpm->epoch);
+  return 1;
+}
+
+void lpm_reader_online(struct lpm *_lpm, unsigned reader)
+{
+  lpm_epoch_reader_online(&_lpm->epoch, reader);
+}
+
+void lpm_reader_offline(struct lpm *_lpm, unsigned reader)
+{
+  lpm_epoch_reader_offline(&_lpm->epoch, reader);
+}
+
+void lpm_reader_quiescent(struct lpm *_lpm, unsigned reader)
+{
+  lpm_epoch_reader_quiescent(&_lpm->epoch, reader);
+}
+
+#endif//LPM_DIR_16_8_8
@@ -0,0 +1,37 @@
+#ifndef _LPM_DIR_16_8_8_H_INCLUDED_
+#define _LPM_DIR_16_8_8_H_INCLUDED_
+
+// Same API as lpm-dir-24-8.h, which declares it; build with -DLPM_DIR_16_8_8
+// (VIGOR_LPM=dir-16-8-8 in Makefile.dpdk) to use this implementation.
+#include "libvig/verified/lpm-dir-24-8.h"
+
+// The lookup goes through up to three levels: lpm_16 is indexed by the 16
+// MSB of the address, the next two bytes each index a group of
+// lpm_GROUP_SIZE entries. All groups, whichever level they are on, come
+// from a single pool.
+// The entries of lpm_16 and of the groups of the second level are as
+// follows:
+//   bit15: 0->next hop, 1->next level lookup
+//   bit14-0: value of next hop or index of the group in the pool
+// The entries of the groups of the third level hold a next hop.
+//
+// lpm_16 takes 128 KB and each group 512 B, so a table of a few thousand
+// routes stays within a few MB and mostly in cache, unlike the 32 MB lpm_24
+// of DIR-24-8. The price is one more memory access for the prefixes longer
+// than /16.
+//
+// Rules are kept in a trie (lpm-rule-trie.h) and can be added and removed
+// in any order, with the same single-writer, concurrent-readers guarantees
+// as DIR-24-8, and the same reclamation once registered readers are
+// quiescent (lpm-epoch.h).
+
+#define lpm_16_MAX_ENTRIES 65536 //= 2^16
+#define lpm_16_PLEN_MAX 16
+
+#define lpm_GROUP_SIZE 256
+#define lpm_GROUP_BITS 8
+#define lpm_GROUP_INITIAL_COUNT 64
+// A flagged entry holding group 0x7FFF would read as INVALID
+#define lpm_GROUP_MAX_COUNT 0x7FFF
+
+#endif//_LPM_DIR_16_8_8_H_INCLUDED_
@@ -0,0 +1,490 @@
+#ifndef LPM_DIR_16_8_8
+
+#include "libvig/verified/lpm-dir-24-8.h"
+#include "lpm-epoch.h"
+#include "lpm-rule-trie.h"
+
+struct rule {
+  uint32_t ipv4;
+  uint8_t prefixlen;
+  uint16_t route;
+};
+
+
+struct lpm {
+  uint16_t* lpm_24;
+  uint16_t* lpm_long;
+  // Number of groups lpm_long has room for
+  uint32_t  lpm_long_groups;
+  // First group that has never been handed out
+  uint32_t  lpm_long_index;
+  // Stack of groups that can be handed out again
+  uint16_t* free_groups;
+  uint32_t  free_groups_count;
+  // Released groups that readers may still be looking at; they join
+  // free_groups once the readers moved on
+  struct lpm_limbo limbo;
+  // Readers, and lpm_long arrays replaced by a bigger one that readers may
+  // still hold
+  struct lpm_epoch epoch;
+  // Rules currently installed, the tables are derived from it
+  struct lpm_rule_node* rules;
+};
+
+void fill_invalid(uint16_t *t, uint32_t size)
+{
+  for (uint32_t i = 0; i < size; i++) {
+    t[i] = INVALID;
+  }
+}
+
+uint32_t build_mask_from_prefixlen(uint8_t prefixlen)
+{
+  uint32_t ip_masks[33] = { 0x00000000, 0x80000000, 0xC0000000, 0xE0000000,
+                            0xF0000000, 0xF8000000, 0xFC000000, 0xFE000000,
+                            0xFF000000, 0xFF800000, 0xFFC00000, 0xFFE00000,
+                            0xFFF00000, 0xFFF80000, 0xFFFC0000, 0xFFFE0000,
+                            0xFFFF0000, 0xFFFF8000, 0xFFFFC000, 0xFFFFE000,
+                            0xFFFFF000, 0xFFFFF800, 0xFFFFFC00, 0xFFFFFE00,
+                            0xFFFFFF00, 0xFFFFFF80, 0xFFFFFFC0, 0xFFFFFFE0,
+                            0xFFFFFFF0, 0xFFFFFFF8, 0xFFFFFFFC, 0xFFFFFFFE,
+                            0xFFFFFFFF};
+
+  return ip_masks[prefixlen];
+}
+
+// Extract the 24 MSB of an uint8_t array and returns them
+uint32_t lpm_24_extract_first_index(uint32_t data)
+{
+  uint32_t res = data >> BYTE_SIZE;
+  return res;
+}
+
+
+// Computes how many entries the rule will take
+uint32_t compute_rule_size(uint8_t prefixlen)
+{
+  if (prefixlen < 25) {
+    uint32_t res[25] = { 0x1000000, 0x800000, 0x400000, 0x200000, 0x100000,
+                         0x80000,   0x40000,  0x20000,  0x10000,  0x8000,
+                         0x4000,    0x2000,   0x1000,   0x800,    0x400,
+                         0x200,     0x100 ,   0x80,     0x40,     0x20,
+                         0x10,      0x8,      0x4,      0x2,      0x1};
+    uint32_t v = res[prefixlen];
+    return v;
+  } else {
+    uint32_t res[8] = {0x80, 0x40, 0x20, 0x10, 0x8, 0x4, 0x2, 0x1};
+    uint32_t v = res[prefixlen-25];
+    return v;
+  }
+}
+
+bool lpm_24_entry_flag(uint16_t entry)
+{
+  return (entry >> 15) == 1;
+}
+
+
+
+uint16_t lpm_24_entry_set_flag(uint16_t entry)
+{
+  uint16_t res = (uint16_t)(entry | lpm_24_FLAG_MASK);
+  return res;
+}
+
+uint32_t lpm_long_extract_first_index(uint32_t data, uint8_t prefixlen,
+                                      uint16_t base_index)
+{
+
+  uint32_t mask = build_mask_from_prefixlen(prefixlen);
+  uint32_t masked_data = data & mask;
+
+  uint8_t last_byte = (uint8_t)(masked_data & 0xFF);
+
+  uint32_t res = (uint32_t)base_index*lpm_LONG_FACTOR + last_byte;
+
+  return res;
+}
+
+// Datapath entries are read and written with single 16-bit atomic accesses,
+// so a lookup racing with an update sees either the old or the new route of
+// an address, never a mix. The release store that publishes an entry also
+// publishes every write made before it (e.g. the content of a new group).
+static inline uint16_t lpm_entry_read(uint16_t *entry)
+{
+  return __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+}
+
+static inline void lpm_entry_write(uint16_t *entry, uint16_t value)
+{
+  __atomic_store_n(entry, value, __ATOMIC_RELEASE);
+}
+
+// Replaces lpm_long by an array twice as big. Readers may still hold the
+// old array, so it is copied rather than reallocated, and only freed once
+// the readers moved on.
+static bool lpm_long_grow(struct lpm *_lpm)
+{
+  if (_lpm->lpm_long_groups >= lpm_LONG_MAX_GROUPS ||
+      _lpm->epoch.retired_count == lpm_EPOCH_MAX_RETIRED) {
+    return false;
+  }
+
+  uint32_t new_groups = _lpm->lpm_long_groups * 2;
+  if (new_groups > lpm_LONG_MAX_GROUPS) {
+    new_groups = lpm_LONG_MAX_GROUPS;
+  }
+
+  // The group stacks are private to the writer, growing them early is
+  // harmless if a later allocation fails.
+  uint16_t* free_groups = (uint16_t*) realloc(_lpm->free_groups,
+                                              new_groups * sizeof(uint16_t));
+  if (free_groups == 0) {
+    return false;
+  }
+  _lpm->free_groups = free_groups;
+
+  if (!lpm_limbo_resize(&_lpm->limbo, new_groups)) {
+    return false;
+  }
+
+  uint16_t* lpm_long = (uint16_t*) malloc(new_groups * lpm_LONG_FACTOR *
+                                          sizeof(uint16_t));
+  if (lpm_long == 0) {
+    return false;
+  }
+
+  uint16_t* old_long = _lpm->lpm_long;
+  memcpy(lpm_long, old_long,
+         _lpm->lpm_long_groups * lpm_LONG_FACTOR * sizeof(uint16_t));
+  __atomic_store_n(&_lpm->lpm_long, lpm_long, __ATOMIC_RELEASE);
+
+  // Checked above, cannot fail
+  lpm_epoch_retire(&_lpm->epoch, old_long);
+  _lpm->lpm_long_groups = new_groups;
+  return true;
+}
+
+// Hands out a group of lpm_long, reusing released groups first and growing
+// the pool when every group is in use. Returns false if the pool is at
+// lpm_LONG_MAX_GROUPS already.
+static bool lpm_long_allocate_group(struct lpm *_lpm, uint16_t *group_out)
+{
+  if (_lpm->free_groups_count > 0) {
+    _lpm->free_groups_count--;
+    *group_out = _lpm->free_groups[_lpm->free_groups_count];
+    return true;
+  }
+
+  if (_lpm->lpm_long_index == _lpm->lpm_long_groups &&
+      !lpm_long_grow(_lpm)) {
+    return false;
+  }
+
+  *group_out = (uint16_t)_lpm->lpm_long_index;
+  _lpm->lpm_long_index++;
+  return true;
+}
+
+// Makes sure the next lpm_long_allocate_group succeeds, so that an update
+// can fail before it changes anything.
+static bool lpm_long_reserve_group(struct lpm *_lpm)
+{
+  uint16_t group;
+  if (!lpm_long_allocate_group(_lpm, &group)) {
+    return false;
+  }
+
+  _lpm->free_groups[_lpm->free_groups_count] = group;
+  _lpm->free_groups_count++;
+  return true;
+}
+
+static void lpm_long_release_group(struct lpm *_lpm, uint16_t group)
+{
+  lpm_limbo_add(&_lpm->limbo, &_lpm->epoch, group);
+}
+
+// Recycles the groups and frees the arrays the readers are done with
+static void lpm_reclaim(struct lpm *_lpm)
+{
+  uint64_t safe = lpm_epoch_safe(&_lpm->epoch);
+  lpm_limbo_reclaim(&_lpm->limbo, safe, _lpm->free_groups,
+                    &_lpm->free_groups_count);
+  lpm_epoch_reclaim(&_lpm->epoch, safe);
+}
+
+// Writes the routes of the addresses under node (prefix/depth, depth >= 24)
+// into group. Unless full is set, subtrees rooted at a rule are skipped:
+// the rules above them do not affect their addresses.
+static void lpm_long_paint(uint16_t *group, struct lpm_rule_node *node,
+                           uint32_t prefix, uint8_t depth, uint16_t inherited,
+                           bool full)
+{
+  uint16_t route = lpm_rule_node_route(node, inherited);
+
+  if (!lpm_rule_node_has_children(node)) {
+    uint32_t first_index = prefix & 0xFF;
+    uint32_t last_index = first_index + (1u << (lpm_PLEN_MAX - depth));
+    for (uint32_t i = first_index; i < last_index; i++) {
+      lpm_entry_write(&group[i], route);
+    }
+    return;
+  }
+
+  for (unsigned bit = 0; bit < 2; bit++) {
+    struct lpm_rule_node* child = node->children[bit];
+    if (!full && child != NULL && child->has_route) {
+      continue;
+    }
+    lpm_long_paint(group, child, prefix | (bit << (31 - depth)), depth + 1,
+                   route, full);
+  }
+}
+
+// Same as lpm_long_paint, for the part of the trie above the /24s. A /24
+// whose node has children points to a group, any other /24 holds its route
+// directly; groups are created and released to keep it that way.
+static void lpm_24_paint(struct lpm *_lpm, struct lpm_rule_node *node,
+                         uint32_t prefix, uint8_t depth, uint16_t inherited,
+                         bool full)
+{
+  uint16_t *lpm_24 = _lpm->lpm_24;
+  uint16_t route = lpm_rule_node_route(node, inherited);
+
+  if (depth == lpm_24_PLEN_MAX && lpm_rule_node_has_children(node)) {
+    uint32_t index = lpm_24_extract_first_index(prefix);
+    uint16_t value = lpm_24[index];
+
+    if (value != INVALID && lpm_24_entry_flag(value)) {
+      uint16_t group = (uint16_t)(value & lpm_24_VAL_MASK);
+      lpm_long_paint(_lpm->lpm_long + (uint32_t)group * lpm_LONG_FACTOR,
+                     node, prefix, depth, inherited, full);
+    } else {
+      uint16_t group;
+      // Reserved by lpm_update_elem, cannot fail
+      lpm_long_allocate_group(_lpm, &group);
+      lpm_long_paint(_lpm->lpm_long + (uint32_t)group * lpm_LONG_FACTOR,
+                     node, prefix, depth, inherited, true);
+      lpm_entry_write(&lpm_24[index], lpm_24_entry_set_flag(group));
+    }
+    return;
+  }
+
+  if (!lpm_rule_node_has_children(node)) {
+    uint32_t first_index = lpm_24_extract_first_index(prefix);
+    uint32_t last_index = first_index + compute_rule_size(depth);
+    for (uint32_t i = first_index; i < last_index; i++) {
+      uint16_t old_value = lpm_24[i];
+      lpm_entry_write(&lpm_24[i], route);
+      if (old_value != INVALID && lpm_24_entry_flag(old_value)) {
+        lpm_long_release_group(_lpm,
+                               (uint16_t)(old_value & lpm_24_VAL_MASK));
+      }
+    }
+    return;
+  }
+
+  for (unsigned bit = 0; bit < 2; bit++) {
+    struct lpm_rule_node* child = node->children[bit];
+    if (!full && child != NULL && child->has_route) {
+      continue;
+    }
+    lpm_24_paint(_lpm, child, prefix | (bit << (31 - depth)), depth + 1,
+                 route, full);
+  }
+}
+
+// Brings the tables in line with the trie after the rule for
+// prefix/prefixlen changed. Rules longer than /24 only affect their /24,
+// which is repainted as a whole so that its group can be created or
+// collapsed.
+static void lpm_repaint(struct lpm *_lpm, uint32_t prefix, uint8_t prefixlen)
+{
+  bool full = prefixlen > lpm_24_PLEN_MAX;
+  uint8_t depth = full ? lpm_24_PLEN_MAX : prefixlen;
+  uint32_t masked_ip = prefix & build_mask_from_prefixlen(depth);
+
+  uint16_t inherited;
+  struct lpm_rule_node* node = lpm_rule_trie_find(_lpm->rules, masked_ip,
+                                                  depth, &inherited);
+  lpm_24_paint(_lpm, node, masked_ip, depth, inherited, full);
+}
+
+int lpm_allocate(struct lpm **lpm_out)
+{
+  struct lpm* _lpm = (struct lpm*) malloc(sizeof(struct lpm));
+  if (_lpm == 0) {
+    return 0;
+  }
+
+  uint16_t* lpm_24 = (uint16_t*) malloc(lpm_24_MAX_ENTRIES *
+                                        sizeof(uint16_t));
+  if (lpm_24 == 0) {
+    goto err_lpm;
+  }
+
+  uint16_t* lpm_long = (uint16_t*) malloc(lpm_LONG_INITIAL_GROUPS *
+                                          lpm_LONG_FACTOR *
+                                          sizeof(uint16_t));
+  if (lpm_long == 0) {
+    goto err_lpm_24;
+  }
+
+  uint16_t* free_groups = (uint16_t*) malloc(lpm_LONG_INITIAL_GROUPS *
+                                             sizeof(uint16_t));
+  if (free_groups == 0) {
+    goto err_lpm_long;
+  }
+
+  _lpm->limbo.groups = 0;
+  _lpm->limbo.epochs = 0;
+  _lpm->limbo.count = 0;
+  if (!lpm_limbo_resize(&_lpm->limbo, lpm_LONG_INITIAL_GROUPS)) {
+    goto err_limbo;
+  }
+
+  struct lpm_rule_node* rules;
+  if (!lpm_rule_trie_allocate(&rules)) {
+    goto err_limbo;
+  }
+
+  //Set every element of the array to INVALID
+  fill_invalid(lpm_24, lpm_24_MAX_ENTRIES);
+
+  _lpm->lpm_24 = lpm_24;
+  _lpm->lpm_long = lpm_long;
+  _lpm->lpm_long_groups = lpm_LONG_INITIAL_GROUPS;
+  _lpm->lpm_long_index = 0;
+  _lpm->free_groups = free_groups;
+  _lpm->free_groups_count = 0;
+  lpm_epoch_init(&_lpm->epoch);
+  _lpm->rules = rules;
+
+  *lpm_out = _lpm;
+  return 1;
+
+err_limbo:
+  lpm_limbo_free(&_lpm->limbo);
+  free(free_groups);
+err_lpm_long:
+  free(lpm_long);
+err_lpm_24:
+  free(lpm_24);
+err_lpm:
+  free(_lpm);
+  return 0;
+}
+
+void lpm_free(struct lpm *_lpm)
+{
+  lpm_rule_trie_free(_lpm->rules);
+  lpm_epoch_free(&_lpm->epoch);
+  lpm_limbo_free(&_lpm->limbo);
+  free(_lpm->free_groups);
+  free(_lpm->lpm_long);
+  free(_lpm->lpm_24);
+  free(_lpm);
+}
+
+int lpm_lookup_elem(struct lpm *_lpm, uint32_t prefix)
+{
+  //get index corresponding to key for lpm_24
+  uint32_t index = lpm_24_extract_first_index(prefix);
+
+  uint16_t value = lpm_entry_read(&_lpm->lpm_24[index]);
+
+  if (value != INVALID && lpm_24_entry_flag(value)) {
+  //the value found in lpm_24 is a base index for an entry in lpm_long,
+  //go look at the index corresponding to the key and this base index.
+  //lpm_long is loaded after the entry: a group is never published before
+  //the array that holds it.
+    uint16_t *lpm_long = __atomic_load_n(&_lpm->lpm_long, __ATOMIC_ACQUIRE);
+    uint16_t extracted_index = (uint16_t)(value & lpm_24_VAL_MASK);
+    uint32_t index_long = lpm_long_extract_first_index(prefix, 32,
+                                                       extracted_index);
+    uint16_t value_long = lpm_entry_read(&lpm_long[index_long]);
+
+    if (value_long == INVALID) {
+      return INVALID;
+    } else {
+      return value_long;
+    }
+  } else {
+  //the value found in lpm_24 is the next hop, just return it
+
+    if (value == INVALID) {
+      return INVALID;
+    } else {
+      return value;
+    }
+  }
+}
+
+int lpm_update_elem(struct lpm *_lpm, uint32_t prefix,
+                    uint8_t prefixlen, uint16_t value)
+{
+  if (prefixlen > lpm_PLEN_MAX || value > MAX_NEXT_HOP_VALUE) {
+    return 0;
+  }
+
+  lpm_reclaim(_lpm);
+
+  uint32_t masked_ip = prefix & build_mask_from_prefixlen(prefixlen);
+
+  //A rule longer than /24 under a /24 without a group needs a new one
+  if (prefixlen > lpm_24_PLEN_MAX) {
+    uint16_t lpm_24_value =
+      _lpm->lpm_24[lpm_24_extract_first_index(masked_ip)];
+    if ((lpm_24_value == INVALID || !lpm_24_entry_flag(lpm_24_value)) &&
+        !lpm_long_reserve_group(_lpm)) {
+      printf("No more available index for lpm_long!\n");
+      fflush(stdout);
+      return 0;
+    }
+  }
+
+  if (!lpm_rule_trie_insert(_lpm->rules, masked_ip, prefixlen, value)) {
+    return 0;
+  }
+
+  lpm_repaint(_lpm, masked_ip, prefixlen);
+  lpm_epoch_advance(&_lpm->epoch);
+  return 1;
+}
+
+int lpm_delete_elem(struct lpm *_lpm, uint32_t prefix, uint8_t prefixlen)
+{
+  if (prefixlen > lpm_PLEN_MAX) {
+    return 0;
+  }
+
+  lpm_reclaim(_lpm);
+
+  uint32_t masked_ip = prefix & build_mask_from_prefixlen(prefixlen);
+
+  if (!lpm_rule_trie_remove(_lpm->rules, masked_ip, prefixlen)) {
+    return 0;
+  }
+
+  lpm_repaint(_lpm, masked_ip, prefixlen);
+  lpm_epoch_advance(&_lpm->epoch);
+  return 1;
+}
+
+void lpm_reader_online(struct lpm *_lpm, unsigned reader)
+{
+  lpm_epoch_reader_online(&_lpm->epoch, reader);
+}
+
+void lpm_reader_offline(struct lpm *_lpm, unsigned reader)
+{
+  lpm_epoch_reader_offline(&_lpm->epoch, reader);
+}
+
+void lpm_reader_quiescent(struct lpm *_lpm, unsigned reader)
+{
+  lpm_epoch_reader_quiescent(&_lpm->epoch, reader);
+}
+
+#endif//LPM_DIR_16_8_8
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+
+#include "lpm-epoch.h"
+
+void lpm_epoch_init(struct lpm_epoch *epoch)
+{
+  // Epoch 0 means offline
+  epoch->current = 1;
+  for (unsigned reader = 0; reader < lpm_MAX_READERS; reader++) {
+    epoch->readers[reader].epoch = 0;
+  }
+  epoch->retired_count = 0;
+}
+
+void lpm_epoch_reader_online(struct lpm_epoch *epoch, unsigned reader)
+{
+  // Between the load and the store, the writer may start a new epoch, find
+  // this reader offline and reclaim what the loaded epoch can still reach.
+  // Loading the epoch again after the store catches that: with sequentially
+  // consistent accesses, if it did not change, the writer sees the store.
+  uint64_t current;
+  do {
+    current = __atomic_load_n(&epoch->current, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&epoch->readers[reader].epoch, current,
+                     __ATOMIC_SEQ_CST);
+  } while (__atomic_load_n(&epoch->current, __ATOMIC_SEQ_CST) != current);
+}
+
+void lpm_epoch_reader_offline(struct lpm_epoch *epoch, unsigned reader)
+{
+  // Release: the lookups made so far are over before the writer sees this
+  __atomic_store_n(&epoch->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+void lpm_epoch_reader_quiescent(struct lpm_epoch *epoch, unsigned reader)
+{
+  // Acquire: the next lookups see what the writer unlinked before starting
+  // that epoch. Release: the lookups made so far are over before the
+  // writer sees the new epoch. The previous announcement holds the writer
+  // back meanwhile, so unlike going online this needs no second look.
+  uint64_t current = __atomic_load_n(&epoch->current, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&epoch->readers[reader].epoch, current, __ATOMIC_RELEASE);
+}
+
+void lpm_epoch_advance(struct lpm_epoch *epoch)
+{
+  __atomic_store_n(&epoch->current, epoch->current + 1, __ATOMIC_SEQ_CST);
+}
+
+uint64_t lpm_epoch_safe(struct lpm_epoch *epoch)
+{
+  uint64_t safe = epoch->current;
+  for (unsigned reader = 0; reader < lpm_MAX_READERS; reader++) {
+    uint64_t announced = __atomic_load_n(&epoch->readers[reader].epoch,
+                                         __ATOMIC_SEQ_CST);
+    if (announced != 0 && announced < safe) {
+      safe = announced;
+    }
+  }
+  return safe;
+}
+
+bool lpm_epoch_retire(struct lpm_epoch *epoch, void *array)
+{
+  if (epoch->retired_count == lpm_EPOCH_MAX_RETIRED) {
+    return false;
+  }
+  epoch->retired[epoch->retired_count] = array;
+  epoch->retired_epochs[epoch->retired_count] = epoch->current;
+  epoch->retired_count++;
+  return true;
+}
+
+void lpm_epoch_reclaim(struct lpm_epoch *epoch, uint64_t safe)
+{
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < epoch->retired_count; i++) {
+    if (epoch->retired_epochs[i] < safe) {
+      free(epoch->retired[i]);
+    } else {
+      epoch->retired[kept] = epoch->retired[i];
+      epoch->retired_epochs[kept] = epoch->retired_epochs[i];
+      kept++;
+    }
+  }
+  epoch->retired_count = kept;
+}
+
+void lpm_epoch_free(struct lpm_epoch *epoch)
+{
+  for (uint32_t i = 0; i < epoch->retired_count; i++) {
+    free(epoch->retired[i]);
+  }
+  epoch->retired_count = 0;
+}
+
+bool lpm_limbo_resize(struct lpm_limbo *limbo, uint32_t capacity)
+{
+  uint16_t* groups = (uint16_t*) realloc(limbo->groups,
+                                         capacity * sizeof(uint16_t));
+  if (groups == 0) {
+    return false;
+  }
+  limbo->groups = groups;
+
+  uint64_t* epochs = (uint64_t*) realloc(limbo->epochs,
+                                         capacity * sizeof(uint64_t));
+  if (epochs == 0) {
+    return false;
+  }
+  limbo->epochs = epochs;
+  return true;
+}
+
+void lpm_limbo_add(struct lpm_limbo *limbo, struct lpm_epoch *epoch,
+                   uint16_t group)
+{
+  limbo->groups[limbo->count] = group;
+  limbo->epochs[limbo->count] = epoch->current;
+  limbo->count++;
+}
+
+void lpm_limbo_reclaim(struct lpm_limbo *limbo, uint64_t safe,
+                       uint16_t *free_groups, uint32_t *free_groups_count)
+{
+  // Groups are added in epoch order, so the reclaimable ones come first
+  uint32_t reclaimed = 0;
+  while (reclaimed < limbo->count && limbo->epochs[reclaimed] < safe) {
+    free_groups[*free_groups_count] = limbo->groups[reclaimed];
+    (*free_groups_count)++;
+    reclaimed++;
+  }
+
+  for (uint32_t i = reclaimed; i < limbo->count; i++) {
+    limbo->groups[i - reclaimed] = limbo->groups[i];
+    limbo->epochs[i - reclaimed] = limbo->epochs[i];
+  }
+  limbo->count -= reclaimed;
+}
+
+void lpm_limbo_free(struct lpm_limbo *limbo)
+{
+  free(limbo->groups);
+  free(limbo->epochs);
+}
@@ -0,0 +1,82 @@
+#ifndef _LPM_EPOCH_H_INCLUDED_
+#define _LPM_EPOCH_H_INCLUDED_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libvig/verified/lpm-dir-24-8.h"
+
+// Quiescent-state-based reclamation of the memory an LPM update unlinks
+// (groups, arrays replaced on growth), shared by the LPM implementations.
+//
+// The writer tags what an update unlinks with the current epoch and starts
+// a new epoch once the update is done. Each registered reader announces,
+// between two lookups, the epoch it saw last: it holds nothing from before
+// that epoch anymore. Something tagged with epoch E is reclaimed once every
+// online reader announced an epoch after E. Readers that lag only delay
+// reclamation, the writer never waits for them.
+
+// Announced epochs are a cache line apart so that readers do not share lines
+struct lpm_reader {
+  // 0 while the reader is offline
+  uint64_t epoch;
+  uint64_t padding[7];
+};
+
+// Arrays replaced on growth that readers may still hold; growth at most
+// doubles the pool each time, so there are never many
+#define lpm_EPOCH_MAX_RETIRED 16
+
+struct lpm_epoch {
+  uint64_t current;
+  struct lpm_reader readers[lpm_MAX_READERS];
+  void* retired[lpm_EPOCH_MAX_RETIRED];
+  uint64_t retired_epochs[lpm_EPOCH_MAX_RETIRED];
+  uint32_t retired_count;
+};
+
+// Groups unlinked from the tables, waiting for the readers to move on; it
+// can hold every group of the pool
+struct lpm_limbo {
+  uint16_t* groups;
+  uint64_t* epochs;
+  uint32_t count;
+};
+
+void lpm_epoch_init(struct lpm_epoch *epoch);
+
+// Reader side, see lpm_reader_online and co. in lpm-dir-24-8.h
+void lpm_epoch_reader_online(struct lpm_epoch *epoch, unsigned reader);
+void lpm_epoch_reader_offline(struct lpm_epoch *epoch, unsigned reader);
+void lpm_epoch_reader_quiescent(struct lpm_epoch *epoch, unsigned reader);
+
+// Writer side. Ends the current update: what it unlinked is tagged with the
+// epoch it ran in, which ends here. Must come after the last table write.
+void lpm_epoch_advance(struct lpm_epoch *epoch);
+
+// Anything tagged with an epoch before the returned one can be reclaimed
+uint64_t lpm_epoch_safe(struct lpm_epoch *epoch);
+
+// Keeps array until the readers are done with it, then frees it.
+// Returns false if too many arrays are waiting already.
+bool lpm_epoch_retire(struct lpm_epoch *epoch, void *array);
+
+// Frees the retired arrays the readers are done with
+void lpm_epoch_reclaim(struct lpm_epoch *epoch, uint64_t safe);
+
+// Frees all retired arrays, for when the table itself is freed
+void lpm_epoch_free(struct lpm_epoch *epoch);
+
+// Returns false if the limbo could not be resized; it is unchanged then
+bool lpm_limbo_resize(struct lpm_limbo *limbo, uint32_t capacity);
+
+void lpm_limbo_add(struct lpm_limbo *limbo, struct lpm_epoch *epoch,
+                   uint16_t group);
+
+// Pushes the groups the readers are done with onto the free stack
+void lpm_limbo_reclaim(struct lpm_limbo *limbo, uint64_t safe,
+                       uint16_t *free_groups, uint32_t *free_groups_count);
+
+void lpm_limbo_free(struct lpm_limbo *limbo);
+
+#endif//_LPM_EPOCH_H_INCLUDED_
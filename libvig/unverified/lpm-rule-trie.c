@@ -0,0 +1,128 @@
+#include <stdlib.h>
+
+#include "libvig/verified/lpm-dir-24-8.h"
+#include "lpm-rule-trie.h"
+
+static struct lpm_rule_node* lpm_rule_node_allocate(void)
+{
+  struct lpm_rule_node* node =
+    (struct lpm_rule_node*) malloc(sizeof(struct lpm_rule_node));
+  if (node == NULL) {
+    return NULL;
+  }
+
+  node->children[0] = NULL;
+  node->children[1] = NULL;
+  node->route = INVALID;
+  node->has_route = false;
+  return node;
+}
+
+static bool lpm_rule_node_is_useless(struct lpm_rule_node *node)
+{
+  return !node->has_route && !lpm_rule_node_has_children(node);
+}
+
+// Frees the nodes on the path of prefix/prefixlen that carry neither a
+// route nor children, bottom-up. The root is never freed.
+static void lpm_rule_trie_prune(struct lpm_rule_node *root, uint32_t prefix,
+                                uint8_t prefixlen)
+{
+  struct lpm_rule_node* path[lpm_PLEN_MAX + 1];
+  struct lpm_rule_node* node = root;
+  uint8_t depth = 0;
+
+  path[0] = root;
+  while (depth < prefixlen) {
+    node = node->children[lpm_rule_prefix_bit(prefix, depth)];
+    if (node == NULL) {
+      break;
+    }
+    depth++;
+    path[depth] = node;
+  }
+
+  while (depth > 0 && lpm_rule_node_is_useless(path[depth])) {
+    struct lpm_rule_node* parent = path[depth - 1];
+    parent->children[lpm_rule_prefix_bit(prefix, depth - 1)] = NULL;
+    free(path[depth]);
+    depth--;
+  }
+}
+
+int lpm_rule_trie_allocate(struct lpm_rule_node **root_out)
+{
+  struct lpm_rule_node* root = lpm_rule_node_allocate();
+  if (root == NULL) {
+    return 0;
+  }
+
+  *root_out = root;
+  return 1;
+}
+
+void lpm_rule_trie_free(struct lpm_rule_node *root)
+{
+  if (root == NULL) {
+    return;
+  }
+
+  lpm_rule_trie_free(root->children[0]);
+  lpm_rule_trie_free(root->children[1]);
+  free(root);
+}
+
+int lpm_rule_trie_insert(struct lpm_rule_node *root, uint32_t prefix,
+                         uint8_t prefixlen, uint16_t route)
+{
+  struct lpm_rule_node* node = root;
+
+  for (uint8_t depth = 0; depth < prefixlen; depth++) {
+    unsigned bit = lpm_rule_prefix_bit(prefix, depth);
+    if (node->children[bit] == NULL) {
+      struct lpm_rule_node* child = lpm_rule_node_allocate();
+      if (child == NULL) {
+        lpm_rule_trie_prune(root, prefix, prefixlen);
+        return 0;
+      }
+      node->children[bit] = child;
+    }
+    node = node->children[bit];
+  }
+
+  node->route = route;
+  node->has_route = true;
+  return 1;
+}
+
+int lpm_rule_trie_remove(struct lpm_rule_node *root, uint32_t prefix,
+                         uint8_t prefixlen)
+{
+  uint16_t inherited;
+  struct lpm_rule_node* node = lpm_rule_trie_find(root, prefix, prefixlen,
+                                                  &inherited);
+  if (node == NULL || !node->has_route) {
+    return 0;
+  }
+
+  node->route = INVALID;
+  node->has_route = false;
+  lpm_rule_trie_prune(root, prefix, prefixlen);
+  return 1;
+}
+
+struct lpm_rule_node* lpm_rule_trie_find(struct lpm_rule_node *root,
+                                         uint32_t prefix, uint8_t depth,
+                                         uint16_t *inherited_out)
+{
+  struct lpm_rule_node* node = root;
+  uint16_t inherited = INVALID;
+
+  for (uint8_t d = 0; d < depth && node != NULL; d++) {
+    inherited = lpm_rule_node_route(node, inherited);
+    node = node->children[lpm_rule_prefix_bit(prefix, d)];
+  }
+
+  *inherited_out = inherited;
+  return node;
+}
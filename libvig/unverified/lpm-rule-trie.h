@@ -0,0 +1,70 @@
+#ifndef _LPM_RULE_TRIE_H_INCLUDED_
+#define _LPM_RULE_TRIE_H_INCLUDED_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Binary (unibit) trie holding the routing rules of an LPM table.
+// The datapath tables (lpm_24/lpm_long, ...) are derived from it: after a
+// rule changes, the owner of the tables repaints the address range under
+// the rule by walking the trie. Nodes that end up with neither a route nor
+// children are pruned, so a node has children iff a more specific rule
+// exists below it.
+//
+// The trie is only touched by the writer; readers never see it.
+
+struct lpm_rule_node {
+  struct lpm_rule_node* children[2];
+  uint16_t route;
+  bool has_route;
+};
+
+// Returns 1 on success, 0 if the root could not be allocated.
+int lpm_rule_trie_allocate(struct lpm_rule_node **root_out);
+
+void lpm_rule_trie_free(struct lpm_rule_node *root);
+
+// Adds prefix/prefixlen -> route, replacing the route of an existing rule
+// for the same prefix. Returns 1 on success, 0 on allocation failure, in
+// which case the trie is unchanged.
+int lpm_rule_trie_insert(struct lpm_rule_node *root, uint32_t prefix,
+                         uint8_t prefixlen, uint16_t route);
+
+// Removes the rule for prefix/prefixlen and prunes the nodes that became
+// useless. Returns 1 if the rule existed, 0 otherwise.
+int lpm_rule_trie_remove(struct lpm_rule_node *root, uint32_t prefix,
+                         uint8_t prefixlen);
+
+// Returns the node for prefix/depth, or NULL if there is none. In both
+// cases *inherited_out receives the route of the longest rule strictly
+// shorter than depth that covers prefix, or INVALID.
+struct lpm_rule_node* lpm_rule_trie_find(struct lpm_rule_node *root,
+                                         uint32_t prefix, uint8_t depth,
+                                         uint16_t *inherited_out);
+
+static inline bool lpm_rule_node_has_children(struct lpm_rule_node *node)
+{
+  return node != NULL &&
+         (node->children[0] != NULL || node->children[1] != NULL);
+}
+
+// Route that a node resolves to, given the route inherited from above.
+static inline uint16_t lpm_rule_node_route(struct lpm_rule_node *node,
+                                           uint16_t inherited)
+{
+  return node != NULL && node->has_route ? node->route : inherited;
+}
+
+// Child of node on the given side, NULL-safe.
+static inline struct lpm_rule_node*
+lpm_rule_node_child(struct lpm_rule_node *node, unsigned bit)
+{
+  return node == NULL ? NULL : node->children[bit];
+}
+
+static inline unsigned lpm_rule_prefix_bit(uint32_t prefix, uint8_t depth)
+{
+  return (prefix >> (31 - depth)) & 1;
+}
+
+#endif//_LPM_RULE_TRIE_H_INCLUDED_
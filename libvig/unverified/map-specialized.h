@@ -0,0 +1,116 @@
+// Template of the map operations for one key type, with the key hash and
+// equality functions called directly, so that the compiler can inline them
+// in the probing loops instead of calling them through the function
+// pointers in struct Map. It mirrors map.c and map-impl(-pow2).c on the same
+// struct Map, and is not covered by the VeriFast proof.
+//
+// The code generated for each key type listed in the NF's NF_MAP_KEYS
+// instantiates it, see codegen/main.ml:
+//   #define MAP_KEY_TYPE FlowId
+//   #include "libvig/unverified/map-specialized.h"
+// defines FlowId_map_get, FlowId_map_get_with_hash, FlowId_map_put,
+// FlowId_map_erase and FlowId_map_ops on top of FlowId_hash and FlowId_eq.
+// The NF calls the former directly; without SPECIALIZED_MAPS, and for KLEE,
+// they are macros for the generic map_get and co.
+// No include guard on purpose.
+
+#ifndef MAP_KEY_TYPE
+#  error "Define MAP_KEY_TYPE before including map-specialized.h"
+#endif
+
+#include <stddef.h>
+
+#include "libvig/verified/map.h"
+#include "libvig/verified/map-layout.h"
+
+#define MAP_SPEC_CONCAT_(a, b) a##b
+#define MAP_SPEC_CONCAT(a, b) MAP_SPEC_CONCAT_(a, b)
+#define MAP_SPEC_FN(name) MAP_SPEC_CONCAT(MAP_KEY_TYPE, name)
+
+#ifdef CAPACITY_POW2
+#  define MAP_SPEC_LOOP(k, capacity) ((k) & ((capacity) - 1))
+#else
+#  define MAP_SPEC_LOOP(k, capacity) ((k) % (capacity))
+#endif
+
+static inline int MAP_SPEC_FN(_map_find_key)(struct Map* map, void* key,
+                                             unsigned hash)
+{
+  unsigned start = MAP_SPEC_LOOP(hash, map->capacity);
+  for (unsigned i = 0; i < map->capacity; ++i) {
+    unsigned index = MAP_SPEC_LOOP(start + i, map->capacity);
+    if (map->busybits[index] != 0 && map->khs[index] == hash) {
+      if (MAP_SPEC_FN(_eq)(map->keyps[index], key)) {
+        return (int)index;
+      }
+    } else if (map->chns[index] == 0) {
+      return -1;
+    }
+  }
+  return -1;
+}
+
+int MAP_SPEC_FN(_map_get_with_hash)(struct Map* map, void* key,
+                                    unsigned hash, int* value_out)
+{
+  int index = MAP_SPEC_FN(_map_find_key)(map, key, hash);
+  if (index == -1) {
+    return 0;
+  }
+  *value_out = map->vals[index];
+  return 1;
+}
+
+int MAP_SPEC_FN(_map_get)(struct Map* map, void* key, int* value_out)
+{
+  return MAP_SPEC_FN(_map_get_with_hash)(map, key, MAP_SPEC_FN(_hash)(key),
+                                         value_out);
+}
+
+void MAP_SPEC_FN(_map_put)(struct Map* map, void* key, int value)
+{
+  unsigned hash = MAP_SPEC_FN(_hash)(key);
+  unsigned start = MAP_SPEC_LOOP(hash, map->capacity);
+  for (unsigned i = 0; i < map->capacity; ++i) {
+    unsigned index = MAP_SPEC_LOOP(start + i, map->capacity);
+    if (map->busybits[index] == 0) {
+      map->busybits[index] = 1;
+      map->keyps[index] = key;
+      map->khs[index] = hash;
+      map->vals[index] = value;
+      ++map->size;
+      return;
+    }
+    ++map->chns[index];
+  }
+}
+
+void MAP_SPEC_FN(_map_erase)(struct Map* map, void* key, void** trash)
+{
+  unsigned hash = MAP_SPEC_FN(_hash)(key);
+  unsigned start = MAP_SPEC_LOOP(hash, map->capacity);
+  for (unsigned i = 0; i < map->capacity; ++i) {
+    unsigned index = MAP_SPEC_LOOP(start + i, map->capacity);
+    if (map->busybits[index] != 0 && map->khs[index] == hash &&
+        MAP_SPEC_FN(_eq)(map->keyps[index], key)) {
+      map->busybits[index] = 0;
+      *trash = map->keyps[index];
+      --map->size;
+      return;
+    }
+    --map->chns[index];
+  }
+}
+
+const struct MapOps MAP_SPEC_FN(_map_ops) = {
+  .get = MAP_SPEC_FN(_map_get),
+  .get_with_hash = MAP_SPEC_FN(_map_get_with_hash),
+  .put = MAP_SPEC_FN(_map_put),
+  .erase = MAP_SPEC_FN(_map_erase),
+};
+
+#undef MAP_SPEC_LOOP
+#undef MAP_SPEC_FN
+#undef MAP_SPEC_CONCAT
+#undef MAP_SPEC_CONCAT_
+#undef MAP_KEY_TYPE
@@ -23,6 +23,14 @@ unsigned long long __builtin_ia32_crc32di(unsigned long long acc,
 #  define AND &&
 #endif // KLEE_VERIFICATION
 
+// Globals of which each core running the NF has its own copy, see nf.h.
+// MULTICORE is only set for the DPDK build, never for verification.
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+#  define PER_CORE __thread
+#else // MULTICORE
+#  define PER_CORE
+#endif // MULTICORE
+
 #define DEFAULT_UINT32_T 0
 
 static void null_init(void *obj)
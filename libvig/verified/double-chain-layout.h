@@ -0,0 +1,15 @@
+#ifndef _DOUBLE_CHAIN_LAYOUT_H_INCLUDED_
+#define _DOUBLE_CHAIN_LAYOUT_H_INCLUDED_
+
+#include "double-chain-impl.h"
+#include "vigor-time.h"
+
+// Only meant for double-chain.c and libvig/unverified/containers-free.c;
+// everything else should go through double-chain.h.
+
+struct DoubleChain {
+  struct dchain_cell* cells;
+  vigor_time_t *timestamps;
+};
+
+#endif//_DOUBLE_CHAIN_LAYOUT_H_INCLUDED_
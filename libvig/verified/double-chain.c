@@ -4,6 +4,7 @@
 #include <stddef.h>
 
 #include "double-chain-impl.h"
+#include "double-chain-layout.h"
 
 //@ #include <nat.gh>
 //@ #include "../proof/arith.gh"
@@ -13,11 +14,6 @@
 #define NULL 0
 #endif//NULL
 
-struct DoubleChain {
-  struct dchain_cell* cells;
-  vigor_time_t *timestamps;
-};
-
 /*@
 
   fixpoint bool insync_fp(list<int> bare_alist, list<vigor_time_t> tstmps,
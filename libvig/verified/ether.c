@@ -89,3 +89,8 @@ unsigned rte_ether_addr_hash(void* obj)
   return hash;
 }
 #endif// KLEE_VERIFICATION
+
+#if defined(SPECIALIZED_MAPS) && !defined(KLEE_VERIFICATION)
+#  define MAP_KEY_TYPE rte_ether_addr
+#  include "libvig/unverified/map-specialized.h"
+#endif
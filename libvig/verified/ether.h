@@ -38,6 +38,21 @@ void rte_ether_addr_allocate(void* obj);
 //@ requires chars(obj, sizeof(struct rte_ether_addr), _);
 //@ ensures rte_ether_addrp(obj, DEFAULT_RTE_ETHER_ADDR);
 
+#if defined(SPECIALIZED_MAPS) && !defined(KLEE_VERIFICATION)
+#  include "map.h"
+int rte_ether_addr_map_get(struct Map* map, void* key, int* value_out);
+int rte_ether_addr_map_get_with_hash(struct Map* map, void* key, unsigned hash,
+                                     int* value_out);
+void rte_ether_addr_map_put(struct Map* map, void* key, int value);
+void rte_ether_addr_map_erase(struct Map* map, void* key, void** trash);
+extern const struct MapOps rte_ether_addr_map_ops;
+#else
+// The generic operations, see codegen/main.ml
+#  define rte_ether_addr_map_get map_get
+#  define rte_ether_addr_map_get_with_hash map_get_with_hash
+#  define rte_ether_addr_map_put map_put
+#  define rte_ether_addr_map_erase map_erase
+#endif
 
 #define LOG_ETHER_ADDR(obj, p) \
   p("{"); \
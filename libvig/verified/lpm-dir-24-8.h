@@ -1,3 +1,6 @@
+#ifndef _LPM_DIR_24_8_H_INCLUDED_
+#define _LPM_DIR_24_8_H_INCLUDED_
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -5,8 +8,6 @@
 #include <stddef.h>
 #include <stdbool.h>
 
-//@ #include "../proof/lpm-dir-24-8.gh"
-
 #define lpm_PLEN_MAX 32
 #define BYTE_SIZE 8
 
@@ -17,60 +18,87 @@
 #define lpm_24_VAL_MASK 0x7FFF
 #define lpm_24_PLEN_MAX 24
 
-#define lpm_LONG_OFFSET_MAX 256
-#define lpm_LONG_FACTOR 256
-#define lpm_LONG_MAX_ENTRIES 65536 //= 2^16
+#define lpm_LONG_FACTOR 256 // entries per lpm_long group
+#define lpm_LONG_INITIAL_GROUPS 256
+// A flagged lpm_24 entry holding group 0x7FFF would read as INVALID,
+// so the group index space stops one short of the 15 bits.
+#define lpm_LONG_MAX_GROUPS 0x7FFF
 
 #define MAX_NEXT_HOP_VALUE 0x7FFF
 
+// Readers that can look up concurrently with updates, see lpm_reader_online
+#define lpm_MAX_READERS 128
+
 // http://tiny-tera.stanford.edu/~nickm/papers/Infocom98_lookup.pdf
 
-// I assume that the rules will be in ascending order of prefixlen
-// Each new rule will simply overwrite any existing rule where it should exist
+// Rules can be added and removed in any order. They are kept in a binary
+// trie (libvig/unverified/lpm-rule-trie.h) and every change repaints the
+// part of the tables the rule covers, so a lookup always returns the
+// longest matching rule.
 // The entries in lpm_24 are as follows:
 //   bit15: 0->next hop, 1->lpm_long lookup
-//   bit14-0: value of next hop or index in lpm_long
+//   bit14-0: value of next hop or index of the group in lpm_long
 //
 // The entries in lpm_long are as follows:
 //   bit15-0: value of next hop
 //
+// lpm_long is a pool of groups of lpm_LONG_FACTOR entries, one group per
+// /24 that holds a longer prefix. The pool starts with
+// lpm_LONG_INITIAL_GROUPS groups and doubles on demand up to
+// lpm_LONG_MAX_GROUPS. Groups whose /24 no longer holds a longer prefix
+// return to a free list and are reused before the pool grows.
+//
+// Updates are meant to come from a single writer, concurrently with any
+// number of readers calling lpm_lookup_elem. Every table entry is changed
+// with a single store and a new group is filled before the lpm_24 entry
+// that points to it, so readers see each address either before or after
+// the update. Readers that run concurrently with updates must register,
+// see lpm_reader_online: released groups and replaced lpm_long arrays are
+// only recycled once every online reader went through a quiescent state
+// after their release. Without online readers they are recycled right
+// away, so lookups and updates must then not overlap.
+//
 //max next hop value is 2^15 - 1.
+//
+// The implementations, libvig/unverified/lpm-dir-24-8.c and
+// lpm-dir-16-8-8.c, are not covered by a VeriFast proof:
+// libvig/proof/lpm-dir-24-8.gh models the original fixed pool of 256 groups.
+// Verified NFs are checked against the model of this API in
+// libvig/models/verified/lpm-dir-24-8.c.
 
 
 struct lpm;
 
-/*@ predicate table(struct lpm* t, dir_24_8 dir); @*/
-
-
-
+// Returns 1 on success, 0 if the tables could not be allocated.
 int lpm_allocate(struct lpm **lpm_out);
-//@ requires *lpm_out |-> ?old_lo;
-/*@ ensures result == 0 ?
-              *lpm_out |-> old_lo :
-              *lpm_out |-> ?new_lo &*&
-              table(new_lo, dir_init()) &*&
-              result == 1; @*/
 
 void lpm_free(struct lpm *_lpm);
-//@ requires table(_lpm, _);
-//@ ensures true;
 
+// Adds the rule prefix/prefixlen -> value, or changes the value of an
+// existing rule for the same prefix.
+// Returns 1 on success, 0 if the value is not a valid next hop, if a new
+// lpm_long group was needed and the pool is exhausted, or if the rule
+// could not be recorded.
 int lpm_update_elem(struct lpm *_lpm, uint32_t prefix,
                     uint8_t prefixlen, uint16_t value);
-/*@ requires table(_lpm, ?dir) &*&
-             prefixlen >= 0 &*& prefixlen <= 32 &*&
-             value != INVALID &*&
-             0 <= value &*& value <= MAX_NEXT_HOP_VALUE &*&
-             false == extract_flag(value) &*&
-             true == valid_entry24(value) &*&
-             true == valid_entry_long(value); @*/
-/*@ ensures can_insert(dir, prefix, prefixlen) == (result != 0) &*&
-            result != 0 ?
-              table(_lpm, add_rule(dir, init_rule(prefix, prefixlen, value)))
-            :
-              table(_lpm, dir); @*/
 
+// Removes the rule prefix/prefixlen; the addresses it covered fall back to
+// the next longest matching rule.
+// Returns 1 on success, 0 if there is no such rule.
+int lpm_delete_elem(struct lpm *_lpm, uint32_t prefix, uint8_t prefixlen);
+
+// Returns the next hop of the longest matching rule, or INVALID.
 int lpm_lookup_elem(struct lpm *_lpm, uint32_t prefix);
-//@ requires table(_lpm, ?dir);
-/*@ ensures table(_lpm, dir) &*&
-            result == lpm_dir_24_8_lookup(Z_of_int(prefix, N32),dir); @*/
+
+// A reader, from 0 to lpm_MAX_READERS - 1, that looks up concurrently with
+// updates goes online before its first lookup and offline after its last
+// one. While online, it must regularly call lpm_reader_quiescent outside
+// of lookups, e.g. once per burst of packets: memory the writer unlinked
+// is only reused once every online reader did. A reader that stays online
+// without calling it makes the tables grow until updates fail.
+// Each reader number must be used by a single thread at a time.
+void lpm_reader_online(struct lpm *_lpm, unsigned reader);
+void lpm_reader_offline(struct lpm *_lpm, unsigned reader);
+void lpm_reader_quiescent(struct lpm *_lpm, unsigned reader);
+
+#endif//_LPM_DIR_24_8_H_INCLUDED_
@@ -0,0 +1,26 @@
+#ifndef _MAP_LAYOUT_H_INCLUDED_
+#define _MAP_LAYOUT_H_INCLUDED_
+
+#include "map-util.h"
+
+// Only meant for map.c and, in libvig/unverified, map-specialized.h,
+// containers-free.c and concurrent-map.c, which probes the same slots but
+// checks its sequence counter before following a key pointer; everything else
+// should go through map.h.
+
+struct Map {
+  int* busybits;
+  void** keyps;
+  unsigned* khs;
+  int* chns;
+  int* vals;
+  unsigned capacity;
+  unsigned size;
+  map_keys_equality* keys_eq;
+  map_key_hash* khash;
+#ifdef SPECIALIZED_MAPS
+  const struct MapOps* ops;
+#endif//SPECIALIZED_MAPS
+};
+
+#endif//_MAP_LAYOUT_H_INCLUDED_
@@ -8,17 +8,7 @@
 #include "map-impl.h"
 #endif
 
-struct Map {
-  int* busybits;
-  void** keyps;
-  unsigned* khs;
-  int* chns;
-  int* vals;
-  unsigned capacity;
-  unsigned size;
-  map_keys_equality* keys_eq;
-  map_key_hash* khash;
-};
+#include "map-layout.h"
 
 /*@
   predicate mapp<t>(struct Map* ptr,
@@ -130,6 +120,9 @@ int map_allocate/*@ <t> @*/(map_keys_equality* keq, map_key_hash* khash,
   (*map_out)->size = 0;
   (*map_out)->keys_eq = keq;
   (*map_out)->khash = khash;
+#ifdef SPECIALIZED_MAPS
+  (*map_out)->ops = NULL;
+#endif//SPECIALIZED_MAPS
   //@ close map_key_type<t>();
   //@ close map_key_hash<t>(hsh);
   //@ close map_record_property<t>(nop_true);
@@ -162,6 +155,11 @@ int map_get/*@ <t> @*/(struct Map* map, void* key, int* value_out)
                *value_out |-> old_v); @*/
 {
   //@ open mapp<t>(map, kp, hsh, recp, mapc(capacity, contents, addrs));
+#ifdef SPECIALIZED_MAPS
+  if (map->ops != NULL) {
+    return map->ops->get(map, key, value_out);
+  }
+#endif//SPECIALIZED_MAPS
   map_key_hash* khash = map->khash;
   unsigned hash = khash(key);
   return map_impl_get(map->busybits,
@@ -177,6 +175,42 @@ int map_get/*@ <t> @*/(struct Map* map, void* key, int* value_out)
   //@ close mapp<t>(map, kp, hsh, recp, mapc(capacity, contents, addrs));
 }
 
+int map_get_with_hash/*@ <t> @*/(struct Map* map, void* key, unsigned hash,
+                                 int* value_out)
+/*@ requires mapp<t>(map, ?kp, ?hsh, ?recp,
+                     mapc(?capacity, ?contents, ?addrs)) &*&
+             kp(key, ?k) &*&
+             hsh(k) == hash &*&
+             *value_out |-> ?old_v; @*/
+/*@ ensures mapp<t>(map, kp, hsh, recp,
+                    mapc(capacity, contents, addrs)) &*&
+            kp(key, k) &*&
+            map_has_fp(contents, k) ?
+              (result == 1 &*&
+               *value_out |-> ?new_v &*&
+               new_v == map_get_fp(contents, k)) :
+              (result == 0 &*&
+               *value_out |-> old_v); @*/
+{
+  //@ open mapp<t>(map, kp, hsh, recp, mapc(capacity, contents, addrs));
+#ifdef SPECIALIZED_MAPS
+  if (map->ops != NULL) {
+    return map->ops->get_with_hash(map, key, hash, value_out);
+  }
+#endif//SPECIALIZED_MAPS
+  return map_impl_get(map->busybits,
+                      map->keyps,
+                      map->khs,
+                      map->chns,
+                      map->vals,
+                      key,
+                      map->keys_eq,
+                      hash,
+                      value_out,
+                      map->capacity);
+  //@ close mapp<t>(map, kp, hsh, recp, mapc(capacity, contents, addrs));
+}
+
 void map_put/*@ <t> @*/(struct Map* map, void* key, int value)
 /*@ requires mapp<t>(map, ?kp, ?hsh, ?recp,
                      mapc(?capacity, ?contents, ?addrs)) &*&
@@ -189,6 +223,12 @@ void map_put/*@ <t> @*/(struct Map* map, void* key, int value)
                          map_put_fp(addrs, k, key))); @*/
 {
   //@ open mapp<t>(map, kp, hsh, recp, mapc(capacity, contents, addrs));
+#ifdef SPECIALIZED_MAPS
+  if (map->ops != NULL) {
+    map->ops->put(map, key, value);
+    return;
+  }
+#endif//SPECIALIZED_MAPS
   map_key_hash* khash = map->khash;
   unsigned hash = khash(key);
   map_impl_put(map->busybits,
@@ -252,6 +292,12 @@ void map_erase/*@ <t> @*/(struct Map* map, void* key, void** trash)
             [0.25]kp(k_out, k); @*/
 {
   //@ open mapp<t>(map, kp, hsh, recp, mapc(capacity, contents, addrs));
+#ifdef SPECIALIZED_MAPS
+  if (map->ops != NULL) {
+    map->ops->erase(map, key, trash);
+    return;
+  }
+#endif//SPECIALIZED_MAPS
   map_key_hash* khash = map->khash;
   unsigned hash = khash(key);
   map_impl_erase(map->busybits,
@@ -272,6 +318,13 @@ void map_erase/*@ <t> @*/(struct Map* map, void* key, void** trash)
     @*/
 }
 
+#ifdef SPECIALIZED_MAPS
+void map_specialize(struct Map* map, const struct MapOps* ops)
+{
+  map->ops = ops;
+}
+#endif//SPECIALIZED_MAPS
+
 unsigned map_size/*@ <t> @*/(struct Map* map)
 /*@ requires mapp<t>(map, ?kp, ?hsh, ?recp,
                      mapc(?capacity, ?contents, ?addrs)); @*/
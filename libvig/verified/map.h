@@ -55,6 +55,26 @@ int map_get/*@ <t> @*/(struct Map* map, void* key, int* value_out);
               (result == 0 &*&
                *value_out |-> old_v); @*/
 
+// Same as map_get, with the hash of the key already computed, e.g. by the
+// bulk hash function generated for the key type for a whole burst of keys,
+// see codegen/main.ml.
+int map_get_with_hash/*@ <t> @*/(struct Map* map, void* key, unsigned hash,
+                                 int* value_out);
+/*@ requires mapp<t>(map, ?kp, ?hsh, ?recp,
+                     mapc(?capacity, ?contents, ?addrs)) &*&
+             kp(key, ?k) &*&
+             hsh(k) == hash &*&
+             *value_out |-> ?old_v; @*/
+/*@ ensures mapp<t>(map, kp, hsh, recp,
+                    mapc(capacity, contents, addrs)) &*&
+            kp(key, k) &*&
+            map_has_fp(contents, k) ?
+              (result == 1 &*&
+               *value_out |-> ?new_v &*&
+               new_v == map_get_fp(contents, k)) :
+              (result == 0 &*&
+               *value_out |-> old_v); @*/
+
 void map_put/*@ <t> @*/(struct Map* map, void* key, int value);
 /*@ requires mapp<t>(map, ?kp, ?hsh, ?recp,
                      mapc(?capacity, ?contents, ?addrs)) &*&
@@ -82,6 +102,28 @@ void map_erase/*@ <t> @*/(struct Map* map, void* key, void** trash);
             length(map_erase_fp(contents, k)) + 1 == length(contents) &*&
             [0.25]kp(k_out, k); @*/
 
+#ifdef SPECIALIZED_MAPS
+// Implementations of the map operations for one key type, with its hash and
+// equality functions inlined rather than called through function pointers.
+// They are generated along with the key type (see codegen/main.ml and
+// libvig/unverified/map-specialized.h) and are not covered by the VeriFast
+// proof.
+struct MapOps {
+  int (*get)(struct Map* map, void* key, int* value_out);
+  int (*get_with_hash)(struct Map* map, void* key, unsigned hash,
+                       int* value_out);
+  void (*put)(struct Map* map, void* key, int value);
+  void (*erase)(struct Map* map, void* key, void** trash);
+};
+
+// NF code calls them directly, e.g. FlowId_map_get (see NF_MAP_KEYS in the
+// top-level Makefile), so this is for the code that only knows struct Map,
+// e.g. the expirator: once set, map_get, map_get_with_hash, map_put and
+// map_erase forward to ops. The map must be empty, and ops must be those of
+// the key type it was allocated for.
+void map_specialize(struct Map* map, const struct MapOps* ops);
+#endif//SPECIALIZED_MAPS
+
 unsigned map_size/*@ <t> @*/(struct Map* map);
 /*@ requires mapp<t>(map, ?kp, ?hsh, ?recp,
                      mapc(?capacity, ?contents, ?addrs)); @*/
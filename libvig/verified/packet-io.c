@@ -4,9 +4,10 @@
 #include <rte_mbuf.h>
 
 #include "packet-io.h"
+#include "boilerplate-util.h"
 
-size_t global_total_length;
-size_t global_read_length = 0;
+PER_CORE size_t global_total_length;
+PER_CORE size_t global_read_length = 0;
 
 /*@
   fixpoint bool missing_chunks(list<pair<int8_t*, int> > missing_chunks, int8_t*
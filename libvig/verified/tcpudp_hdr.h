@@ -12,4 +12,16 @@ __attribute__((__packed__)) // VeriFast does not understand attributes
 #endif                      //_NO_VERIFAST_
 ;
 
+// The part of a TCP header that follows the ports, up to the flags
+struct tcp_flags_hdr {
+  uint32_t sent_seq;
+  uint32_t recv_ack;
+  uint8_t data_off;
+  uint8_t tcp_flags;
+}
+#ifdef _NO_VERIFAST_
+__attribute__((__packed__)) // VeriFast does not understand attributes
+#endif                      //_NO_VERIFAST_
+;
+
 #endif //_TCPUDP_H_INCLUDED_
@@ -0,0 +1,13 @@
+#ifndef _VECTOR_LAYOUT_H_INCLUDED_
+#define _VECTOR_LAYOUT_H_INCLUDED_
+
+// Only meant for vector.c and libvig/unverified/containers-free.c;
+// everything else should go through vector.h.
+
+struct Vector {
+  char* data;
+  int elem_size;
+  unsigned capacity;
+};
+
+#endif//_VECTOR_LAYOUT_H_INCLUDED_
@@ -1,17 +1,12 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include "vector.h"
+#include "vector-layout.h"
 
 //@ #include "../proof/arith.gh"
 //@ #include "../proof/stdex.gh"
 //@ #include "../proof/listutils-lemmas.gh"
 
-struct Vector {
-  char* data;
-  int elem_size;
-  unsigned capacity;
-};
-
 /*@
   predicate entsp<t>(void* data, int el_size,
                      predicate (void*;t) entp,
@@ -0,0 +1,108 @@
+#include "nf-profile.h"
+
+#if defined(VIGOR_PROFILE) && !defined(KLEE_VERIFICATION) && !defined(NFOS)
+
+#  include <inttypes.h>
+#  include <stdio.h>
+
+#  include <rte_lcore.h>
+#  include <rte_spinlock.h>
+
+#  include "nf-log.h"
+
+PER_CORE struct nf_histogram nf_profile_histograms[NF_STAGE_COUNT];
+uint64_t nf_profile_overhead;
+volatile sig_atomic_t nf_profile_dumps_requested;
+PER_CORE sig_atomic_t nf_profile_dumps_done;
+
+// So that the dumps of the cores do not interleave
+static rte_spinlock_t dump_lock = RTE_SPINLOCK_INITIALIZER;
+
+static const char *const stage_names[NF_STAGE_COUNT] = {
+  [NF_STAGE_PARSE] = "parse",
+  [NF_STAGE_EXPIRE] = "expire",
+  [NF_STAGE_LOOKUP] = "lookup",
+  [NF_STAGE_ALLOCATE] = "allocate",
+  [NF_STAGE_CHECKSUM] = "checksum",
+  [NF_STAGE_TX] = "tx",
+  [NF_STAGE_TOTAL] = "total",
+};
+
+static void request_dump(int signal) {
+  (void)signal;
+  nf_profile_dumps_requested++;
+}
+
+void nf_profile_init(void) {
+  // The smallest of many measurements of nothing, which is what the TSC
+  // reads themselves cost
+  uint64_t overhead = UINT64_MAX;
+  for (unsigned n = 0; n < 10000; n++) {
+    uint64_t start = rte_rdtsc_precise();
+    uint64_t cycles = rte_rdtsc_precise() - start;
+    if (cycles < overhead) {
+      overhead = cycles;
+    }
+  }
+  nf_profile_overhead = overhead;
+
+  signal(SIGUSR1, request_dump);
+  NF_INFO("Profiling nf_process, TSC overhead: %" PRIu64 " cycles, "
+          "send SIGUSR1 to print the histograms", overhead);
+}
+
+// Highest value of the given bucket
+static uint64_t bucket_max(unsigned bucket) {
+  if (bucket < NF_PROFILE_SUB_BUCKETS) {
+    return bucket;
+  }
+  unsigned shift = bucket / NF_PROFILE_SUB_BUCKETS - 1;
+  uint64_t top = bucket % NF_PROFILE_SUB_BUCKETS + NF_PROFILE_SUB_BUCKETS;
+  return ((top + 1) << shift) - 1;
+}
+
+// Smallest value that at least the given fraction of the counts are below
+// or at, within the precision of the buckets
+static uint64_t percentile(const struct nf_histogram *histogram,
+                           double fraction) {
+  uint64_t rank = (uint64_t)(fraction * histogram->count + 0.5);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (unsigned bucket = 0; bucket < NF_PROFILE_BUCKETS; bucket++) {
+    seen += histogram->counts[bucket];
+    if (seen >= rank) {
+      uint64_t max = bucket_max(bucket);
+      return max < histogram->max ? max : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+void nf_profile_dump(void) {
+  nf_profile_dumps_done = nf_profile_dumps_requested;
+
+  rte_spinlock_lock(&dump_lock);
+  printf("Cycles per stage on lcore %u (%" PRIu64 " Hz TSC):\n",
+         rte_lcore_id(), rte_get_tsc_hz());
+  printf("%-9s %12s %8s %8s %8s %8s %8s %8s %10s\n", "stage", "count", "mean",
+         "p50", "p90", "p99", "p99.9", "p99.99", "max");
+  for (unsigned stage = 0; stage < NF_STAGE_COUNT; stage++) {
+    const struct nf_histogram *histogram = &nf_profile_histograms[stage];
+    if (histogram->count == 0) {
+      continue;
+    }
+    printf("%-9s %12" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+           " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %10" PRIu64 "\n",
+           stage_names[stage], histogram->count,
+           histogram->sum / histogram->count, percentile(histogram, 0.5),
+           percentile(histogram, 0.9), percentile(histogram, 0.99),
+           percentile(histogram, 0.999), percentile(histogram, 0.9999),
+           histogram->max);
+  }
+  fflush(stdout);
+  rte_spinlock_unlock(&dump_lock);
+}
+
+#endif // VIGOR_PROFILE && !KLEE_VERIFICATION && !NFOS
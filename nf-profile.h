@@ -0,0 +1,148 @@
+#pragma once
+
+// Opt-in profiling of nf_process, for builds with VIGOR_PROFILE defined,
+// e.g. `VIGOR_PROFILE=true make`: every core keeps a histogram of the TSC
+// cycles each stage of each packet took, and prints them all on SIGUSR1.
+// Stages are the libVig and nf-util calls the NFs make, which NF files time
+// by including this header: it shadows those functions with macros that time
+// them. nf.c times nf_process as a whole and the transmissions.
+// Histograms are log-linear, as in HdrHistogram: values below 16 are exact,
+// larger ones within 1/16, i.e. 6%. The cost of reading the TSC is measured
+// at startup and subtracted.
+// Unverified, and only in the DPDK build: otherwise this header defines
+// nothing but no-ops, and leaves the calls alone.
+
+#include <stdint.h>
+
+enum nf_stage {
+  // nf_then_get_*_header
+  NF_STAGE_PARSE,
+  // expire_items_single_map
+  NF_STAGE_EXPIRE,
+  // map_get
+  NF_STAGE_LOOKUP,
+  // dchain_allocate_new_index
+  NF_STAGE_ALLOCATE,
+  // nf_set_rte_ipv4_udptcp_checksum
+  NF_STAGE_CHECKSUM,
+  // rte_eth_tx_burst, per call, so per batch when batching
+  NF_STAGE_TX,
+  // nf_process as a whole
+  NF_STAGE_TOTAL,
+  NF_STAGE_COUNT
+};
+
+#if defined(VIGOR_PROFILE) && !defined(KLEE_VERIFICATION) && !defined(NFOS)
+
+#  include <signal.h>
+
+#  include <rte_branch_prediction.h>
+#  include <rte_cycles.h>
+
+// Declared before the macros below, so that the declarations are left alone
+#  include "libvig/verified/boilerplate-util.h"
+#  include "libvig/verified/double-chain.h"
+#  include "libvig/verified/expirator.h"
+#  include "libvig/verified/map.h"
+#  include "nf-util.h"
+
+#  define NF_PROFILE_SUB_BUCKET_BITS 4
+#  define NF_PROFILE_SUB_BUCKETS (1 << NF_PROFILE_SUB_BUCKET_BITS)
+// One row of sub-buckets for the exact values, then one per power of 2
+#  define NF_PROFILE_BUCKETS \
+    ((64 - NF_PROFILE_SUB_BUCKET_BITS + 1) * NF_PROFILE_SUB_BUCKETS)
+
+struct nf_histogram {
+  uint64_t counts[NF_PROFILE_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+};
+
+extern PER_CORE struct nf_histogram nf_profile_histograms[NF_STAGE_COUNT];
+extern uint64_t nf_profile_overhead;
+// Incremented by SIGUSR1; each core dumps its histograms when it sees that
+// it changed since its last dump
+extern volatile sig_atomic_t nf_profile_dumps_requested;
+extern PER_CORE sig_atomic_t nf_profile_dumps_done;
+
+// Sets up the SIGUSR1 handler and measures the cost of reading the TSC
+void nf_profile_init(void);
+void nf_profile_dump(void);
+
+static inline unsigned nf_profile_bucket(uint64_t cycles) {
+  if (cycles < NF_PROFILE_SUB_BUCKETS) {
+    return cycles;
+  }
+  unsigned msb = 63 - __builtin_clzll(cycles);
+  unsigned shift = msb - NF_PROFILE_SUB_BUCKET_BITS;
+  // The top bits, with the leading one dropped
+  unsigned sub_bucket = (cycles >> shift) - NF_PROFILE_SUB_BUCKETS;
+  return (shift + 1) * NF_PROFILE_SUB_BUCKETS + sub_bucket;
+}
+
+static inline uint64_t nf_profile_start(void) {
+  return rte_rdtsc_precise();
+}
+
+static inline void nf_profile_end(enum nf_stage stage, uint64_t start) {
+  uint64_t cycles = rte_rdtsc_precise() - start;
+  cycles = cycles > nf_profile_overhead ? cycles - nf_profile_overhead : 0;
+
+  struct nf_histogram *histogram = &nf_profile_histograms[stage];
+  histogram->counts[nf_profile_bucket(cycles)]++;
+  histogram->count++;
+  histogram->sum += cycles;
+  if (cycles > histogram->max) {
+    histogram->max = cycles;
+  }
+}
+
+// To be called by nf.c after each packet, outside of any timed stage
+static inline void nf_profile_packet_done(void) {
+  if (unlikely(nf_profile_dumps_requested != nf_profile_dumps_done)) {
+    nf_profile_dump();
+  }
+}
+
+#  define NF_PROFILE(stage, call)                              \
+    ({                                                         \
+      uint64_t _nf_profile_start = nf_profile_start();         \
+      __auto_type _nf_profile_result = (call);                 \
+      nf_profile_end(stage, _nf_profile_start);                \
+      _nf_profile_result;                                      \
+    })
+#  define NF_PROFILE_VOID(stage, call)                         \
+    do {                                                       \
+      uint64_t _nf_profile_start = nf_profile_start();         \
+      call;                                                    \
+      nf_profile_end(stage, _nf_profile_start);                \
+    } while (0)
+
+// A function-like macro is not expanded within its own expansion, so these
+// call the functions they shadow
+#  define nf_then_get_rte_ether_header(...) \
+    NF_PROFILE(NF_STAGE_PARSE, nf_then_get_rte_ether_header(__VA_ARGS__))
+#  define nf_then_get_rte_ipv4_header(...) \
+    NF_PROFILE(NF_STAGE_PARSE, nf_then_get_rte_ipv4_header(__VA_ARGS__))
+#  define nf_then_get_tcpudp_header(...) \
+    NF_PROFILE(NF_STAGE_PARSE, nf_then_get_tcpudp_header(__VA_ARGS__))
+#  define nf_then_get_tcp_flags_header(...) \
+    NF_PROFILE(NF_STAGE_PARSE, nf_then_get_tcp_flags_header(__VA_ARGS__))
+#  define expire_items_single_map(...) \
+    NF_PROFILE(NF_STAGE_EXPIRE, expire_items_single_map(__VA_ARGS__))
+#  define map_get(...) NF_PROFILE(NF_STAGE_LOOKUP, map_get(__VA_ARGS__))
+#  define dchain_allocate_new_index(...) \
+    NF_PROFILE(NF_STAGE_ALLOCATE, dchain_allocate_new_index(__VA_ARGS__))
+#  define nf_set_rte_ipv4_udptcp_checksum(...)  \
+    NF_PROFILE_VOID(NF_STAGE_CHECKSUM,          \
+                    nf_set_rte_ipv4_udptcp_checksum(__VA_ARGS__))
+
+#else // VIGOR_PROFILE && !KLEE_VERIFICATION && !NFOS
+
+#  define nf_profile_init() ((void)0)
+#  define nf_profile_start() ((uint64_t)0)
+#  define nf_profile_end(stage, start) ((void)(start))
+#  define nf_profile_packet_done() ((void)0)
+
+#endif // VIGOR_PROFILE && !KLEE_VERIFICATION && !NFOS
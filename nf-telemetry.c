@@ -0,0 +1,119 @@
+#include "nf-telemetry.h"
+
+#if !defined(KLEE_VERIFICATION) && !defined(NFOS)
+
+#  include <fcntl.h>
+#  include <stdio.h>
+#  include <stdlib.h>
+#  include <string.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+
+#  include <rte_common.h>
+
+#  include "nf-log.h"
+
+// Layout of the segment, which nf-telemetry.py reads: the header, the
+// descriptions of the counters, then block_count blocks of block_size bytes
+// starting at block_offset, each with counter_count 64-bit counters.
+// Everything is in host byte order.
+#  define TELEMETRY_MAGIC "VIGTLM1"
+
+struct telemetry_header {
+  char magic[8];
+  uint32_t block_count;
+  uint32_t counter_count;
+  uint32_t block_offset;
+  uint32_t block_size;
+};
+
+struct telemetry_counter {
+  char name[31];
+  // Whether it is a gauge, which readers show as is, rather than as a rate
+  uint8_t is_gauge;
+};
+
+static const struct telemetry_counter counters[NF_COUNTER_COUNT] = {
+  [NF_COUNTER_RX] = { "rx", 0 },
+  [NF_COUNTER_TX] = { "tx", 0 },
+  [NF_COUNTER_FLOODED] = { "flooded", 0 },
+  [NF_COUNTER_DROP_NF] = { "drop_nf", 0 },
+  [NF_COUNTER_DROP_TX] = { "drop_tx", 0 },
+  [NF_COUNTER_DROP_RING] = { "drop_ring", 0 },
+  [NF_COUNTER_EXPIRED] = { "expired", 0 },
+  [NF_COUNTER_ALLOC_FAILED] = { "alloc_failed", 0 },
+  [NF_COUNTER_FLOWS] = { "flows", 1 },
+};
+
+// Blocks are whole cache lines, so that no two cores write to the same one
+#  define BLOCK_SIZE \
+    RTE_ALIGN_CEIL(NF_COUNTER_COUNT * sizeof(uint64_t), RTE_CACHE_LINE_SIZE)
+#  define BLOCK_OFFSET                               \
+    RTE_ALIGN_CEIL(sizeof(struct telemetry_header) + \
+                       sizeof(counters),             \
+                   RTE_CACHE_LINE_SIZE)
+
+// Where cores count until nf_telemetry_core_init, or if there is no segment
+static uint64_t unexported_values[NF_COUNTER_COUNT];
+
+PER_CORE volatile uint64_t *nf_telemetry_values = unexported_values;
+
+static char segment_name[32];
+static uint8_t *segment;
+static unsigned segment_blocks;
+
+// Readers skip the segments of processes that are gone, but those that exit
+// normally, including through rte_exit, remove theirs
+static void remove_segment(void) {
+  shm_unlink(segment_name);
+}
+
+void nf_telemetry_init(unsigned block_count) {
+  char *name = segment_name;
+  snprintf(name, sizeof(segment_name), "/vigor-%d", (int)getpid());
+  size_t size = BLOCK_OFFSET + (size_t)block_count * BLOCK_SIZE;
+
+  int fd = shm_open(name, O_CREAT | O_TRUNC | O_RDWR, 0644);
+  if (fd < 0) {
+    NF_INFO("Cannot create the telemetry segment %s, no telemetry", name);
+    return;
+  }
+  if (ftruncate(fd, size) != 0) {
+    NF_INFO("Cannot size the telemetry segment %s, no telemetry", name);
+    close(fd);
+    shm_unlink(name);
+    return;
+  }
+  void *mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    NF_INFO("Cannot map the telemetry segment %s, no telemetry", name);
+    shm_unlink(name);
+    return;
+  }
+
+  // Zero-filled by ftruncate; the magic goes last so that readers never see
+  // a half-written header
+  struct telemetry_header *header = mapped;
+  header->block_count = block_count;
+  header->counter_count = NF_COUNTER_COUNT;
+  header->block_offset = BLOCK_OFFSET;
+  header->block_size = BLOCK_SIZE;
+  memcpy(header + 1, counters, sizeof(counters));
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(header->magic, TELEMETRY_MAGIC, sizeof(header->magic));
+
+  segment = mapped;
+  segment_blocks = block_count;
+  atexit(remove_segment);
+  NF_INFO("Telemetry in the shared memory segment %s", name);
+}
+
+void nf_telemetry_core_init(unsigned block) {
+  if (segment != NULL && block < segment_blocks) {
+    nf_telemetry_values =
+        (volatile uint64_t *)(segment + BLOCK_OFFSET + block * BLOCK_SIZE);
+  }
+}
+
+#endif // !KLEE_VERIFICATION && !NFOS
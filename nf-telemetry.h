@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "libvig/verified/boilerplate-util.h"
+
+// Counters of nf.c and of the NF, exported through a shared memory segment
+// that other processes read, e.g. nf-telemetry.py. Every core has its own
+// block of counters and updates it with plain stores: no atomics, no locks,
+// no shared cache lines. Readers see each counter whole, since 64-bit stores
+// are atomic, but not a consistent snapshot of a block.
+// Unverified: with KLEE_VERIFICATION and in the NFOS the counters compile to
+// nothing, so they do not change what is verified.
+
+enum nf_counter {
+  // Packets received from the devices, and sent to them, once per device
+  // for floods
+  NF_COUNTER_RX,
+  NF_COUNTER_TX,
+  // Packets nf_process flooded
+  NF_COUNTER_FLOODED,
+  // Packets dropped because nf_process said so, because a TX queue was full,
+  // and because the ring of the core they were steered to was full
+  NF_COUNTER_DROP_NF,
+  NF_COUNTER_DROP_TX,
+  NF_COUNTER_DROP_RING,
+  // Entries of the NF's tables that expired, and that could not be allocated
+  // because their table was full
+  NF_COUNTER_EXPIRED,
+  NF_COUNTER_ALLOC_FAILED,
+  // Gauge, not a counter: entries in the NF's main table
+  NF_COUNTER_FLOWS,
+  NF_COUNTER_COUNT
+};
+
+#if defined(KLEE_VERIFICATION) || defined(NFOS)
+
+#  define nf_telemetry_init(block_count) ((void)0)
+#  define nf_telemetry_core_init(block) ((void)0)
+// n is still evaluated, so that it can be a variable used nowhere else;
+// value is not, so that it can read state the models do not expect to be read
+#  define nf_telemetry_add(counter, n) ((void)(n))
+#  define nf_telemetry_set(counter, value) ((void)0)
+
+#else // KLEE_VERIFICATION || NFOS
+
+// Creates the segment "/vigor-<pid>", with the given number of blocks.
+// If it cannot, the counters still work but nobody can read them.
+void nf_telemetry_init(unsigned block_count);
+
+// Points the calling core's counters to the given block, which it must be
+// the only one to use
+void nf_telemetry_core_init(unsigned block);
+
+// The calling core's block; volatile so that every update is a store
+extern PER_CORE volatile uint64_t *nf_telemetry_values;
+
+static inline void nf_telemetry_add(enum nf_counter counter, uint64_t n) {
+  nf_telemetry_values[counter] += n;
+}
+
+static inline void nf_telemetry_set(enum nf_counter counter, uint64_t value) {
+  nf_telemetry_values[counter] = value;
+}
+
+#endif // KLEE_VERIFICATION || NFOS
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+# Prints the counters a running DPDK NF exports, see nf-telemetry.h: every
+# interval, the rate of each counter over that interval and its total since
+# the NF started, summed over all cores, or the current value of gauges.
+#
+# Usage: nf-telemetry.py [--per-core] [<pid> [<interval in s> [<count>]]]
+# Without a pid, reads the segment of the only running NF. Without a count,
+# prints until the NF exits.
+
+import glob
+import mmap
+import os
+import struct
+import sys
+import time
+
+MAGIC = b'VIGTLM1\0'
+# struct telemetry_header and struct telemetry_counter, in host byte order
+HEADER = struct.Struct('=8sIIII')
+COUNTER = struct.Struct('=31sB')
+
+
+def is_running(pid):
+  try:
+    os.kill(pid, 0)
+  except ProcessLookupError:
+    return False
+  except PermissionError:
+    pass
+  return True
+
+
+def find_segment():
+  pids = []
+  for path in glob.glob('/dev/shm/vigor-*'):
+    suffix = path[len('/dev/shm/vigor-'):]
+    if suffix.isdigit() and is_running(int(suffix)):
+      pids.append(int(suffix))
+  if len(pids) != 1:
+    print('Found ' + str(len(pids)) + ' running NFs, pass a pid',
+          file=sys.stderr)
+    sys.exit(1)
+  return pids[0]
+
+
+class Segment:
+
+  def __init__(self, pid):
+    with open('/dev/shm/vigor-' + str(pid), 'rb') as f:
+      self.data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    (magic, self.block_count, counter_count, self.block_offset,
+     self.block_size) = HEADER.unpack_from(self.data)
+    if magic != MAGIC:
+      raise ValueError('not a telemetry segment, or not initialized yet')
+    self.counters = []
+    for i in range(counter_count):
+      name, is_gauge = COUNTER.unpack_from(self.data,
+                                           HEADER.size + i * COUNTER.size)
+      self.counters.append((name.rstrip(b'\0').decode(), is_gauge != 0))
+    self.values = struct.Struct('=' + str(counter_count) + 'Q')
+
+  def read(self):
+    """Returns the counters of each block"""
+    return [self.values.unpack_from(self.data,
+                                    self.block_offset + b * self.block_size)
+            for b in range(self.block_count)]
+
+
+def print_values(segment, previous, current, elapsed, per_core):
+  rows = [('total', [sum(column) for column in zip(*previous)],
+           [sum(column) for column in zip(*current)])]
+  if per_core:
+    # The last block is the software dispatcher's, if there is one
+    rows += [('core ' + str(b) if b < segment.block_count - 1 else 'dispatch',
+              previous[b], current[b]) for b in range(segment.block_count)]
+
+  for label, before, after in rows:
+    if per_core:
+      print(label + ':')
+    for (name, is_gauge), old, new in zip(segment.counters, before, after):
+      if is_gauge:
+        print('  {:<14} {:>14}'.format(name, new))
+      else:
+        print('  {:<14} {:>14.0f}/s {:>20}'.format(name,
+                                                   (new - old) / elapsed, new))
+  print()
+
+
+def main():
+  args = sys.argv[1:]
+  per_core = '--per-core' in args
+  args = [arg for arg in args if arg != '--per-core']
+  if len(args) > 3:
+    print('Usage: ' + sys.argv[0] +
+          ' [--per-core] [<pid> [<interval in s> [<count>]]]', file=sys.stderr)
+    sys.exit(1)
+
+  pid = int(args[0]) if len(args) > 0 else find_segment()
+  interval = float(args[1]) if len(args) > 1 else 1.0
+  count = int(args[2]) if len(args) > 2 else None
+  segment = Segment(pid)
+
+  previous = segment.read()
+  previous_time = time.monotonic()
+  while is_running(pid) and count != 0:
+    time.sleep(interval)
+    current = segment.read()
+    current_time = time.monotonic()
+    print_values(segment, previous, current, current_time - previous_time,
+                 per_core)
+    previous, previous_time = current, current_time
+    if count is not None:
+      count -= 1
+
+
+if __name__ == '__main__':
+  try:
+    main()
+  except KeyboardInterrupt:
+    pass
@@ -15,8 +15,8 @@
 #  include <klee/klee.h>
 #endif
 
-void *chunks_borrowed[MAX_N_CHUNKS];
-size_t chunks_borrowed_num = 0;
+PER_CORE void *chunks_borrowed[MAX_N_CHUNKS];
+PER_CORE size_t chunks_borrowed_num = 0;
 
 bool nf_has_rte_ipv4_header(struct rte_ether_hdr *header) {
   return header->ether_type == rte_be_to_cpu_16(RTE_ETHER_TYPE_IPV4);
@@ -5,11 +5,14 @@
 #include <stdio.h>
 #include <assert.h>
 
+#include <netinet/in.h>
+
 #include <rte_common.h>
 #include <rte_byteorder.h>
 #include <rte_mbuf.h>
 #include <rte_ethdev.h>
 #include <rte_ip.h>
+#include "libvig/verified/boilerplate-util.h"
 #include "libvig/verified/packet-io.h"
 #include "libvig/verified/tcpudp_hdr.h"
 
@@ -55,6 +58,12 @@ static struct str_field_descr tcpudp_fields[] = {
   { offsetof(struct tcpudp_hdr, src_port), sizeof(uint16_t), 0, "src_port" },
   { offsetof(struct tcpudp_hdr, dst_port), sizeof(uint16_t), 0, "dst_port" }
 };
+static struct str_field_descr tcp_flags_fields[] = {
+  { offsetof(struct tcp_flags_hdr, sent_seq), sizeof(uint32_t), 0, "sent_seq" },
+  { offsetof(struct tcp_flags_hdr, recv_ack), sizeof(uint32_t), 0, "recv_ack" },
+  { offsetof(struct tcp_flags_hdr, data_off), sizeof(uint8_t), 0, "data_off" },
+  { offsetof(struct tcp_flags_hdr, tcp_flags), sizeof(uint8_t), 0, "tcp_flags" }
+};
 static struct nested_field_descr rte_ether_nested_fields[] = {
   { offsetof(struct rte_ether_hdr, d_addr), 0, sizeof(uint8_t), 6, "addr_bytes" },
   { offsetof(struct rte_ether_hdr, s_addr), 0, sizeof(uint8_t), 6, "addr_bytes" }
@@ -76,8 +85,8 @@ char *nf_mac_to_str(struct rte_ether_addr *addr);
 char *nf_rte_ipv4_to_str(uint32_t addr);
 
 #define MAX_N_CHUNKS 100
-extern void *chunks_borrowed[];
-extern size_t chunks_borrowed_num;
+extern PER_CORE void *chunks_borrowed[];
+extern PER_CORE size_t chunks_borrowed_num;
 
 static inline void *nf_borrow_next_chunk(void *p, size_t length) {
   assert(chunks_borrowed_num < MAX_N_CHUNKS);
@@ -160,3 +169,15 @@ nf_then_get_tcpudp_header(struct rte_ipv4_hdr *ip_header, void *p) {
   return (struct tcpudp_hdr *)nf_borrow_next_chunk(p,
                                                    sizeof(struct tcpudp_hdr));
 }
+
+// Only for TCP packets, right after nf_then_get_tcpudp_header
+static inline struct tcp_flags_hdr *
+nf_then_get_tcp_flags_header(struct rte_ipv4_hdr *ip_header, void *p) {
+  if ((ip_header->next_proto_id != IPPROTO_TCP) |
+      (packet_get_unread_length(p) < sizeof(struct tcp_flags_hdr))) {
+    return NULL;
+  }
+  CHUNK_LAYOUT(p, tcp_flags_hdr, tcp_flags_fields);
+  return (struct tcp_flags_hdr *)nf_borrow_next_chunk(
+      p, sizeof(struct tcp_flags_hdr));
+}
@@ -1,8 +1,12 @@
 #include "nf.h"
 #include "nf-log.h"
+#include "nf-profile.h"
+#include "nf-telemetry.h"
 #include "nf-util.h"
 
 #include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <rte_common.h>
 #include <rte_eal.h>
@@ -14,6 +18,19 @@
 #include "libvig/verified/boilerplate-util.h"
 #include "libvig/verified/packet-io.h"
 
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+#  include <rte_flow.h>
+#  include <rte_hash_crc.h>
+#  include <rte_launch.h>
+#  include <rte_ring.h>
+#  include <rte_spinlock.h>
+#endif // MULTICORE
+
+#if !defined(KLEE_VERIFICATION) && !defined(NFOS)
+#  include <rte_interrupts.h>
+#  include <rte_pause.h>
+#endif // !KLEE_VERIFICATION && !NFOS
+
 #ifdef KLEE_VERIFICATION
 #  include "libvig/models/hardware.h"
 #  include "libvig/models/verified/vigor-time-control.h"
@@ -50,51 +67,338 @@
       stub_hardware_reset_receive(VIGOR_DEVICE);                                  \
       nf_loop_iteration_border(_vigor_lcore_id, VIGOR_NOW);                       \
     }
+#  define VIGOR_LOOP_RECEIVED()
 #else // KLEE_VERIFICATION
 #  define VIGOR_LOOP_BEGIN                                                                   \
+    rx_idle_init(0, true);                                                                   \
     while (1) {                                                                              \
       vigor_time_t VIGOR_NOW = current_time();                                               \
       unsigned VIGOR_DEVICES_COUNT = rte_eth_dev_count_avail();                                    \
+      unsigned VIGOR_RECEIVED_COUNT = 0;                                                     \
       for (uint16_t VIGOR_DEVICE = 0; VIGOR_DEVICE < VIGOR_DEVICES_COUNT; VIGOR_DEVICE++) {
 #  define VIGOR_LOOP_END                                                                     \
       }                                                                                      \
+      rx_idle_wait(VIGOR_RECEIVED_COUNT, VIGOR_NOW, 0);                                      \
     }
+// Tells the loop a packet was received, so that it does not back off
+#  define VIGOR_LOOP_RECEIVED() VIGOR_RECEIVED_COUNT++
 #endif // KLEE_VERIFICATION
 
 
 #if VIGOR_BATCH_SIZE == 1
-// Queue sizes for receiving/transmitting packets
+// Default queue sizes for receiving/transmitting packets
 // NOT powers of 2 so that ixgbe doesn't use vector stuff
 // but they have to be multiples of 8, and at least 32,
 // otherwise the driver refuses to work
-static const uint16_t RX_QUEUE_SIZE = 96;
-static const uint16_t TX_QUEUE_SIZE = 96;
+#  define DEFAULT_RX_QUEUE_SIZE 96
+#  define DEFAULT_TX_QUEUE_SIZE 96
 #else
 // Do the opposite: we want batching!
-static const uint16_t RX_QUEUE_SIZE = 128;
-static const uint16_t TX_QUEUE_SIZE = 128;
+#  define DEFAULT_RX_QUEUE_SIZE 128
+#  define DEFAULT_TX_QUEUE_SIZE 128
 #endif
 
-// Buffer count for mempools
+// Default number of buffers each core caches from each mempool,
+// see rte_mempool_create for the constraints
+#define DEFAULT_MEMPOOL_CACHE_SIZE 256
+
+// Buffers in flight beyond those the rings and caches can hold,
+// per device mempool
 static const unsigned MEMPOOL_BUFFER_COUNT = 256;
 
+// Sizes of the queues, of the per-device mempools (0 means enough for all
+// queues, see mempool_size) and of their per-core caches, which can be set
+// on the command line, see nf_io_config_init
+static unsigned rx_queue_size = DEFAULT_RX_QUEUE_SIZE;
+static unsigned tx_queue_size = DEFAULT_TX_QUEUE_SIZE;
+static unsigned mempool_buffer_count = 0;
+static unsigned mempool_cache_size = DEFAULT_MEMPOOL_CACHE_SIZE;
+
+// Default longest sleep waiting for RX interrupts, which bounds the wake-up
+// latency when an interrupt is missed
+#define DEFAULT_IDLE_MAX_SLEEP 10 // milliseconds
+
+// Adaptive RX, which can also be set on the command line: how long a core
+// polls in vain before sleeping until an RX interrupt, 0 to always busy-poll,
+// and how long it may sleep at most; see rx_idle_wait
+static unsigned idle_timeout = 0; // microseconds
+static unsigned idle_max_sleep = DEFAULT_IDLE_MAX_SLEEP;
+
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+// Whether the main lcore dispatches the packets to the others in software,
+// instead of the devices spreading them over the cores with RSS; see
+// choose_dispatch. Define VIGOR_SOFTWARE_DISPATCH to always do it.
+static bool software_dispatch = false;
+
+// Room for the RSS keys of all the devices we know of, e.g. 52B for i40e
+#  define RSS_KEY_MAX_SIZE 64
+
+// Hashed fields; their pairs (addresses, ports) are hashed symmetrically
+static const uint64_t RSS_HASH_FIELDS = ETH_RSS_IP | ETH_RSS_TCP | ETH_RSS_UDP;
+
+unsigned nf_core_count(void) {
+  return rte_lcore_count() - (software_dispatch ? 1 : 0);
+}
+
+unsigned nf_core_index(void) {
+  unsigned index = rte_lcore_index(rte_lcore_id());
+  // The dispatcher does not run the NF
+  if (software_dispatch &&
+      index > (unsigned)rte_lcore_index(rte_get_master_lcore())) {
+    index--;
+  }
+  return index;
+}
+
+// With the same 16 bits repeated in the Toeplitz key, swapping the source
+// and destination addresses and ports does not change the hash, so both
+// directions of a flow land on the same queue, and thus the same core
+static void fill_symmetric_rss_key(uint8_t* key, uint8_t size) {
+  for (uint8_t n = 0; n < size; n++) {
+    key[n] = n % 2 == 0 ? 0x6d : 0x5a;
+  }
+}
+
+static bool device_supports_symmetric_rss(uint16_t device) {
+  struct rte_eth_dev_info dev_info;
+  if (rte_eth_dev_info_get(device, &dev_info) != 0) {
+    return false;
+  }
+  return (dev_info.flow_type_rss_offloads & RSS_HASH_FIELDS) != 0 &&
+         dev_info.hash_key_size != 0 &&
+         dev_info.hash_key_size <= RSS_KEY_MAX_SIZE &&
+         dev_info.max_rx_queues >= rte_lcore_count();
+}
+
+// Stateful NFs need both directions of a flow on the same core, which RSS
+// only guarantees with a key we can set; if any device cannot do that, e.g.
+// a vdev, the main lcore dispatches the packets itself
+static void choose_dispatch(void) {
+  if (rte_lcore_count() == 1) {
+    return;
+  }
+#  ifdef VIGOR_SOFTWARE_DISPATCH
+  software_dispatch = true;
+#  else // VIGOR_SOFTWARE_DISPATCH
+  uint16_t nb_devices = rte_eth_dev_count_avail();
+  for (uint16_t device = 0; device < nb_devices; device++) {
+    if (!device_supports_symmetric_rss(device)) {
+      NF_INFO("Device %" PRIu16 " has no configurable RSS", device);
+      software_dispatch = true;
+    }
+  }
+#  endif // VIGOR_SOFTWARE_DISPATCH
+  if (rte_lcore_count() == 2 && software_dispatch) {
+    rte_exit(EXIT_FAILURE, "Software dispatch needs at least 3 lcores\n");
+  }
+}
+#else // MULTICORE
+unsigned nf_core_count(void) {
+  return 1;
+}
+
+unsigned nf_core_index(void) {
+  return 0;
+}
+#endif // MULTICORE
+
+// One RX queue per core, unless the packets are dispatched in software
+static uint16_t rx_queue_count(void) {
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+  if (software_dispatch) {
+    return 1;
+  }
+#endif // MULTICORE
+  return nf_core_count();
+}
+
+#ifndef KLEE_VERIFICATION
+// Devices the next flood goes to, see nf_set_flood_devices
+static PER_CORE uint64_t flood_devices = UINT64_MAX;
+
+void nf_set_flood_devices(uint64_t devices) {
+  flood_devices = devices;
+}
+
+// Fills targets with the devices to flood the given packet to, and resets
+// the restriction for the next packet
+static uint16_t flood_targets(struct rte_mbuf* packet, uint16_t nb_devices,
+                              uint16_t* targets) {
+  uint64_t devices = flood_devices;
+  flood_devices = UINT64_MAX;
+
+  uint16_t count = 0;
+  for (uint16_t device = 0; device < nb_devices; device++) {
+    if (device != packet->port &&
+        (device >= 64 || (devices & (1ull << device)) != 0)) {
+      targets[count++] = device;
+    }
+  }
+  return count;
+}
+#endif // KLEE_VERIFICATION
+
 // Send the given packet to all devices except the packet's own
-void flood(struct rte_mbuf* packet, uint16_t nb_devices) {
+void flood(struct rte_mbuf* packet, uint16_t nb_devices, uint16_t queue) {
+#ifndef KLEE_VERIFICATION
+  if (flood_devices != UINT64_MAX) {
+    uint16_t targets[RTE_MAX_ETHPORTS];
+    uint16_t count = flood_targets(packet, nb_devices, targets);
+    if (count == 0) {
+      rte_pktmbuf_free(packet);
+      return;
+    }
+    rte_mbuf_refcnt_set(packet, count);
+    for (uint16_t n = 0; n < count; n++) {
+      uint64_t start = nf_profile_start();
+      uint16_t sent = rte_eth_tx_burst(targets[n], queue, &packet, 1);
+      nf_profile_end(NF_STAGE_TX, start);
+      if (sent == 1) {
+        nf_telemetry_add(NF_COUNTER_TX, 1);
+      } else {
+        nf_telemetry_add(NF_COUNTER_DROP_TX, 1);
+        rte_pktmbuf_free(packet); // drops this device's reference
+      }
+    }
+    return;
+  }
+#endif // KLEE_VERIFICATION
   rte_mbuf_refcnt_set(packet, nb_devices - 1);
   int total_sent = 0;
   uint16_t skip_device = packet->port;
   for (uint16_t device = 0; device < nb_devices; device++) {
     if (device != skip_device) {
-      total_sent += rte_eth_tx_burst(device, 0, &packet, 1);
+      uint64_t start = nf_profile_start();
+      total_sent += rte_eth_tx_burst(device, queue, &packet, 1);
+      nf_profile_end(NF_STAGE_TX, start);
     }
   }
+  nf_telemetry_add(NF_COUNTER_TX, total_sent);
   // should not happen, but in case we couldn't transmit, ensure the packet is freed
   if (total_sent != nb_devices - 1) {
+    nf_telemetry_add(NF_COUNTER_DROP_TX, nb_devices - 1 - total_sent);
     rte_mbuf_refcnt_set(packet, 1);
     rte_pktmbuf_free(packet);
   }
 }
 
+#ifndef KLEE_VERIFICATION
+// Unverified TX batching, for the loops that receive bursts: packets wait in
+// a per-device batch until it is full or the burst is over, so that each
+// device's queue is written to once per burst rather than once per packet.
+// Floods put the same mbuf in the batch of each target with one reference per
+// device, so that they are not copied; this relies on the devices not
+// modifying the packets they send, i.e. on no TX offloads.
+#  define TX_BATCH_SIZE 32
+
+struct tx_batch {
+  uint16_t count;
+  struct rte_mbuf* mbufs[TX_BATCH_SIZE];
+};
+
+static PER_CORE struct tx_batch tx_batches[RTE_MAX_ETHPORTS];
+
+static void tx_batch_flush(uint16_t device, uint16_t queue) {
+  struct tx_batch* batch = &tx_batches[device];
+  uint64_t start = nf_profile_start();
+  uint16_t sent = rte_eth_tx_burst(device, queue, batch->mbufs, batch->count);
+  nf_profile_end(NF_STAGE_TX, start);
+  nf_telemetry_add(NF_COUNTER_TX, sent);
+  nf_telemetry_add(NF_COUNTER_DROP_TX, batch->count - sent);
+  for (uint16_t n = sent; n < batch->count; n++) {
+    rte_pktmbuf_free(batch->mbufs[n]);
+  }
+  batch->count = 0;
+}
+
+static void tx_batch_add(uint16_t device, uint16_t queue,
+                         struct rte_mbuf* mbuf) {
+  struct tx_batch* batch = &tx_batches[device];
+  batch->mbufs[batch->count++] = mbuf;
+  if (batch->count == TX_BATCH_SIZE) {
+    tx_batch_flush(device, queue);
+  }
+}
+
+// To be called at the end of each burst
+static void tx_batches_flush(uint16_t nb_devices, uint16_t queue) {
+  for (uint16_t device = 0; device < nb_devices; device++) {
+    if (tx_batches[device].count != 0) {
+      tx_batch_flush(device, queue);
+    }
+  }
+}
+
+static void flood_batched(struct rte_mbuf* packet, uint16_t nb_devices,
+                          uint16_t queue) {
+  uint16_t targets[RTE_MAX_ETHPORTS];
+  uint16_t count = flood_targets(packet, nb_devices, targets);
+  if (count == 0) {
+    rte_pktmbuf_free(packet);
+    return;
+  }
+  // Before any batch is flushed, since each flush may free a reference
+  rte_mbuf_refcnt_set(packet, count);
+  for (uint16_t n = 0; n < count; n++) {
+    tx_batch_add(targets[n], queue, packet);
+  }
+}
+
+// Processes a packet of a burst, see tx_batches_flush
+static void process_packet(struct rte_mbuf* mbuf, uint16_t queue,
+                           vigor_time_t now, uint16_t nb_devices) {
+  uint8_t* data = rte_pktmbuf_mtod(mbuf, uint8_t*);
+  packet_state_total_length(data, &(mbuf->pkt_len));
+  uint64_t start = nf_profile_start();
+  uint16_t dst_device = nf_process(mbuf->port, data, mbuf->pkt_len, now);
+  nf_profile_end(NF_STAGE_TOTAL, start);
+  nf_return_all_chunks(data);
+
+  if (dst_device == mbuf->port) {
+    nf_telemetry_add(NF_COUNTER_DROP_NF, 1);
+    rte_pktmbuf_free(mbuf);
+  } else if (dst_device == FLOOD_FRAME) {
+    nf_telemetry_add(NF_COUNTER_FLOODED, 1);
+    flood_batched(mbuf, nb_devices, queue);
+  } else {
+    tx_batch_add(dst_device, queue, mbuf);
+  }
+  nf_profile_packet_done();
+}
+
+// See nf_set_burst_hook
+static PER_CORE nf_burst_fn burst_hook = NULL;
+
+void nf_set_burst_hook(nf_burst_fn hook) {
+  burst_hook = hook;
+}
+
+// Processes a burst of at most BURST_MAX_SIZE packets, see process_packet
+#  define BURST_MAX_SIZE 64
+#  if VIGOR_BATCH_SIZE > BURST_MAX_SIZE
+#    error "VIGOR_BATCH_SIZE is larger than BURST_MAX_SIZE"
+#  endif
+static void process_burst(struct rte_mbuf** mbufs, uint16_t count,
+                          uint16_t queue, vigor_time_t now,
+                          uint16_t nb_devices) {
+  if (burst_hook != NULL && count != 0) {
+    uint16_t devices[BURST_MAX_SIZE];
+    uint8_t* buffers[BURST_MAX_SIZE];
+    uint16_t lengths[BURST_MAX_SIZE];
+    for (uint16_t n = 0; n < count; n++) {
+      devices[n] = mbufs[n]->port;
+      buffers[n] = rte_pktmbuf_mtod(mbufs[n], uint8_t*);
+      lengths[n] = rte_pktmbuf_data_len(mbufs[n]);
+    }
+    burst_hook(devices, buffers, lengths, count);
+  }
+
+  for (uint16_t n = 0; n < count; n++) {
+    process_packet(mbufs[n], queue, now, nb_devices);
+  }
+}
+#endif // KLEE_VERIFICATION
+
 // Initializes the given device using the given memory pool
 static int nf_init_device(uint16_t device, struct rte_mempool* mbuf_pool) {
   int retval;
@@ -103,25 +407,59 @@ static int nf_init_device(uint16_t device, struct rte_mempool* mbuf_pool) {
   struct rte_eth_conf device_conf = {0};
   //device_conf.rxmode.hw_strip_crc = 1;
 
-  // Configure the device (1, 1 == number of RX/TX queues)
-  retval = rte_eth_dev_configure(device, 1, 1, &device_conf);
-  if (retval != 0) {
-    return retval;
+  // One TX queue per core
+  uint16_t tx_queue_count = nf_core_count();
+  uint16_t rx_queues = rx_queue_count();
+
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+  // Spread the flows over the cores, with a symmetric key
+  uint8_t rss_key[RSS_KEY_MAX_SIZE];
+  if (rx_queues > 1) {
+    struct rte_eth_dev_info dev_info;
+    retval = rte_eth_dev_info_get(device, &dev_info);
+    if (retval != 0) {
+      return retval;
+    }
+    fill_symmetric_rss_key(rss_key, dev_info.hash_key_size);
+    device_conf.rxmode.mq_mode = ETH_MQ_RX_RSS;
+    device_conf.rx_adv_conf.rss_conf.rss_key = rss_key;
+    device_conf.rx_adv_conf.rss_conf.rss_key_len = dev_info.hash_key_size;
+    device_conf.rx_adv_conf.rss_conf.rss_hf =
+        RSS_HASH_FIELDS & dev_info.flow_type_rss_offloads;
   }
+#endif // MULTICORE
 
-  // Allocate and set up a TX queue (NULL == default config)
-  retval = rte_eth_tx_queue_setup(device, 0, TX_QUEUE_SIZE,
-                                  rte_eth_dev_socket_id(device), NULL);
+#if !defined(KLEE_VERIFICATION) && !defined(NFOS)
+  // Needed for rx_idle_sleep, which copes with devices that do not have them
+  if (idle_timeout != 0) {
+    device_conf.intr_conf.rxq = 1;
+  }
+#endif // !KLEE_VERIFICATION && !NFOS
+
+  // Configure the device
+  retval = rte_eth_dev_configure(device, rx_queues, tx_queue_count,
+                                 &device_conf);
   if (retval != 0) {
     return retval;
   }
 
+  // Allocate and set up TX queues (NULL == default config)
+  for (uint16_t queue = 0; queue < tx_queue_count; queue++) {
+    retval = rte_eth_tx_queue_setup(device, queue, tx_queue_size,
+                                    rte_eth_dev_socket_id(device), NULL);
+    if (retval != 0) {
+      return retval;
+    }
+  }
+
   // Allocate and set up RX queues (NULL == default config)
-  retval = rte_eth_rx_queue_setup(device, 0, RX_QUEUE_SIZE,
-                                  rte_eth_dev_socket_id(device),
-                                  NULL, mbuf_pool);
-  if (retval != 0) {
-    return retval;
+  for (uint16_t queue = 0; queue < rx_queues; queue++) {
+    retval = rte_eth_rx_queue_setup(device, queue, rx_queue_size,
+                                    rte_eth_dev_socket_id(device),
+                                    NULL, mbuf_pool);
+    if (retval != 0) {
+      return retval;
+    }
   }
 
   // Start the device
@@ -139,32 +477,503 @@ static int nf_init_device(uint16_t device, struct rte_mempool* mbuf_pool) {
   return 0;
 }
 
-// Main worker method (for now used on a single thread...)
-static void worker_main(void) {
+#if !defined(KLEE_VERIFICATION) && !defined(NFOS)
+// Adaptive RX (unverified), for sites that are idle most of the time: after
+// IDLE_SPIN_SWEEPS sweeps over the devices without a packet, a core pauses
+// between sweeps, twice as long each time up to IDLE_MAX_PAUSES rte_pause,
+// i.e. some microseconds. Once it has had no packet for idle_timeout, it
+// sleeps until an RX interrupt on one of its queues, or idle_max_sleep.
+#  define IDLE_SPIN_SWEEPS 64
+#  define IDLE_MAX_PAUSES 1024
+
+static PER_CORE struct {
+  unsigned empty_sweeps;
+  unsigned pauses;
+  vigor_time_t idle_since;
+  // Whether the core can sleep, i.e. has queues with working interrupts
+  bool can_sleep;
+} rx_idle;
+
+// Registers the RX interrupts of the given queue of each device with the
+// calling core; a core that only reads rings cannot sleep
+static void rx_idle_init(uint16_t queue, bool has_queues) {
+  rx_idle.empty_sweeps = 0;
+  rx_idle.pauses = 1;
+  rx_idle.can_sleep = false;
+  if (idle_timeout == 0 || !has_queues) {
+    return;
+  }
+
+  rx_idle.can_sleep = true;
+  uint16_t nb_devices = rte_eth_dev_count_avail();
+  for (uint16_t device = 0; device < nb_devices; device++) {
+    if (rte_eth_dev_rx_intr_ctl_q(device, queue, RTE_EPOLL_PER_THREAD,
+                                  RTE_INTR_EVENT_ADD, NULL) != 0) {
+      NF_INFO("Device %" PRIu16 " has no RX interrupts, core %u will only "
+              "back off", device, rte_lcore_id());
+      rx_idle.can_sleep = false;
+    }
+  }
+}
+
+// Sleeps until a packet arrives on the given queue of any device, or at most
+// idle_max_sleep; a packet that arrived just before the interrupts were
+// enabled may not wake the core up before that
+static void rx_idle_sleep(uint16_t queue) {
+  uint16_t nb_devices = rte_eth_dev_count_avail();
+  for (uint16_t device = 0; device < nb_devices; device++) {
+    rte_eth_dev_rx_intr_enable(device, queue);
+  }
+
+  struct rte_epoll_event events[RTE_MAX_ETHPORTS];
+  rte_epoll_wait(RTE_EPOLL_PER_THREAD, events, nb_devices, idle_max_sleep);
+
+  for (uint16_t device = 0; device < nb_devices; device++) {
+    rte_eth_dev_rx_intr_disable(device, queue);
+  }
+}
+
+// Called after each sweep over the devices, with the number of packets
+// received during it
+static void rx_idle_wait(unsigned received, vigor_time_t now, uint16_t queue) {
+  if (idle_timeout == 0) {
+    return;
+  }
+
+  if (received != 0) {
+    rx_idle.empty_sweeps = 0;
+    rx_idle.pauses = 1;
+    return;
+  }
+
+  if (rx_idle.empty_sweeps == 0) {
+    rx_idle.idle_since = now;
+  }
+  rx_idle.empty_sweeps++;
+  if (rx_idle.empty_sweeps < IDLE_SPIN_SWEEPS) {
+    return;
+  }
+
+  if (rx_idle.can_sleep &&
+      now - rx_idle.idle_since >= (vigor_time_t)idle_timeout * 1000) {
+    rx_idle_sleep(queue);
+    rx_idle.empty_sweeps = 0;
+    rx_idle.pauses = 1;
+    return;
+  }
+
+  for (unsigned n = 0; n < rx_idle.pauses; n++) {
+    rte_pause();
+  }
+  if (rx_idle.pauses < IDLE_MAX_PAUSES) {
+    rx_idle.pauses *= 2;
+  }
+}
+#elif defined(NFOS)
+// No interrupts in the NFOS, always busy-poll
+static void rx_idle_init(uint16_t queue, bool has_queues) {}
+static void rx_idle_wait(unsigned received, vigor_time_t now, uint16_t queue) {}
+#endif // !KLEE_VERIFICATION && !NFOS
+
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+// Size of the rings through which cores get packets from the dispatcher or
+// each other, and of the bursts they take from them
+static const unsigned CORE_RING_SIZE = 512;
+#  define CORE_BURST_SIZE 32
+
+// Packets steered to each core, indexed by nf_core_index
+static struct rte_ring* core_rings[RTE_MAX_LCORE];
+
+// Set by the cores in nf_init while the dispatcher may already be running,
+// hence the atomic accesses
+static nf_steer_fn steer_packet = NULL;
+
+// Cores initialize their copy of the NF one at a time, since NFs are written
+// for a single thread and e.g. rte_flow is not thread-safe
+static rte_spinlock_t init_lock = RTE_SPINLOCK_INITIALIZER;
+
+void nf_set_steering(nf_steer_fn steer) {
+  // Release: whatever nf_init set up for steer is visible to its callers
+  __atomic_store_n(&steer_packet, steer, __ATOMIC_RELEASE);
+}
+
+static nf_steer_fn get_steering(void) {
+  return __atomic_load_n(&steer_packet, __ATOMIC_ACQUIRE);
+}
+
+// Sends the packets of the given protocol whose destination port matches
+// port under mask to the given queue; both are the raw field values.
+// Returns NULL if the device cannot.
+static struct rte_flow* steer_dst_port_block(uint16_t device, bool tcp,
+                                             uint16_t port, uint16_t mask,
+                                             uint16_t queue) {
+  struct rte_flow_item_tcp tcp_spec = { .hdr.dst_port = port };
+  struct rte_flow_item_tcp tcp_mask = { .hdr.dst_port = mask };
+  struct rte_flow_item_udp udp_spec = { .hdr.dst_port = port };
+  struct rte_flow_item_udp udp_mask = { .hdr.dst_port = mask };
+
+  struct rte_flow_attr attr = { .ingress = 1 };
+  struct rte_flow_item pattern[] = {
+    { .type = RTE_FLOW_ITEM_TYPE_ETH },
+    { .type = RTE_FLOW_ITEM_TYPE_IPV4 },
+    tcp ? (struct rte_flow_item){ .type = RTE_FLOW_ITEM_TYPE_TCP,
+                                  .spec = &tcp_spec, .mask = &tcp_mask }
+        : (struct rte_flow_item){ .type = RTE_FLOW_ITEM_TYPE_UDP,
+                                  .spec = &udp_spec, .mask = &udp_mask },
+    { .type = RTE_FLOW_ITEM_TYPE_END },
+  };
+  struct rte_flow_action_queue action_queue = { .index = queue };
+  struct rte_flow_action actions[] = {
+    { .type = RTE_FLOW_ACTION_TYPE_QUEUE, .conf = &action_queue },
+    { .type = RTE_FLOW_ACTION_TYPE_END },
+  };
+
+  struct rte_flow_error error;
+  struct rte_flow* flow =
+      rte_flow_create(device, &attr, pattern, actions, &error);
+  if (flow == NULL) {
+    NF_INFO("Device %" PRIu16 " cannot steer ports to queues: %s", device,
+            error.message == NULL ? "unknown error" : error.message);
+  }
+  return flow;
+}
+
+// A port range is covered by at most 2 blocks per bit, see
+// nf_steer_dst_ports, and each block needs a TCP and a UDP rule
+#  define STEER_MAX_RULES (2 * 16 * 2)
+
+bool nf_steer_dst_ports(uint16_t device, uint16_t first_port,
+                        uint32_t port_count, unsigned core) {
+  struct rte_flow* rules[STEER_MAX_RULES];
+  unsigned rule_count = 0;
+
+  // Flow rules match ports under a mask, so cover the range with the
+  // largest aligned power-of-2 blocks, as with prefixes
+  uint32_t port = first_port;
+  uint32_t end = first_port + port_count;
+  while (port < end) {
+    uint32_t block = port == 0 ? 65536 : (port & -port);
+    while (port + block > end) {
+      block >>= 1;
+    }
+    uint16_t mask = (uint16_t)~(block - 1);
+    for (int tcp = 1; tcp >= 0; tcp--) {
+      struct rte_flow* rule =
+          steer_dst_port_block(device, tcp, port, mask, core);
+      if (rule == NULL) {
+        // Remove this core's rules, so that none of its ports are half
+        // steered in hardware; rte_flow_flush would also remove those of
+        // the cores that succeeded
+        for (unsigned n = 0; n < rule_count; n++) {
+          struct rte_flow_error error;
+          rte_flow_destroy(device, rules[n], &error);
+        }
+        return false;
+      }
+      rules[rule_count++] = rule;
+    }
+    port += block;
+  }
+  return true;
+}
+
+// Hash of the canonicalized 5-tuple of a packet, i.e. with the endpoints
+// sorted so that both directions of a flow get the same one
+static uint32_t flow_hash(uint8_t* buffer, uint16_t packet_length) {
+  struct rte_ether_hdr* rte_ether_header = (struct rte_ether_hdr*)buffer;
+  if (packet_length < sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) ||
+      !nf_has_rte_ipv4_header(rte_ether_header)) {
+    return 0;
+  }
+  struct rte_ipv4_hdr* rte_ipv4_header =
+      (struct rte_ipv4_hdr*)(rte_ether_header + 1);
+
+  uint32_t addr_a = rte_ipv4_header->src_addr;
+  uint32_t addr_b = rte_ipv4_header->dst_addr;
+  uint16_t port_a = 0;
+  uint16_t port_b = 0;
+  size_t tcpudp_offset = sizeof(struct rte_ether_hdr) +
+                         (rte_ipv4_header->version_ihl & 0x0f) * WORD_SIZE;
+  if (nf_has_tcpudp_header(rte_ipv4_header) &&
+      packet_length >= tcpudp_offset + sizeof(struct tcpudp_hdr)) {
+    struct tcpudp_hdr* tcpudp_header =
+        (struct tcpudp_hdr*)(buffer + tcpudp_offset);
+    port_a = tcpudp_header->src_port;
+    port_b = tcpudp_header->dst_port;
+  }
+
+  if (addr_a > addr_b || (addr_a == addr_b && port_a > port_b)) {
+    uint32_t addr = addr_a;
+    addr_a = addr_b;
+    addr_b = addr;
+    uint16_t port = port_a;
+    port_a = port_b;
+    port_b = port;
+  }
+
+  uint32_t hash = rte_hash_crc_4byte(addr_a, rte_ipv4_header->next_proto_id);
+  hash = rte_hash_crc_4byte(addr_b, hash);
+  return rte_hash_crc_4byte(((uint32_t)port_a << 16) | port_b, hash);
+}
+
+// Loop of the main lcore with software dispatch: it only receives packets,
+// and gives each to the core that owns its flow
+static void dispatcher_loop(void) {
+  unsigned nb_cores = nf_core_count();
+  NF_INFO("Core %u dispatching packets to %u cores.", rte_lcore_id(),
+          nb_cores);
+
+  rx_idle_init(0, true);
+  while (1) {
+    unsigned received = 0;
+    uint16_t nb_devices = rte_eth_dev_count_avail();
+    for (uint16_t device = 0; device < nb_devices; device++) {
+      struct rte_mbuf* mbufs[CORE_BURST_SIZE];
+      uint16_t rx_count = rte_eth_rx_burst(device, 0, mbufs, CORE_BURST_SIZE);
+      received += rx_count;
+      nf_telemetry_add(NF_COUNTER_RX, rx_count);
+      nf_steer_fn steer = get_steering();
+      for (uint16_t n = 0; n < rx_count; n++) {
+        uint8_t* data = rte_pktmbuf_mtod(mbufs[n], uint8_t*);
+        uint16_t length = rte_pktmbuf_data_len(mbufs[n]);
+        int owner = steer == NULL ? -1 : steer(device, data, length);
+        unsigned core = owner >= 0 ?
+                        (unsigned)owner :
+                        (unsigned)(((uint64_t)flow_hash(data, length) *
+                                    nb_cores) >> 32);
+        if (rte_ring_enqueue(core_rings[core], mbufs[n]) != 0) {
+          nf_telemetry_add(NF_COUNTER_DROP_RING, 1);
+          rte_pktmbuf_free(mbufs[n]);
+        }
+      }
+    }
+    rx_idle_wait(received, current_time(), 0);
+  }
+}
+
+// Loop of each core when there are several, which also takes the packets
+// the dispatcher or other cores steered to it
+static void worker_loop_multicore(void) {
+  unsigned core = nf_core_index();
+  struct rte_ring* own_ring = core_rings[core];
+
+  rx_idle_init(core, !software_dispatch);
+  while (1) {
+    unsigned received = 0;
+    vigor_time_t now = current_time();
+    uint16_t nb_devices = rte_eth_dev_count_avail();
+    // With software dispatch, packets only come from the ring
+    uint16_t rx_devices = software_dispatch ? 0 : nb_devices;
+    for (uint16_t device = 0; device < rx_devices; device++) {
+      struct rte_mbuf* mbufs[CORE_BURST_SIZE];
+      uint16_t rx_count =
+          rte_eth_rx_burst(device, core, mbufs, CORE_BURST_SIZE);
+      received += rx_count;
+      nf_telemetry_add(NF_COUNTER_RX, rx_count);
+
+      // The packets that stay on this core, in their order
+      uint16_t kept = 0;
+      nf_steer_fn steer = get_steering();
+      for (uint16_t n = 0; n < rx_count; n++) {
+        if (steer != NULL) {
+          int owner = steer(device, rte_pktmbuf_mtod(mbufs[n], uint8_t*),
+                            rte_pktmbuf_data_len(mbufs[n]));
+          if (owner >= 0 && (unsigned)owner != core) {
+            if (rte_ring_enqueue(core_rings[owner], mbufs[n]) != 0) {
+              nf_telemetry_add(NF_COUNTER_DROP_RING, 1);
+              rte_pktmbuf_free(mbufs[n]);
+            }
+            continue;
+          }
+        }
+
+        mbufs[kept++] = mbufs[n];
+      }
+      process_burst(mbufs, kept, core, now, nb_devices);
+    }
+
+    struct rte_mbuf* mbufs[CORE_BURST_SIZE];
+    unsigned count = rte_ring_dequeue_burst(own_ring, (void**)mbufs,
+                                            CORE_BURST_SIZE, NULL);
+    process_burst(mbufs, count, core, now, nb_devices);
+    tx_batches_flush(nb_devices, core);
+    rx_idle_wait(received + count, now, core);
+  }
+}
+#endif // MULTICORE
+
+// Options of nf.c itself, which the NFs never see:
+//   --rx-queue-size <n>, --tx-queue-size <n>: descriptors per queue
+//   --mempool-size <n>: buffers per device, default: enough for all queues
+//   --mempool-cache-size <n>: buffers each core caches from each mempool
+//   --idle-timeout <us>: idle time before sleeping until an RX interrupt,
+//                        default: 0, i.e. always busy-poll
+//   --idle-max-sleep <ms>: longest such sleep
+static void nf_io_config_init(int* argc, char** argv) {
+  struct {
+    const char* name;
+    unsigned* value;
+    unsigned max;
+  } options[] = {
+    { "--rx-queue-size", &rx_queue_size, UINT16_MAX },
+    { "--tx-queue-size", &tx_queue_size, UINT16_MAX },
+    { "--mempool-size", &mempool_buffer_count, UINT32_MAX },
+    { "--mempool-cache-size", &mempool_cache_size, RTE_MEMPOOL_CACHE_MAX_SIZE },
+    { "--idle-timeout", &idle_timeout, UINT32_MAX / 1000 },
+    { "--idle-max-sleep", &idle_max_sleep, INT32_MAX },
+  };
+  unsigned options_count = sizeof(options) / sizeof(options[0]);
+
+  int kept = 1;
+  for (int arg = 1; arg < *argc; arg++) {
+    unsigned option = 0;
+    while (option < options_count &&
+           strcmp(argv[arg], options[option].name) != 0) {
+      option++;
+    }
+    if (option == options_count) {
+      argv[kept++] = argv[arg];
+      continue;
+    }
+
+    if (arg + 1 == *argc) {
+      rte_exit(EXIT_FAILURE, "Missing value for %s\n", argv[arg]);
+    }
+    arg++;
+    uintmax_t value = nf_util_parse_int(argv[arg], options[option].name + 2,
+                                        10, '\0');
+    if (value > options[option].max) {
+      rte_exit(EXIT_FAILURE, "%s must be at most %u\n", options[option].name,
+               options[option].max);
+    }
+    *options[option].value = value;
+  }
+  *argc = kept;
+
+  if (rx_queue_size == 0 || tx_queue_size == 0) {
+    rte_exit(EXIT_FAILURE, "Queue sizes must be strictly positive\n");
+  }
+
+  NF_INFO("RX queue size: %u, TX queue size: %u", rx_queue_size,
+          tx_queue_size);
+  NF_INFO("Mempool size: %u%s, cache size: %u", mempool_buffer_count,
+          mempool_buffer_count == 0 ? " (auto)" : "", mempool_cache_size);
+  NF_INFO("Idle timeout: %uus, max sleep: %ums", idle_timeout, idle_max_sleep);
+}
+
+// Enough buffers for the device's RX queues, for every TX queue its packets
+// may wait in, for what the cores cache and for some in flight
+static unsigned mempool_size(unsigned nb_devices) {
+  if (mempool_buffer_count != 0) {
+    return mempool_buffer_count;
+  }
+  unsigned nb_cores = nf_core_count();
+  unsigned size = rx_queue_count() * rx_queue_size +
+                  nb_devices * nb_cores * tx_queue_size +
+                  nb_cores * mempool_cache_size + MEMPOOL_BUFFER_COUNT;
+#ifndef KLEE_VERIFICATION
+  // Packets waiting in the TX batches of the cores
+  size += nb_cores * nb_devices * TX_BATCH_SIZE;
+#endif // KLEE_VERIFICATION
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+  // Packets waiting in the rings of the cores
+  size += nb_cores * CORE_RING_SIZE;
+#endif // MULTICORE
+  return size;
+}
+
+// Creates the mempool of the given device, on its socket
+static struct rte_mempool* nf_create_mempool(uint16_t device,
+                                             unsigned nb_devices) {
+  unsigned size = mempool_size(nb_devices);
+  // DPDK refuses caches larger than 2/3 of the pool
+  unsigned cache_size = mempool_cache_size;
+  if (cache_size > size * 2 / 3) {
+    cache_size = size * 2 / 3;
+  }
+
+  int socket = rte_eth_dev_socket_id(device);
+  char name[RTE_MEMPOOL_NAMESIZE];
+  snprintf(name, sizeof(name), "MEMPOOL_%" PRIu16, device);
+  struct rte_mempool *mbuf_pool = rte_pktmbuf_pool_create(
+      name, // name
+      size, // #elements
+      cache_size, // cache size, per core
+      0, // application private area size
+      RTE_MBUF_DEFAULT_BUF_SIZE, // data buffer size
+      socket < 0 ? (int)rte_socket_id() : socket // socket ID
+  );
+  if (mbuf_pool == NULL) {
+    rte_exit(EXIT_FAILURE, "Cannot create pool: %s\n", rte_strerror(rte_errno));
+  }
+  return mbuf_pool;
+}
+
+// Main worker method, run by every core
+static int worker_main(void* unused) {
+  (void)unused;
+
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+  if (software_dispatch && rte_lcore_id() == rte_get_master_lcore()) {
+    // The block after those of the cores, see MAIN
+    nf_telemetry_core_init(nf_core_count());
+    dispatcher_loop();
+    return 0;
+  }
+
+  nf_telemetry_core_init(nf_core_index());
+  rte_spinlock_lock(&init_lock);
+  bool initialized = nf_init();
+  rte_spinlock_unlock(&init_lock);
+  if (!initialized) {
+    rte_exit(EXIT_FAILURE, "Error initializing NF");
+  }
+#else // MULTICORE
+  nf_telemetry_core_init(0);
   if (!nf_init()) {
     rte_exit(EXIT_FAILURE, "Error initializing NF");
   }
+#endif // MULTICORE
 
   NF_INFO("Core %u forwarding packets.", rte_lcore_id());
 
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+  if (nf_core_count() > 1) {
+    NF_INFO("Running on %u cores, this code is unverified!", nf_core_count());
+    worker_loop_multicore();
+  }
+#endif // MULTICORE
+
 #if VIGOR_BATCH_SIZE == 1
   VIGOR_LOOP_BEGIN
     struct rte_mbuf* mbuf;
     if (rte_eth_rx_burst(VIGOR_DEVICE, 0, &mbuf, 1) != 0) {
+      VIGOR_LOOP_RECEIVED();
+      nf_telemetry_add(NF_COUNTER_RX, 1);
       uint8_t* data = rte_pktmbuf_mtod(mbuf, uint8_t*);
       packet_state_total_length(data, &(mbuf->pkt_len));
+      uint64_t start = nf_profile_start();
       uint16_t dst_device = nf_process(mbuf->port, data, mbuf->pkt_len, VIGOR_NOW);
+      nf_profile_end(NF_STAGE_TOTAL, start);
       nf_return_all_chunks(data);
 
       if (dst_device == VIGOR_DEVICE) {
+        nf_telemetry_add(NF_COUNTER_DROP_NF, 1);
         rte_pktmbuf_free(mbuf);
       } else if (dst_device == FLOOD_FRAME) {
-        flood(mbuf, VIGOR_DEVICES_COUNT);
+        nf_telemetry_add(NF_COUNTER_FLOODED, 1);
+        flood(mbuf, VIGOR_DEVICES_COUNT, 0);
       } else {
         // ensure we don't leak symbols into DPDK
         concretize_devices(&dst_device, rte_eth_dev_count_avail());
-        if (rte_eth_tx_burst(dst_device, 0, &mbuf, 1) != 1) {
+        start = nf_profile_start();
+        uint16_t sent = rte_eth_tx_burst(dst_device, 0, &mbuf, 1);
+        nf_profile_end(NF_STAGE_TX, start);
+        if (sent == 1) {
+          nf_telemetry_add(NF_COUNTER_TX, 1);
+        } else {
 #ifdef VIGOR_ALLOW_DROPS
+          nf_telemetry_add(NF_COUNTER_DROP_TX, 1);
           rte_pktmbuf_free(mbuf); // OK, we're debugging
 #else
           printf("We assume the hardware will allways accept a packet to transmit.\n");
@@ -172,47 +981,27 @@ static void worker_main(void) {
 #endif
         }
       }
+      nf_profile_packet_done();
     }
   VIGOR_LOOP_END
 
 #else // if VIGOR_BATCH_SIZE != 1
 
-  if (rte_eth_dev_count_avail() != 2) {
-    printf("We assume there will be exactly 2 devices for our simple batching implementation.");
-    exit(1);
-  }
   NF_INFO("Running with batches, this code is unverified!");
 
   while(1) {
-    unsigned VIGOR_DEVICES_COUNT = rte_eth_dev_count_avail();
-    for (uint16_t VIGOR_DEVICE = 0; VIGOR_DEVICE < VIGOR_DEVICES_COUNT; VIGOR_DEVICE++) {
+    uint16_t nb_devices = rte_eth_dev_count_avail();
+    for (uint16_t device = 0; device < nb_devices; device++) {
       struct rte_mbuf* mbufs[VIGOR_BATCH_SIZE];
-      uint16_t rx_count = rte_eth_rx_burst(VIGOR_DEVICE, 0, mbufs, VIGOR_BATCH_SIZE);
-
-      struct rte_mbuf *mbufs_to_send[VIGOR_BATCH_SIZE];
-      uint16_t tx_count = 0;
-      for (uint16_t n = 0; n < rx_count; n++) {
-        uint8_t* data = rte_pktmbuf_mtod(mbufs[n], uint8_t*);
-        packet_state_total_length(data, &(mbufs[n]->pkt_len));
-        vigor_time_t VIGOR_NOW = current_time();
-        uint16_t dst_device = nf_process(mbufs[n]->port, data, mbufs[n]->pkt_len, VIGOR_NOW);
-        nf_return_all_chunks(data);
-
-        if (dst_device == VIGOR_DEVICE) {
-          rte_pktmbuf_free(mbufs[n]);
-        } else { // includes flood when 2 devices, which is equivalent to just a send
-          mbufs_to_send[tx_count] = mbufs[n];
-          tx_count++;
-       }
-     }
-
-      uint16_t sent_count = rte_eth_tx_burst(1 - VIGOR_DEVICE, 0, mbufs_to_send, tx_count);
-      for (uint16_t n = sent_count; n < tx_count; n++) {
-        rte_pktmbuf_free(mbufs[n]); // should not happen, but we're in the unverified case anyway
-      }
+      uint16_t rx_count = rte_eth_rx_burst(device, 0, mbufs, VIGOR_BATCH_SIZE);
+      nf_telemetry_add(NF_COUNTER_RX, rx_count);
+      process_burst(mbufs, rx_count, 0, current_time(), nb_devices);
     }
+    tx_batches_flush(nb_devices, 0);
   }
 #endif
+
+  return 0;
 }
 
 
@@ -226,26 +1015,34 @@ int MAIN(int argc, char** argv) {
   argc -= ret;
   argv += ret;
 
-  // NF-specific config
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+  choose_dispatch();
+#elif !defined(KLEE_VERIFICATION) && !defined(NFOS)
+  // The other lcores would sit idle, see NF_MULTICORE in Makefile.dpdk
+  if (rte_lcore_count() > 1) {
+    rte_exit(EXIT_FAILURE, "This NF only runs on a single core\n");
+  }
+#endif // MULTICORE
+
+#if VIGOR_BATCH_SIZE != 1
+  if (nf_core_count() != 1) {
+    rte_exit(EXIT_FAILURE, "Batching only supports a single core\n");
+  }
+#endif
+
+  // Config of nf.c itself, then NF-specific config
+  nf_io_config_init(&argc, argv);
   nf_config_init(argc, argv);
   nf_config_print();
 
-  // Create a memory pool
-  unsigned nb_devices = rte_eth_dev_count_avail();
-  struct rte_mempool *mbuf_pool = rte_pktmbuf_pool_create(
-      "MEMPOOL", // name
-      MEMPOOL_BUFFER_COUNT * nb_devices, // #elements
-      0, // cache size (per-core, not useful in a single-threaded app)
-      0, // application private area size
-      RTE_MBUF_DEFAULT_BUF_SIZE, // data buffer size
-      rte_socket_id()            // socket ID
-  );
-  if (mbuf_pool == NULL) {
-    rte_exit(EXIT_FAILURE, "Cannot create pool: %s\n", rte_strerror(rte_errno));
-  }
+  // One block of counters per core, plus one for the dispatcher
+  nf_telemetry_init(nf_core_count() + 1);
+  nf_profile_init();
 
-  // Initialize all devices
+  // Initialize all devices, each with its own memory pool
+  unsigned nb_devices = rte_eth_dev_count_avail();
   for (uint16_t device = 0; device < nb_devices; device++) {
+    struct rte_mempool *mbuf_pool = nf_create_mempool(device, nb_devices);
     ret = nf_init_device(device, mbuf_pool);
     if (ret == 0) {
       NF_INFO("Initialized device %" PRIu16 ".", device);
@@ -254,8 +1051,26 @@ int MAIN(int argc, char** argv) {
     }
   }
 
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+  unsigned nb_cores = nf_core_count();
+  for (unsigned core = 0; core < nb_cores; core++) {
+    char name[RTE_RING_NAMESIZE];
+    snprintf(name, sizeof(name), "CORE_RING_%u", core);
+    core_rings[core] = rte_ring_create(name, CORE_RING_SIZE, rte_socket_id(),
+                                       RING_F_SC_DEQ);
+    if (core_rings[core] == NULL) {
+      rte_exit(EXIT_FAILURE, "Cannot create ring: %s\n",
+               rte_strerror(rte_errno));
+    }
+  }
+
+  // Run!
+  rte_eal_mp_remote_launch(worker_main, NULL, CALL_MASTER);
+  rte_eal_mp_wait_lcore();
+#else // MULTICORE
   // Run!
-  worker_main();
+  worker_main(NULL);
+#endif // MULTICORE
 
   return 0;
 }
@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "libvig/verified/boilerplate-util.h"
 #include "libvig/verified/vigor-time.h"
 
 #define FLOOD_FRAME ((uint16_t) -1)
@@ -19,4 +20,51 @@ void nf_config_print(void);
 
 #ifdef KLEE_VERIFICATION
 void nf_loop_iteration_border(unsigned lcore_id, vigor_time_t time);
+#else
+// Restricts the flood of the packet being processed to the given devices,
+// bit i standing for device i, if nf_process returns FLOOD_FRAME; the device
+// the packet came from is still skipped. Unverified, e.g. for VLANs.
+void nf_set_flood_devices(uint64_t devices);
+
+// Has the given function called with each burst of packets that the burst
+// loops (see VIGOR_BATCH_SIZE and MULTICORE in nf.c) are about to process,
+// before nf_process is called on each of them in the same order, e.g. so that
+// the NF hashes the keys of the whole burst at once. The single-packet loop
+// never calls it. Unverified; each core sets its own, e.g. in nf_init.
+typedef void (*nf_burst_fn)(uint16_t* devices, uint8_t** buffers,
+                            uint16_t* packet_lengths, uint16_t count);
+void nf_set_burst_hook(nf_burst_fn hook);
+#endif
+
+// Unverified multi-core support, for NFs built with NF_MULTICORE := true (see
+// Makefile.dpdk), the others refuse more than one lcore: every EAL lcore runs
+// its own copy of the NF, i.e. calls nf_init and then nf_process on its own
+// RX/TX queue of each device, with RSS spreading the flows over the queues.
+// Nothing is shared, so the NF's globals must be declared PER_CORE (see
+// boilerplate-util.h), and the NF must make sure that the packets that share
+// state reach the same core, e.g. with a steering function.
+// Verification and NFOS only ever see a single core.
+
+// Number of cores running the NF, and the index in [0, count) of the calling
+// one, which is also the index of the queues it uses
+unsigned nf_core_count(void);
+unsigned nf_core_index(void);
+
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+// Packets that RSS cannot place, e.g. replies whose flow is only known by the
+// core that allocated the external port, are given to the core returned by
+// the steering function, or handled where they arrived if it returns -1.
+// The function only gets to read the packet, before nf_process.
+typedef int (*nf_steer_fn)(uint16_t device, uint8_t* buffer,
+                           uint16_t packet_length);
+void nf_set_steering(nf_steer_fn steer);
+
+// Asks the device to deliver the TCP and UDP packets whose destination port
+// is in [first_port, first_port + port_count) to the queue of the given core,
+// so that they need not go through the steering function. Ports are the raw
+// values of tcpudp_hdr.dst_port, without byte order conversion, which is how
+// vignat stores its external ports. Returns false if the device does not
+// support it.
+bool nf_steer_dst_ports(uint16_t device, uint16_t first_port,
+                        uint32_t port_count, unsigned core);
 #endif
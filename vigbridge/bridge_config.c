@@ -19,21 +19,43 @@ const uint32_t DEFAULT_CAPACITY = 128;       // MAC addresses
   fprintf(stderr, format, ##__VA_ARGS__); \
   exit(EXIT_FAILURE);
 
+// Parses "<vid>:<device>[,<device>...]" into the VLAN's member ports
+static void parse_vlan(const char *str, unsigned nb_devices) {
+  char *end;
+  long vid = strtol(str, &end, 10);
+  if (end == str || *end != ':' || vid < 0 || vid >= VLAN_COUNT - 1) {
+    PARSE_ERROR("Invalid VLAN: %s\n", str);
+  }
+
+  do {
+    const char *device_str = end + 1;
+    long device = strtol(device_str, &end, 10);
+    if (end == device_str || (*end != ',' && *end != '\0') || device < 0 ||
+        device >= nb_devices) {
+      PARSE_ERROR("Invalid VLAN member port: %s\n", str);
+    }
+    config.vlan_ports[vid] |= 1ull << device;
+  } while (*end == ',');
+}
+
 void nf_config_init(int argc, char **argv) {
   // Set the default values
   config.expiration_time = DEFAULT_EXP_TIME; // seconds
   config.dyn_capacity = DEFAULT_CAPACITY;    // MAC addresses
   config.static_config_fname[0] = '\0'; // no static filtering configuration
+  config.vlan_aware = false;
+  memset(config.vlan_ports, 0, sizeof(config.vlan_ports));
 
   unsigned nb_devices = rte_eth_dev_count_avail();
 
   struct option long_options[] = { { "expire", required_argument, NULL, 't' },
                                    { "capacity", required_argument, NULL, 'c' },
                                    { "config", required_argument, NULL, 'f' },
+                                   { "vlan", required_argument, NULL, 'v' },
                                    { NULL, 0, NULL, 0 } };
 
   int opt;
-  while ((opt = getopt_long(argc, argv, "t:c:f:", long_options, NULL)) != EOF) {
+  while ((opt = getopt_long(argc, argv, "t:c:f:v:", long_options, NULL)) != EOF) {
     unsigned device;
     switch (opt) {
       case 't':
@@ -56,11 +78,26 @@ void nf_config_init(int argc, char **argv) {
         config.static_config_fname[CONFIG_FNAME_LEN - 1] = '\0';
         break;
 
+      case 'v':
+        // Member ports are 64-bit masks, see nf_set_flood_devices
+        if (nb_devices > 64) {
+          PARSE_ERROR("VLANs support at most 64 devices.\n");
+        }
+        parse_vlan(optarg, nb_devices);
+        config.vlan_aware = true;
+        break;
+
       default:
         PARSE_ERROR("Unknown option %c", opt);
     }
   }
 
+  // Untagged frames belong to VLAN 0, on all ports unless configured
+  if (config.vlan_aware && config.vlan_ports[0] == 0) {
+    config.vlan_ports[0] = nb_devices == 64 ? UINT64_MAX
+                                            : (1ull << nb_devices) - 1;
+  }
+
   // Reset getopt
   optind = 1;
 }
@@ -72,7 +109,9 @@ void nf_config_usage(void) {
           ".\n"
           "\t--capacity <n>: dynamic mac learning table capacity,"
           " default: %" PRIu32 ".\n"
-          "\t--config <fname>: static filtering table configuration file.\n",
+          "\t--config <fname>: static filtering table configuration file.\n"
+          "\t--vlan <vid>:<device>[,<device>...]: member ports of a VLAN,"
+          " repeatable; makes the bridge VLAN-aware.\n",
           DEFAULT_EXP_TIME, DEFAULT_CAPACITY);
 }
 
@@ -82,6 +121,14 @@ void nf_config_print(void) {
   NF_INFO("Expiration time: %" PRIu32 "us", config.expiration_time);
   NF_INFO("Capacity: %" PRIu16, config.dyn_capacity);
   NF_INFO("Static configuration file: %s", config.static_config_fname);
+  NF_INFO("VLAN-aware: %s", config.vlan_aware ? "yes" : "no");
+  if (config.vlan_aware) {
+    for (unsigned vid = 0; vid < VLAN_COUNT; ++vid) {
+      if (config.vlan_ports[vid] != 0) {
+        NF_INFO("VLAN %u ports: 0x%" PRIx64, vid, config.vlan_ports[vid]);
+      }
+    }
+  }
 
   NF_INFO("\n--- ------ ------ ---\n");
 }
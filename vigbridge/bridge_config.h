@@ -1,10 +1,14 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include "libvig/verified/vigor-time.h"
 
 #define CONFIG_FNAME_LEN 512
 
+// 802.1Q VIDs are 12 bits
+#define VLAN_COUNT 4096
+
 struct nf_config {
   // Expiration time of flows, in microseconds
   uint32_t expiration_time;
@@ -14,4 +18,10 @@ struct nf_config {
 
   // The static configuration file name
   char static_config_fname[CONFIG_FNAME_LEN];
+
+  // Whether any --vlan was given, see bridge_vlan.h
+  bool vlan_aware;
+
+  // Member ports of each VLAN, bit i standing for device i
+  uint64_t vlan_ports[VLAN_COUNT];
 };
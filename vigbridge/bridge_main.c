@@ -4,9 +4,13 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <rte_common.h>
 #include <rte_ethdev.h>
 
@@ -20,20 +24,27 @@
 #include "nf-util.h"
 #include "nf-log.h"
 #include "nf-parse.h"
+#include "nf-profile.h"
+#include "nf-telemetry.h"
 #include "bridge_config.h"
+#include "bridge_vlan.h"
 #include "state.h"
 
 struct nf_config config;
 
-struct State *mac_tables;
+PER_CORE struct State *mac_tables;
 
 int bridge_expire_entries(vigor_time_t time) {
   assert(time >= 0); // we don't support the past
   assert(sizeof(vigor_time_t) <= sizeof(uint64_t));
   uint64_t time_u = (uint64_t)time; // OK because of the two asserts
   vigor_time_t last_time = time_u - config.expiration_time * 1000; // us to ns
-  return expire_items_single_map(mac_tables->dyn_heap, mac_tables->dyn_keys,
-                                 mac_tables->dyn_map, last_time);
+  int expired = expire_items_single_map(mac_tables->dyn_heap,
+                                        mac_tables->dyn_keys,
+                                        mac_tables->dyn_map, last_time);
+  nf_telemetry_add(NF_COUNTER_EXPIRED, expired);
+  nf_telemetry_set(NF_COUNTER_FLOWS, map_size(mac_tables->dyn_map));
+  return expired;
 }
 
 int bridge_get_device(struct rte_ether_addr *dst, uint16_t src_device) {
@@ -41,7 +52,7 @@ int bridge_get_device(struct rte_ether_addr *dst, uint16_t src_device) {
   struct StaticKey k;
   memcpy(&k.addr, dst, sizeof(struct rte_ether_addr));
   k.device = src_device;
-  int present = map_get(mac_tables->st_map, &k, &device);
+  int present = StaticKey_map_get(mac_tables->st_map, &k, &device);
   if (present) {
     return device;
   }
@@ -50,7 +61,7 @@ int bridge_get_device(struct rte_ether_addr *dst, uint16_t src_device) {
 #endif                            // KLEE_VERIFICATION
 
   int index = -1;
-  present = map_get(mac_tables->dyn_map, dst, &index);
+  present = rte_ether_addr_map_get(mac_tables->dyn_map, dst, &index);
   if (present) {
     struct DynamicValue *value = 0;
     vector_borrow(mac_tables->dyn_vals, index, (void **)&value);
@@ -65,7 +76,7 @@ void bridge_put_update_entry(struct rte_ether_addr *src, uint16_t src_device,
                              vigor_time_t time) {
   int index = -1;
   int hash = rte_ether_addr_hash(src);
-  int present = map_get(mac_tables->dyn_map, src, &index);
+  int present = rte_ether_addr_map_get(mac_tables->dyn_map, src, &index);
   if (present) {
     dchain_rejuvenate_index(mac_tables->dyn_heap, index, time);
   } else {
@@ -73,6 +84,7 @@ void bridge_put_update_entry(struct rte_ether_addr *src, uint16_t src_device,
         dchain_allocate_new_index(mac_tables->dyn_heap, &index, time);
     if (!allocated) {
       NF_INFO("No more space in the dynamic table");
+      nf_telemetry_add(NF_COUNTER_ALLOC_FAILED, 1);
       return;
     }
     struct rte_ether_addr *key = 0;
@@ -81,7 +93,7 @@ void bridge_put_update_entry(struct rte_ether_addr *src, uint16_t src_device,
     vector_borrow(mac_tables->dyn_vals, index, (void **)&value);
     memcpy(key, src, sizeof(struct rte_ether_addr));
     value->device = src_device;
-    map_put(mac_tables->dyn_map, key, index);
+    rte_ether_addr_map_put(mac_tables->dyn_map, key, index);
     // the other half of the key is in the map
     vector_return(mac_tables->dyn_keys, index, key);
     vector_return(mac_tables->dyn_vals, index, value);
@@ -90,6 +102,10 @@ void bridge_put_update_entry(struct rte_ether_addr *src, uint16_t src_device,
 
 // File parsing, is not really the kind of code we want to verify.
 #ifdef KLEE_VERIFICATION
+static unsigned static_ft_capacity(void) {
+  return 8192; // Has to be power of 2
+}
+
 void read_static_ft_from_file(struct Map *stat_map, struct Vector *stat_keys,
                               uint32_t stat_capacity) {}
 
@@ -99,36 +115,157 @@ static void read_static_ft_from_array(struct Map *stat_map,
 
 #else // KLEE_VERIFICATION
 
+// Most static rules a file may hold, so that the table capacity fits in an
+// unsigned with room to spare
+#  define STATIC_FT_MAX_RULES (1u << 24)
+
+// Smallest power of 2 that keeps the hash table occupied by less than 50%.
+// CAPACITY_UPPER_LIMIT only bounds the proofs, like --capacity it is not
+// enforced here, but going beyond it is worth a warning.
+static unsigned capacity_for_rules(unsigned number_of_rules) {
+  if (number_of_rules > STATIC_FT_MAX_RULES) {
+    rte_exit(EXIT_FAILURE, "Too many static rules, at most %u: %s",
+             STATIC_FT_MAX_RULES, config.static_config_fname);
+  }
+
+  uint64_t capacity = 1;
+  while (capacity <= (uint64_t)number_of_rules * 2) {
+    capacity *= 2;
+  }
+  if (capacity >= CAPACITY_UPPER_LIMIT) {
+    NF_INFO("The static table capacity, %" PRIu64 ", is beyond the %u "
+            "entries the map proofs cover",
+            capacity, CAPACITY_UPPER_LIMIT);
+  }
+  return (unsigned)capacity;
+}
+
 #  ifndef NFOS
-static void read_static_ft_from_file(struct Map *stat_map,
-                                     struct Vector *stat_keys,
-                                     uint32_t stat_capacity) {
+// Binary static tables, compiled from text ones by compile-static-table.py:
+// a header, then entry_count entries, in host byte order. They are mmap-ed
+// and inserted as they are, with no parsing.
+#    define STATIC_FT_MAGIC "VIGBRST1"
+
+struct static_ft_header {
+  char magic[8];
+  uint32_t entry_count;
+  uint32_t entry_size;
+};
+
+struct static_ft_entry {
+  struct rte_ether_addr addr;
+  uint16_t device_from;
+  // -2 filters the frames out, see nf_process
+  int16_t device_to;
+};
+
+static_assert(sizeof(struct static_ft_header) == 16,
+              "compile-static-table.py writes 16-byte headers");
+static_assert(sizeof(struct static_ft_entry) == 10,
+              "compile-static-table.py writes 10-byte entries");
+
+// The static configuration file, opened by static_ft_capacity so that the
+// table can be sized from it: either mapped, if it is a binary one, or
+// ready to be parsed
+static const struct static_ft_header *static_ft_binary;
+static size_t static_ft_binary_size;
+static FILE *static_ft_text;
+static unsigned static_ft_rules;
+
+static bool map_binary_static_ft(int fd) {
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      file_stat.st_size < (off_t)sizeof(struct static_ft_header)) {
+    return false;
+  }
+
+  size_t size = file_stat.st_size;
+  const struct static_ft_header *header =
+      mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  if (header == MAP_FAILED) {
+    return false;
+  }
+  if (memcmp(header->magic, STATIC_FT_MAGIC, sizeof(header->magic)) != 0) {
+    munmap((void *)header, size);
+    return false;
+  }
+
+  if (header->entry_count > STATIC_FT_MAX_RULES) {
+    rte_exit(EXIT_FAILURE, "Too many static rules, at most %u: %s",
+             STATIC_FT_MAX_RULES, config.static_config_fname);
+  }
+  if (header->entry_size != sizeof(struct static_ft_entry) ||
+      size != sizeof(struct static_ft_header) +
+                  (size_t)header->entry_count * sizeof(struct static_ft_entry)) {
+    rte_exit(EXIT_FAILURE, "Corrupted binary static config file: %s",
+             config.static_config_fname);
+  }
+
+  static_ft_binary = header;
+  static_ft_binary_size = size;
+  static_ft_rules = header->entry_count;
+  return true;
+}
+
+static unsigned static_ft_capacity(void) {
   if (config.static_config_fname[0] == '\0') {
     // No static config
-    return;
+    return capacity_for_rules(0);
   }
 
-  FILE *cfg_file = fopen(config.static_config_fname, "r");
-  if (cfg_file == NULL) {
+  int fd = open(config.static_config_fname, O_RDONLY);
+  if (fd < 0) {
+    rte_exit(EXIT_FAILURE, "Error opening the static config file: %s",
+             config.static_config_fname);
+  }
+
+  if (map_binary_static_ft(fd)) {
+    // The mapping stays valid without the file descriptor
+    close(fd);
+    return capacity_for_rules(static_ft_rules);
+  }
+
+  static_ft_text = fdopen(fd, "r");
+  if (static_ft_text == NULL) {
     rte_exit(EXIT_FAILURE, "Error opening the static config file: %s",
              config.static_config_fname);
   }
 
   unsigned number_of_lines = 0;
-  char ch;
-  do {
-    ch = fgetc(cfg_file);
-    if (ch == '\n')
+  int ch;
+  while ((ch = fgetc(static_ft_text)) != EOF) {
+    if (ch == '\n') {
       number_of_lines++;
-  } while (ch != EOF);
+    }
+  }
+  rewind(static_ft_text);
 
-  // Make sure the hash table is occupied only by 50%
-  unsigned capacity = number_of_lines * 2;
-  rewind(cfg_file);
-  if (stat_capacity <= capacity) {
-    rte_exit(EXIT_FAILURE, "Too many static rules (%d), max: %d",
-             number_of_lines, stat_capacity / 2);
+  // The last line may lack a '\n'
+  static_ft_rules = number_of_lines + 1;
+  return capacity_for_rules(static_ft_rules);
+}
+
+static void read_static_ft_from_binary(struct Map *stat_map,
+                                       struct Vector *stat_keys) {
+  const struct static_ft_entry *entries =
+      (const struct static_ft_entry *)(static_ft_binary + 1);
+  for (unsigned i = 0; i < static_ft_rules; ++i) {
+    struct StaticKey *key = 0;
+    vector_borrow(stat_keys, i, (void **)&key);
+    key->addr = entries[i].addr;
+    key->device = entries[i].device_from;
+    StaticKey_map_put(stat_map, key, entries[i].device_to);
+    vector_return(stat_keys, i, key);
   }
+
+  munmap((void *)static_ft_binary, static_ft_binary_size);
+  static_ft_binary = NULL;
+  NF_INFO("Loaded %u static rules", static_ft_rules);
+}
+
+static void read_static_ft_from_text(struct Map *stat_map,
+                                     struct Vector *stat_keys) {
+  FILE *cfg_file = static_ft_text;
   int count = 0;
 
   while (1) {
@@ -176,8 +313,7 @@ static void read_static_ft_from_file(struct Map *stat_map,
     vector_borrow(stat_keys, count, (void **)&key);
 
     // Ouff... the strings are extracted, now let's parse them.
-    result = nf_parse_etheraddr(mac_addr_str, &key->addr);
-    if (result < 0) {
+    if (!nf_parse_etheraddr(mac_addr_str, &key->addr)) {
       NF_INFO("Invalid MAC address: %s, skip", mac_addr_str);
       continue;
     }
@@ -198,13 +334,27 @@ static void read_static_ft_from_file(struct Map *stat_map,
 
     // Now everything is alright, we can add the entry
     key->device = device_from;
-    map_put(stat_map, &key->addr, device_to);
+    StaticKey_map_put(stat_map, &key->addr, device_to);
     vector_return(stat_keys, count, key);
     ++count;
-    assert(count < capacity);
+    assert(count <= static_ft_rules);
   }
 finally:
   fclose(cfg_file);
+  static_ft_text = NULL;
+  NF_INFO("Loaded %d static rules", count);
+}
+
+static void read_static_ft_from_file(struct Map *stat_map,
+                                     struct Vector *stat_keys,
+                                     uint32_t stat_capacity) {
+  // Sized by static_ft_capacity
+  assert(static_ft_rules * 2 < stat_capacity);
+  if (static_ft_binary != NULL) {
+    read_static_ft_from_binary(stat_map, stat_keys);
+  } else if (static_ft_text != NULL) {
+    read_static_ft_from_text(stat_map, stat_keys);
+  }
 }
 #  endif // NFOS
 
@@ -216,6 +366,12 @@ struct {
   { "00:00:00:00:00:00", 0, 0 },
 };
 
+#  ifdef NFOS
+static unsigned static_ft_capacity(void) {
+  return capacity_for_rules(sizeof(static_rules) / sizeof(static_rules[0]));
+}
+#  endif // NFOS
+
 static void read_static_ft_from_array(struct Map *stat_map,
                                       struct Vector *stat_keys,
                                       uint32_t stat_capacity) {
@@ -241,7 +397,7 @@ static void read_static_ft_from_array(struct Map *stat_map,
 
     // Now everything is alright, we can add the entry
     key->device = static_rules[idx].device_from;
-    map_put(stat_map, &key->addr, static_rules[idx].device_to);
+    StaticKey_map_put(stat_map, &key->addr, static_rules[idx].device_to);
     vector_return(stat_keys, count, key);
     ++count;
     assert(count < capacity);
@@ -251,9 +407,8 @@ static void read_static_ft_from_array(struct Map *stat_map,
 #endif // KLEE_VERIFICATION
 
 bool nf_init(void) {
-  unsigned stat_capacity = 8192; // Has to be power of 2
+  unsigned stat_capacity = static_ft_capacity();
   unsigned capacity = config.dyn_capacity;
-  assert(stat_capacity < CAPACITY_UPPER_LIMIT - 1);
 
   mac_tables = alloc_state(capacity, stat_capacity, rte_eth_dev_count_avail());
   if (mac_tables == NULL) {
@@ -265,13 +420,62 @@ bool nf_init(void) {
 #else
   read_static_ft_from_file(mac_tables->st_map, mac_tables->st_vec,
                            stat_capacity);
+#endif
+#ifndef KLEE_VERIFICATION
+  if (config.vlan_aware && !bridge_vlan_init(capacity)) {
+    return false;
+  }
 #endif
   return true;
 }
 
+#ifndef KLEE_VERIFICATION
+// nf_process for VLAN-aware bridges, see bridge_vlan.h. Static rules apply
+// to all VLANs, but only send frames to members of theirs.
+static int bridge_vlan_process(uint16_t device, uint8_t *buffer,
+                               struct rte_ether_hdr *rte_ether_header,
+                               vigor_time_t now) {
+  uint16_t vid;
+  if (!bridge_vlan_get_vid(buffer, rte_ether_header, device, &vid)) {
+    return device;
+  }
+
+  bridge_vlan_expire(now);
+  bridge_vlan_put_update_entry(&rte_ether_header->s_addr, vid, device, now);
+
+  int forward_to = -1;
+  struct StaticKey k;
+  memcpy(&k.addr, &rte_ether_header->d_addr, sizeof(struct rte_ether_addr));
+  k.device = device;
+  if (!StaticKey_map_get(mac_tables->st_map, &k, &forward_to)) {
+    forward_to = bridge_vlan_get_device(&rte_ether_header->d_addr, vid);
+  }
+
+  if (forward_to == -1) {
+    nf_set_flood_devices(config.vlan_ports[vid]);
+    return FLOOD_FRAME;
+  }
+
+  // Egress filtering, 8.6.4, also catches -2, i.e. filtered frames
+  if (forward_to < 0 || forward_to >= 64 ||
+      (config.vlan_ports[vid] & (1ull << forward_to)) == 0) {
+    NF_DEBUG("filtered frame");
+    return device;
+  }
+
+  return forward_to;
+}
+#endif // KLEE_VERIFICATION
+
 int nf_process(uint16_t device, uint8_t* buffer, uint16_t buffer_length, vigor_time_t now) {
   struct rte_ether_hdr *rte_ether_header = nf_then_get_rte_ether_header(buffer);
 
+#ifndef KLEE_VERIFICATION
+  if (config.vlan_aware) {
+    return bridge_vlan_process(device, buffer, rte_ether_header, now);
+  }
+#endif
+
   bridge_expire_entries(now);
   bridge_put_update_entry(&rte_ether_header->s_addr, device, now);
 
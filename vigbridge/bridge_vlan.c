@@ -0,0 +1,118 @@
+#include "bridge_vlan.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_byteorder.h>
+
+#include "libvig/verified/boilerplate-util.h"
+#include "libvig/verified/double-chain.h"
+#include "libvig/verified/expirator.h"
+#include "libvig/verified/map.h"
+#include "libvig/verified/vector.h"
+
+#include "bridge_config.h"
+#include "nf.h"
+#include "nf-log.h"
+#include "nf-profile.h"
+#include "nf-telemetry.h"
+#include "nf-util.h"
+#include "vlan_key.h.gen.h"
+
+#ifndef KLEE_VERIFICATION
+
+// The dynamic filtering table, as in state.h but keyed by (VLAN, MAC). The
+// device of each entry sits right next to its key's index in devices.
+struct VlanTable {
+  struct Map *map;
+  struct Vector *keys;
+  struct DoubleChain *heap;
+  uint16_t *devices;
+};
+
+static PER_CORE struct VlanTable vlan_table;
+
+bool bridge_vlan_init(unsigned capacity) {
+  if (map_allocate(VlanKey_eq, VlanKey_hash, capacity, &vlan_table.map) == 0 ||
+      vector_allocate(sizeof(struct VlanKey), capacity, VlanKey_allocate,
+                      &vlan_table.keys) == 0 ||
+      dchain_allocate(capacity, &vlan_table.heap) == 0) {
+    return false;
+  }
+#  if defined(SPECIALIZED_MAPS)
+  map_specialize(vlan_table.map, &VlanKey_map_ops);
+#  endif
+
+  vlan_table.devices = calloc(capacity, sizeof(uint16_t));
+  return vlan_table.devices != NULL;
+}
+
+int bridge_vlan_expire(vigor_time_t time) {
+  vigor_time_t last_time = time - config.expiration_time * 1000; // us to ns
+  int expired = expire_items_single_map(vlan_table.heap, vlan_table.keys,
+                                        vlan_table.map, last_time);
+  nf_telemetry_add(NF_COUNTER_EXPIRED, expired);
+  nf_telemetry_set(NF_COUNTER_FLOWS, map_size(vlan_table.map));
+  return expired;
+}
+
+bool bridge_vlan_get_vid(uint8_t *buffer, struct rte_ether_hdr *ether_header,
+                         uint16_t device, uint16_t *vid_out) {
+  uint16_t vid = 0;
+  if (ether_header->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_VLAN)) {
+    if (packet_get_unread_length(buffer) < sizeof(struct rte_vlan_hdr)) {
+      NF_DEBUG("truncated 802.1Q tag");
+      return false;
+    }
+    struct rte_vlan_hdr *vlan_header = (struct rte_vlan_hdr *)
+        nf_borrow_next_chunk(buffer, sizeof(struct rte_vlan_hdr));
+    vid = rte_be_to_cpu_16(vlan_header->vlan_tci) & 0x0FFF;
+  }
+
+  // Ingress filtering, 8.6.2
+  if ((config.vlan_ports[vid] & (1ull << device)) == 0) {
+    NF_DEBUG("frame of VLAN %" PRIu16 " on non-member port %" PRIu16, vid,
+             device);
+    return false;
+  }
+
+  *vid_out = vid;
+  return true;
+}
+
+void bridge_vlan_put_update_entry(struct rte_ether_addr *src, uint16_t vid,
+                                  uint16_t src_device, vigor_time_t time) {
+  struct VlanKey lookup_key = { .addr = *src, .vlan = vid };
+  int index = -1;
+  if (VlanKey_map_get(vlan_table.map, &lookup_key, &index)) {
+    dchain_rejuvenate_index(vlan_table.heap, index, time);
+    // Stations may move, unlike in the verified bridge which keeps the
+    // first port until the entry expires
+    vlan_table.devices[index] = src_device;
+    return;
+  }
+
+  if (!dchain_allocate_new_index(vlan_table.heap, &index, time)) {
+    NF_INFO("No more space in the dynamic table");
+    nf_telemetry_add(NF_COUNTER_ALLOC_FAILED, 1);
+    return;
+  }
+  struct VlanKey *key = 0;
+  vector_borrow(vlan_table.keys, index, (void **)&key);
+  *key = lookup_key;
+  vlan_table.devices[index] = src_device;
+  VlanKey_map_put(vlan_table.map, key, index);
+  vector_return(vlan_table.keys, index, key);
+}
+
+int bridge_vlan_get_device(struct rte_ether_addr *dst, uint16_t vid) {
+  struct VlanKey key = { .addr = *dst, .vlan = vid };
+  int index = -1;
+  if (VlanKey_map_get(vlan_table.map, &key, &index)) {
+    return vlan_table.devices[index];
+  }
+  return -1;
+}
+
+#endif // KLEE_VERIFICATION
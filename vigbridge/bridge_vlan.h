@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <rte_ether.h>
+
+#include "libvig/verified/vigor-time.h"
+
+// VLAN-aware bridging, IEEE 802.1Q-2014 section 8.6, an unverified extension
+// of the bridge: frames carry the VID of their 802.1Q tag, or 0 if they are
+// untagged or priority-tagged. Addresses are learned per (VLAN, MAC), in one
+// table, so the same address may sit behind different ports in different
+// VLANs. Frames only enter and leave through ports that are members of their
+// VLAN, see --vlan, and floods only reach those ports. Tags are forwarded as
+// they are; there is no tagging or untagging at the edge.
+// Not compiled for KLEE_VERIFICATION, whose bridge is never VLAN-aware.
+
+bool bridge_vlan_init(unsigned capacity);
+
+int bridge_vlan_expire(vigor_time_t time);
+
+// Reads the 802.1Q tag, if any, right after the Ethernet header in buffer.
+// Returns false if the frame must be dropped: a truncated tag, or a VLAN that
+// device is not a member of.
+bool bridge_vlan_get_vid(uint8_t *buffer, struct rte_ether_hdr *ether_header,
+                         uint16_t device, uint16_t *vid_out);
+
+void bridge_vlan_put_update_entry(struct rte_ether_addr *src, uint16_t vid,
+                                  uint16_t src_device, vigor_time_t time);
+
+// Returns -1 if the address was not learned in that VLAN
+int bridge_vlan_get_device(struct rte_ether_addr *dst, uint16_t vid);
@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+# Compiles a static filtering table for the bridge, one
+# "<MAC> <from device> <to device>" rule per line as with --config, into the
+# binary format that the bridge maps and loads with no parsing; see
+# read_static_ft_from_binary in bridge_main.c. Pass the result to --config
+# the same way. The bridge must run on a machine with the same byte order.
+#
+# Usage: compile-static-table.py <text table> <binary table>
+
+import struct
+import sys
+
+MAGIC = b'VIGBRST1'
+# struct static_ft_header and struct static_ft_entry, in host byte order
+HEADER = struct.Struct('=8sII')
+ENTRY = struct.Struct('=6sHh')
+
+
+def parse_mac(text):
+  parts = text.split(':')
+  if len(parts) != 6:
+    raise ValueError(text)
+  return bytes(int(part, 16) for part in parts)
+
+
+def main():
+  if len(sys.argv) != 3:
+    print('Usage: ' + sys.argv[0] + ' <text table> <binary table>',
+          file=sys.stderr)
+    sys.exit(1)
+
+  entries = []
+  with open(sys.argv[1]) as text:
+    # The bridge reads whitespace-separated triples, not lines
+    words = text.read().split()
+  for i in range(0, len(words) - 2, 3):
+    mac, device_from, device_to = words[i:i + 3]
+    try:
+      entries.append(ENTRY.pack(parse_mac(mac), int(device_from),
+                                int(device_to)))
+    except (ValueError, struct.error):
+      print('Invalid rule: ' + ' '.join(words[i:i + 3]) + ', skip',
+            file=sys.stderr)
+
+  with open(sys.argv[2], 'wb') as binary:
+    binary.write(HEADER.pack(MAGIC, len(entries), ENTRY.size))
+    binary.writelines(entries)
+  print('Compiled ' + str(len(entries)) + ' rules')
+
+
+if __name__ == '__main__':
+  main()
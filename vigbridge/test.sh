@@ -9,6 +9,11 @@ function cleanup {
   sudo killall iperf 2>/dev/null || true
   sudo ip netns delete lan 2>/dev/null || true
   sudo ip netns delete wan 2>/dev/null || true
+  sudo killall tcpdump 2>/dev/null || true
+  for PORT in 0 1 2; do
+    sudo ip netns delete p$PORT 2>/dev/null || true
+    rm -f "/tmp/vigbridge-test-p$PORT"
+  done
 }
 trap cleanup EXIT
 
@@ -22,11 +27,11 @@ function test_bridge {
         --vdev "net_tap1,iface=test_lan" \
         --no-shconf -- \
         --expire 10 --capacity 100 --config no-file.cfg \
-        #>/dev/null 2>/dev/null &
+        >/dev/null 2>/dev/null &
   NF_PID=$!
 
   while [ ! -f /sys/class/net/test_lan/tun_flags -o \
-          ! -f /sys/class/net/test_lan/tun_flags ]; do
+          ! -f /sys/class/net/test_wan/tun_flags ]; do
     echo "Waiting for NF to launch...";
     sleep 1;
   done
@@ -63,9 +68,115 @@ function test_bridge {
 }
 
 
+# Adds a host in VLAN $2 behind port $1, with IP $3 and, if given, MAC $4
+function add_vlan_host {
+  IFACE=test_p$1.$2
+  sudo ip netns exec p$1 ip link add link test_p$1 name $IFACE type vlan id $2
+  if [ $# -ge 4 ]; then
+    sudo ip netns exec p$1 ip link set $IFACE address $4
+  fi
+  sudo ip netns exec p$1 ip addr add $3/24 dev $IFACE
+  sudo ip netns exec p$1 ip link set $IFACE up
+}
+
+# Lines of what the bridge sent to port $1 that match $2
+function count_captured {
+  grep -c "$2" "/tmp/vigbridge-test-p$1" || true
+}
+
+# VLAN 10 spans ports 0 and 1, VLAN 20 ports 0 and 2. The hosts behind ports
+# 1 and 2 share a MAC address, which only learning per (VLAN, MAC) tells
+# apart. Port 1 also has a host in VLAN 20, which it is not a member of, so
+# ingress filtering must drop its frames.
+function test_vlans {
+  SHARED_MAC=02:00:00:00:00:01
+
+  sudo ./build/app/bridge \
+        --no-pci \
+        --vdev "net_tap0,iface=test_p0" \
+        --vdev "net_tap1,iface=test_p1" \
+        --vdev "net_tap2,iface=test_p2" \
+        --no-shconf -- \
+        --expire 10 --capacity 128 --config no-file.cfg \
+        --vlan 10:0,1 --vlan 20:0,2 \
+        >/dev/null 2>/dev/null &
+  NF_PID=$!
+
+  for PORT in 0 1 2; do
+    while [ ! -f /sys/class/net/test_p$PORT/tun_flags ]; do
+      echo "Waiting for NF to launch...";
+      sleep 1;
+    done
+  done
+  sleep 2
+
+  for PORT in 0 1 2; do
+    sudo ip netns add p$PORT
+    sudo ip link set test_p$PORT netns p$PORT
+    sudo ip netns exec p$PORT ip link set test_p$PORT up
+  done
+  add_vlan_host 0 10 10.0.10.1
+  add_vlan_host 0 20 10.0.20.1
+  add_vlan_host 1 10 10.0.10.2 $SHARED_MAC
+  add_vlan_host 2 20 10.0.20.2 $SHARED_MAC
+  add_vlan_host 1 20 10.0.20.3
+  FILTERED_MAC=$(sudo ip netns exec p1 cat /sys/class/net/test_p1.20/address)
+
+  # What the bridge sends to each port, with the 802.1Q tags
+  TCPDUMP_PIDS=''
+  for PORT in 0 1 2; do
+    sudo ip netns exec p$PORT tcpdump -i test_p$PORT -Q in -e -n -l \
+        >"/tmp/vigbridge-test-p$PORT" 2>/dev/null &
+    TCPDUMP_PIDS="$TCPDUMP_PIDS $!"
+  done
+  sleep 1
+
+  # Alternate between the two VLANs, so that the shared MAC address keeps
+  # being learned behind port 1 in one and port 2 in the other
+  FAILED=''
+  for ROUND in 1 2 3; do
+    for DST_IP in 10.0.10.2 10.0.20.2; do
+      if ! sudo ip netns exec p0 ping -c 1 -W 1 $DST_IP >/dev/null; then
+        FAILED="$FAILED $DST_IP"
+      fi
+    done
+  done
+  if sudo ip netns exec p1 ping -c 3 -W 1 10.0.20.1 >/dev/null; then
+    FAILED="$FAILED filtered-10.0.20.1"
+  fi
+
+  sudo killall tcpdump
+  wait $TCPDUMP_PIDS 2>/dev/null || true
+
+  sudo killall bridge
+  wait $NF_PID 2>/dev/null || true
+
+  # Floods and unicasts of a VLAN only reach its members, and nothing the
+  # filtered host sent gets through
+  LEAKED_10=$(count_captured 2 'vlan 10,')
+  LEAKED_20=$(count_captured 1 'vlan 20,')
+  LEAKED_FILTERED=$(( $(count_captured 0 "$FILTERED_MAC") +
+                      $(count_captured 2 "$FILTERED_MAC") ))
+  echo "VLANs: failed pings:${FAILED:- none}, VLAN 10 frames on port 2:" \
+       "$LEAKED_10, VLAN 20 frames on port 1: $LEAKED_20, frames of the" \
+       "filtered host: $LEAKED_FILTERED"
+
+  for PORT in 0 1 2; do
+    sudo ip netns delete p$PORT
+  done
+
+  if [ -n "$FAILED" -o "$LEAKED_10" -ne 0 -o "$LEAKED_20" -ne 0 -o \
+       "$LEAKED_FILTERED" -ne 0 ]; then
+    echo "VLAN test failed" 1>&2
+    exit 1
+  fi
+}
+
+
 make clean
 make ADDITIONAL_FLAGS="-DSTOP_ON_RX_0 -g" -j$(nproc)
 
 test_bridge 12500 500000
+test_vlans
 
 echo "Done."
@@ -0,0 +1,13 @@
+#ifndef _VLAN_KEY_H_INCLUDED_
+#define _VLAN_KEY_H_INCLUDED_
+
+#include <stdint.h>
+#include <rte_ether.h>
+
+// A learned address is only valid within its VLAN, see bridge_vlan.h
+struct VlanKey {
+  struct rte_ether_addr addr;
+  uint16_t vlan;
+};
+
+#endif //_VLAN_KEY_H_INCLUDED_
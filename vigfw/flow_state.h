@@ -0,0 +1,13 @@
+#ifndef _FLOW_STATE_H_INCLUDED_
+#define _FLOW_STATE_H_INCLUDED_
+
+#include <stdint.h>
+
+// Connection tracking state of a flow, see fw_flowmanager.c
+struct FlowState {
+  // Slot of the flow in the timeout queue of its TCP state, if any
+  uint32_t queue_slot;
+  uint8_t tcp_state;
+};
+
+#endif //_FLOW_STATE_H_INCLUDED_
@@ -18,11 +18,24 @@ void nf_config_init(int argc, char **argv) {
 
   struct option long_options[] = { { "eth-dest", required_argument, NULL, 'm' },
                                    { "expire", required_argument, NULL, 't' },
+                                   { "expire-half-open", required_argument,
+                                     NULL, 'h' },
+                                   { "expire-closing", required_argument,
+                                     NULL, 'c' },
+                                   { "evict-half-open", no_argument, NULL,
+                                     'e' },
                                    { "max-flows", required_argument, NULL,
                                      'f' },
+                                   { "source-quota", required_argument, NULL,
+                                     'q' },
                                    { "wan", required_argument, NULL, 'w' },
                                    { NULL, 0, NULL, 0 } };
 
+  config.half_open_expiration_time = 0;
+  config.closing_expiration_time = 0;
+  config.source_quota = 0;
+  config.evict_half_open = false;
+
   config.device_macs = calloc(nb_devices, sizeof(struct rte_ether_addr));
   config.endpoint_macs = calloc(nb_devices, sizeof(struct rte_ether_addr));
 
@@ -32,7 +45,7 @@ void nf_config_init(int argc, char **argv) {
   }
 
   int opt;
-  while ((opt = getopt_long(argc, argv, "m:t:f:w:", long_options, NULL)) !=
+  while ((opt = getopt_long(argc, argv, "m:t:h:c:ef:q:w:", long_options, NULL)) !=
          EOF) {
     unsigned device;
     switch (opt) {
@@ -57,6 +70,26 @@ void nf_config_init(int argc, char **argv) {
         }
         break;
 
+      case 'h':
+        config.half_open_expiration_time =
+            nf_util_parse_int(optarg, "half-open-exp-time", 10, '\0');
+        if (config.half_open_expiration_time == 0) {
+          PARSE_ERROR("Expiration time must be strictly positive.\n");
+        }
+        break;
+
+      case 'c':
+        config.closing_expiration_time =
+            nf_util_parse_int(optarg, "closing-exp-time", 10, '\0');
+        if (config.closing_expiration_time == 0) {
+          PARSE_ERROR("Expiration time must be strictly positive.\n");
+        }
+        break;
+
+      case 'e':
+        config.evict_half_open = true;
+        break;
+
       case 'f':
         config.max_flows = nf_util_parse_int(optarg, "max-flows", 10, '\0');
         if (config.max_flows <= 0) {
@@ -64,6 +97,11 @@ void nf_config_init(int argc, char **argv) {
         }
         break;
 
+      case 'q':
+        config.source_quota =
+            nf_util_parse_int(optarg, "source-quota", 10, '\0');
+        break;
+
       case 'w':
         config.wan_device = nf_util_parse_int(optarg, "wan-dev", 10, '\0');
         if (config.wan_device >= nb_devices) {
@@ -77,6 +115,22 @@ void nf_config_init(int argc, char **argv) {
     }
   }
 
+  // Every flow expires after expiration_time anyway,
+  // see fw_flowmanager.c
+  if (config.half_open_expiration_time > config.expiration_time) {
+    config.half_open_expiration_time = config.expiration_time;
+  }
+  if (config.closing_expiration_time > config.expiration_time) {
+    config.closing_expiration_time = config.expiration_time;
+  }
+  config.track_tcp = config.half_open_expiration_time != 0 ||
+                     config.closing_expiration_time != 0;
+
+  // Only the half-open queue knows which connections are half-open
+  if (config.evict_half_open && config.half_open_expiration_time == 0) {
+    PARSE_ERROR("--evict-half-open needs --expire-half-open.\n");
+  }
+
   // Reset getopt
   optind = 1;
 }
@@ -87,7 +141,19 @@ void nf_config_usage(void) {
           "\t--eth-dest <device>,<mac>: MAC address of the endpoint linked to "
           "a device.\n"
           "\t--expire <time>: flow expiration time (us).\n"
+          "\t--expire-half-open <time>: expiration time of TCP connections "
+          "that have not seen a reply yet (us), e.g. 5000000; tracks TCP "
+          "connection states, which spec.py does not describe, default: "
+          "off.\n"
+          "\t--expire-closing <time>: expiration time of closed or reset TCP "
+          "connections (us), e.g. 30000000; tracks TCP connection states, "
+          "which spec.py does not describe, default: off.\n"
+          "\t--evict-half-open: when the flow table is full, evict the "
+          "oldest half-open TCP connection to make room for a new flow, "
+          "needs --expire-half-open, default: off.\n"
           "\t--max-flows <n>: flow table capacity.\n"
+          "\t--source-quota <n>: flows a source IP may open per second once "
+          "the flow table is half full, default: 0 (no limit).\n"
           "\t--wan <device>: set device to be the external one.\n");
 }
 
@@ -109,7 +175,14 @@ void nf_config_print(void) {
   }
 
   NF_INFO("Expiration time: %" PRIu32 "us", config.expiration_time);
+  NF_INFO("TCP state tracking: %s", config.track_tcp ? "on" : "off");
+  NF_INFO("Half-open expiration time: %" PRIu32 "us",
+          config.half_open_expiration_time);
+  NF_INFO("Closing expiration time: %" PRIu32 "us",
+          config.closing_expiration_time);
   NF_INFO("Max flows: %" PRIu32, config.max_flows);
+  NF_INFO("Source quota: %" PRIu32, config.source_quota);
+  NF_INFO("Half-open eviction: %s", config.evict_half_open ? "on" : "off");
 
   NF_INFO("\n--- --- ------ ---\n");
 }
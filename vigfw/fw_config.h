@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <rte_ether.h>
@@ -19,6 +20,27 @@ struct nf_config {
   // Expiration time of flows, in microseconds
   uint32_t expiration_time;
 
+  // Expiration time of half-open TCP connections, in microseconds,
+  // 0 for expiration_time
+  uint32_t half_open_expiration_time;
+
+  // Expiration time of closing and reset TCP connections, in microseconds,
+  // 0 for expiration_time
+  uint32_t closing_expiration_time;
+
+  // Whether TCP connection states are tracked, i.e. either of the above is
+  // set; spec.py does not describe them, so this is off by default
+  bool track_tcp;
+
+  // Flows a source IP may open per second once the flow table is half full,
+  // 0 for no limit
+  uint32_t source_quota;
+
+  // Whether a new flow evicts the oldest half-open TCP connection when the
+  // flow table is full; spec.py refuses new flows then, so this is off by
+  // default, and it needs half_open_expiration_time
+  bool evict_half_open;
+
   // Size of the flow table
   uint32_t max_flows;
 };
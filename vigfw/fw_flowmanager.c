@@ -3,22 +3,100 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h> //for memcpy
+#include <netinet/in.h>
 #include <rte_ethdev.h>
 
+#include "libvig/unverified/count-min-sketch.h"
 #include "libvig/verified/double-chain.h"
 #include "libvig/verified/map.h"
 #include "libvig/verified/vector.h"
 #include "libvig/verified/expirator.h"
 
+#include "flow_state.h"
+#include "nf-profile.h"
+#include "nf-telemetry.h"
 #include "state.h"
 
+// TCP flags, as in struct tcp_flags_hdr
+#define TCP_FIN_FLAG 0x01
+#define TCP_SYN_FLAG 0x02
+#define TCP_RST_FLAG 0x04
+
+// Values of FlowState.tcp_state
+#define TCP_STATE_NONE 0 // not TCP, only expiration_time applies
+#define TCP_STATE_SYN_SENT 1
+#define TCP_STATE_ESTABLISHED 2
+#define TCP_STATE_FIN_WAIT 3
+
+#define QUEUE_NONE -1
+#define QUEUE_HALF_OPEN 0
+#define QUEUE_CLOSING 1
+#define QUEUE_COUNT 2
+
+// Sources are counted in one-second periods, see flow_manager_admit
+#define SOURCE_SKETCH_WIDTH_LOG2 12
+#define SOURCE_SKETCH_PERIOD 1000000000 // nanoseconds
+
+// All flows are in heap, which expires them after expiration_time.
+// If TCP states are tracked, flows in a short-lived TCP state whose timeout
+// is set are also in the queue of that state:
+// its own dchain, whose slots point back to the flow index, so that each
+// queue stays sorted by last use even though the timeouts differ.
+// These containers are not part of the state in spec.py, and each is only
+// allocated when the timeout that uses it is set, so that the default
+// configuration allocates none of them.
+struct TimeoutQueue {
+  struct DoubleChain *heap;
+  struct Vector *flows;
+  vigor_time_t expiration_time; /*microseconds*/
+};
+
 struct FlowManager {
   struct State *state;
-  vigor_time_t expiration_time; /*seconds*/
+  vigor_time_t expiration_time; /*microseconds*/
+  // Off unless a short-lived TCP state has its own timeout: flows then only
+  // use the containers that spec.py describes
+  bool track_tcp;
+  struct Vector *flow_states; // NULL unless track_tcp
+  struct TimeoutQueue queues[QUEUE_COUNT]; // empty unless expiration_time
+
+  // Admission control, see flow_manager_admit
+  struct CountMinSketch *sources;
+  uint32_t source_quota;
+  bool evict_half_open;
+  uint32_t flow_count;
+  uint32_t max_flows;
 };
 
+static void flow_state_init(void *obj) {
+  struct FlowState *flow_state = obj;
+  flow_state->queue_slot = 0;
+  flow_state->tcp_state = TCP_STATE_NONE;
+}
+
+static void flow_index_init(void *obj) { *(uint32_t *)obj = 0; }
+
+static bool timeout_queue_allocate(struct TimeoutQueue *queue,
+                                   vigor_time_t expiration_time,
+                                   uint64_t max_flows) {
+  queue->heap = NULL;
+  queue->flows = NULL;
+  queue->expiration_time = expiration_time;
+  if (expiration_time == 0) {
+    return true;
+  }
+
+  return dchain_allocate(max_flows, &queue->heap) != 0 &&
+         vector_allocate(sizeof(uint32_t), max_flows, flow_index_init,
+                         &queue->flows) != 0;
+}
+
 struct FlowManager *flow_manager_allocate(uint16_t fw_device,
                                           vigor_time_t expiration_time,
+                                          vigor_time_t half_open_expiration_time,
+                                          vigor_time_t closing_expiration_time,
+                                          uint32_t source_quota,
+                                          bool evict_half_open,
                                           uint64_t max_flows) {
   struct FlowManager *manager =
       (struct FlowManager *)malloc(sizeof(struct FlowManager));
@@ -31,34 +109,237 @@ struct FlowManager *flow_manager_allocate(uint16_t fw_device,
   }
 
   manager->expiration_time = expiration_time;
+  manager->track_tcp =
+      half_open_expiration_time != 0 || closing_expiration_time != 0;
+
+  manager->flow_states = NULL;
+  if (manager->track_tcp &&
+      vector_allocate(sizeof(struct FlowState), max_flows, flow_state_init,
+                      &manager->flow_states) == 0) {
+    return NULL;
+  }
+  if (!timeout_queue_allocate(&manager->queues[QUEUE_HALF_OPEN],
+                              half_open_expiration_time, max_flows) ||
+      !timeout_queue_allocate(&manager->queues[QUEUE_CLOSING],
+                              closing_expiration_time, max_flows)) {
+    return NULL;
+  }
+
+  manager->sources = NULL;
+  if (source_quota != 0 &&
+      !cms_allocate(SOURCE_SKETCH_WIDTH_LOG2, SOURCE_SKETCH_PERIOD,
+                    &manager->sources)) {
+    return NULL;
+  }
+  manager->source_quota = source_quota;
+  manager->evict_half_open = evict_half_open;
+  manager->flow_count = 0;
+  manager->max_flows = max_flows;
 
   return manager;
 }
 
+// A state whose timeout is 0 has no queue, expiration_time applies to it
+static int tcp_state_queue(struct FlowManager *manager, uint8_t tcp_state) {
+  int queue;
+  switch (tcp_state) {
+    case TCP_STATE_SYN_SENT:
+      queue = QUEUE_HALF_OPEN;
+      break;
+    case TCP_STATE_FIN_WAIT:
+      queue = QUEUE_CLOSING;
+      break;
+    default:
+      return QUEUE_NONE;
+  }
+  return manager->queues[queue].expiration_time == 0 ? QUEUE_NONE : queue;
+}
+
+// A connection stays half-open until a packet comes back from the WAN side,
+// whichever flags the packets that opened it carried, so that floods and
+// scans do not need to follow the handshake to be cleaned up early.
+static uint8_t tcp_next_state(uint8_t tcp_state, uint8_t tcp_flags,
+                              bool from_wan) {
+  if (tcp_flags & (TCP_FIN_FLAG | TCP_RST_FLAG)) {
+    return TCP_STATE_FIN_WAIT;
+  }
+
+  switch (tcp_state) {
+    case TCP_STATE_SYN_SENT:
+      return from_wan ? TCP_STATE_ESTABLISHED : TCP_STATE_SYN_SENT;
+    case TCP_STATE_FIN_WAIT:
+      // The ports are being reused for a new connection
+      return (!from_wan && (tcp_flags & TCP_SYN_FLAG)) ? TCP_STATE_SYN_SENT
+                                                         : TCP_STATE_FIN_WAIT;
+    default:
+      return tcp_state;
+  }
+}
+
+static void flow_manager_enqueue(struct FlowManager *manager, int index,
+                                 struct FlowState *flow_state,
+                                 vigor_time_t time) {
+  int queue = tcp_state_queue(manager, flow_state->tcp_state);
+  if (queue == QUEUE_NONE) {
+    return;
+  }
+
+  int slot;
+  // Cannot fail, a flow is in at most one queue and each queue can hold
+  // all the flows
+  dchain_allocate_new_index(manager->queues[queue].heap, &slot, time);
+  uint32_t *flow;
+  vector_borrow(manager->queues[queue].flows, slot, (void **)&flow);
+  *flow = index;
+  vector_return(manager->queues[queue].flows, slot, flow);
+  flow_state->queue_slot = slot;
+}
+
+static void flow_manager_dequeue(struct FlowManager *manager,
+                                 struct FlowState *flow_state) {
+  int queue = tcp_state_queue(manager, flow_state->tcp_state);
+  if (queue == QUEUE_NONE) {
+    return;
+  }
+
+  dchain_free_index(manager->queues[queue].heap, flow_state->queue_slot);
+}
+
+// Moves the flow along the TCP state machine, and to the right queue
+static void flow_manager_track(struct FlowManager *manager, int index,
+                               struct FlowId *id, uint8_t tcp_flags,
+                               bool from_wan, vigor_time_t time) {
+  if (!manager->track_tcp || id->protocol != IPPROTO_TCP) {
+    return;
+  }
+
+  struct FlowState *flow_state = 0;
+  vector_borrow(manager->flow_states, index, (void **)&flow_state);
+  uint8_t next_state = tcp_next_state(flow_state->tcp_state, tcp_flags,
+                                      from_wan);
+  if (next_state != flow_state->tcp_state) {
+    flow_manager_dequeue(manager, flow_state);
+    flow_state->tcp_state = next_state;
+    flow_manager_enqueue(manager, index, flow_state, time);
+  } else {
+    int queue = tcp_state_queue(manager, flow_state->tcp_state);
+    if (queue != QUEUE_NONE) {
+      dchain_rejuvenate_index(manager->queues[queue].heap,
+                              flow_state->queue_slot, time);
+    }
+  }
+  vector_return(manager->flow_states, index, flow_state);
+}
+
+static void flow_manager_erase(struct FlowManager *manager, int index) {
+  struct FlowId *key = 0;
+  vector_borrow(manager->state->fv, index, (void **)&key);
+  FlowId_map_erase(manager->state->fm, key, (void **)&key);
+  vector_return(manager->state->fv, index, key);
+  manager->flow_count--;
+}
+
+// Once the table is half full, a source that opened more than source_quota
+// flows in the current period cannot open new ones until the next period:
+// a single host flooding SYNs with random ports then cannot take the whole
+// table, while the other hosts keep getting new flows. Below that occupancy
+// nothing is refused, so a lone heavy but legitimate host is not penalized.
+static bool flow_manager_admit(struct FlowManager *manager, struct FlowId *id,
+                               vigor_time_t time) {
+  if (manager->sources == NULL) {
+    return true;
+  }
+
+  return manager->flow_count < manager->max_flows / 2 ||
+         cms_estimate(manager->sources, id->src_ip, time) <
+             manager->source_quota;
+}
+
+// Counts a flow the source opened, once it got a slot in the table, so that
+// attempts refused because the table is full do not use up its quota
+static void flow_manager_admitted(struct FlowManager *manager,
+                                  struct FlowId *id, vigor_time_t time) {
+  if (manager->sources != NULL) {
+    cms_add(manager->sources, id->src_ip, time);
+  }
+}
+
+// Makes room for a new flow in a full table, by evicting the half-open TCP
+// connection that was least recently used, if any. Established connections
+// are never evicted, so under a SYN flood the table degrades to refusing
+// new connections rather than breaking existing ones.
+static bool flow_manager_evict_half_open(struct FlowManager *manager,
+                                         vigor_time_t time) {
+  if (!manager->evict_half_open) {
+    return false;
+  }
+
+  struct TimeoutQueue *half_open = &manager->queues[QUEUE_HALF_OPEN];
+  int slot;
+  // Every entry is older than time + 1, so this pops the oldest one
+  if (!dchain_expire_one_index(half_open->heap, &slot, time + 1)) {
+    return false;
+  }
+
+  uint32_t *flow;
+  vector_borrow(half_open->flows, slot, (void **)&flow);
+  int index = *flow;
+  vector_return(half_open->flows, slot, flow);
+
+  flow_manager_erase(manager, index);
+  dchain_free_index(manager->state->heap, index);
+  return true;
+}
+
 void flow_manager_allocate_or_refresh_flow(struct FlowManager *manager,
                                            struct FlowId *id,
                                            uint32_t internal_device,
+                                           uint8_t tcp_flags,
                                            vigor_time_t time) {
   int index;
-  if (map_get(manager->state->fm, id, &index)) {
+  if (FlowId_map_get(manager->state->fm, id, &index)) {
     dchain_rejuvenate_index(manager->state->heap, index, time);
+    flow_manager_track(manager, index, id, tcp_flags, false, time);
     return;
   }
-  if (!dchain_allocate_new_index(manager->state->heap, &index, time)) {
+  if (!flow_manager_admit(manager, id, time)) {
+    // The source exceeded its quota, its traffic goes out untracked
+    // and replies will be dropped.
+    return;
+  }
+  if (!dchain_allocate_new_index(manager->state->heap, &index, time) &&
+      !(flow_manager_evict_half_open(manager, time) &&
+        dchain_allocate_new_index(manager->state->heap, &index, time))) {
     // No luck, the flow table is full, but we can at least let the
     // outgoing traffic out.
+    nf_telemetry_add(NF_COUNTER_ALLOC_FAILED, 1);
     return;
   }
+  manager->flow_count++;
+  flow_manager_admitted(manager, id, time);
 
   struct FlowId *key = 0;
   vector_borrow(manager->state->fv, index, (void **)&key);
   memcpy((void *)key, (void *)id, sizeof(struct FlowId));
-  map_put(manager->state->fm, key, index);
+  FlowId_map_put(manager->state->fm, key, index);
   vector_return(manager->state->fv, index, key);
   uint32_t *int_dev;
   vector_borrow(manager->state->int_devices, index, (void **)&int_dev);
   *int_dev = internal_device;
   vector_return(manager->state->int_devices, index, int_dev);
+
+  if (!manager->track_tcp) {
+    return;
+  }
+  struct FlowState *flow_state = 0;
+  vector_borrow(manager->flow_states, index, (void **)&flow_state);
+  flow_state->tcp_state = TCP_STATE_NONE;
+  if (id->protocol == IPPROTO_TCP) {
+    flow_state->tcp_state = tcp_next_state(TCP_STATE_SYN_SENT, tcp_flags,
+                                           false);
+    flow_manager_enqueue(manager, index, flow_state, time);
+  }
+  vector_return(manager->flow_states, index, flow_state);
 }
 
 void flow_manager_expire(struct FlowManager *manager, vigor_time_t time) {
@@ -66,15 +347,56 @@ void flow_manager_expire(struct FlowManager *manager, vigor_time_t time) {
   assert(sizeof(vigor_time_t) <= sizeof(uint64_t));
   uint64_t time_u = (uint64_t)time; // OK because of the two asserts
   vigor_time_t last_time = time_u - manager->expiration_time * 1000; // us to ns
-  expire_items_single_map(manager->state->heap, manager->state->fv,
-                          manager->state->fm, last_time);
+
+  if (!manager->track_tcp) {
+    int expired = expire_items_single_map(manager->state->heap,
+                                          manager->state->fv,
+                                          manager->state->fm, last_time);
+    manager->flow_count -= expired;
+    nf_telemetry_add(NF_COUNTER_EXPIRED, expired);
+    nf_telemetry_set(NF_COUNTER_FLOWS, manager->flow_count);
+    return;
+  }
+
+  for (int queue = 0; queue < QUEUE_COUNT; queue++) {
+    struct TimeoutQueue *timeouts = &manager->queues[queue];
+    if (timeouts->expiration_time == 0) {
+      continue;
+    }
+    vigor_time_t queue_last_time =
+        time_u - timeouts->expiration_time * 1000; // us to ns
+    int slot;
+    while (dchain_expire_one_index(timeouts->heap, &slot, queue_last_time)) {
+      uint32_t *flow;
+      vector_borrow(timeouts->flows, slot, (void **)&flow);
+      int index = *flow;
+      vector_return(timeouts->flows, slot, flow);
+
+      flow_manager_erase(manager, index);
+      dchain_free_index(manager->state->heap, index);
+      nf_telemetry_add(NF_COUNTER_EXPIRED, 1);
+    }
+  }
+
+  int index;
+  while (dchain_expire_one_index(manager->state->heap, &index, last_time)) {
+    struct FlowState *flow_state = 0;
+    vector_borrow(manager->flow_states, index, (void **)&flow_state);
+    flow_manager_dequeue(manager, flow_state);
+    vector_return(manager->flow_states, index, flow_state);
+
+    flow_manager_erase(manager, index);
+    nf_telemetry_add(NF_COUNTER_EXPIRED, 1);
+  }
+  nf_telemetry_set(NF_COUNTER_FLOWS, manager->flow_count);
 }
 
 bool flow_manager_get_refresh_flow(struct FlowManager *manager,
-                                   struct FlowId *id, vigor_time_t time,
+                                   struct FlowId *id, uint8_t tcp_flags,
+                                   vigor_time_t time,
                                    uint32_t *internal_device) {
   int index;
-  if (map_get(manager->state->fm, id, &index) == 0) {
+  if (FlowId_map_get(manager->state->fm, id, &index) == 0) {
     return false;
   }
   uint32_t *int_dev;
@@ -82,5 +404,6 @@ bool flow_manager_get_refresh_flow(struct FlowManager *manager,
   *internal_device = *int_dev;
   vector_return(manager->state->int_devices, index, int_dev);
   dchain_rejuvenate_index(manager->state->heap, index, time);
+  flow_manager_track(manager, index, id, tcp_flags, true, time);
   return true;
 }
@@ -9,17 +9,34 @@
 
 struct FlowManager;
 
+// All flows expire after expiration_time without traffic. If either of the
+// half-open and closing timeouts is not 0, TCP connections are also tracked
+// with a small state machine: a connection is half-open until the first
+// reply, established afterwards, and closing once either side sent a FIN or
+// a RST. Half-open and closing connections then expire after their own,
+// shorter, timeouts; 0 means the state has none. Times are in microseconds.
+// If source_quota is not 0, once the table is half full each source IP may
+// only open source_quota flows per second. If evict_half_open is set, which
+// needs a half-open timeout, when the table is full the oldest half-open
+// connection is evicted to make room for a new flow.
 struct FlowManager *flow_manager_allocate(uint16_t fw_device,
                                           vigor_time_t expiration_time,
+                                          vigor_time_t half_open_expiration_time,
+                                          vigor_time_t closing_expiration_time,
+                                          uint32_t source_quota,
+                                          bool evict_half_open,
                                           uint64_t max_flows);
 
+// tcp_flags is only relevant for TCP flows (as per id->protocol)
 void flow_manager_allocate_or_refresh_flow(struct FlowManager *manager,
                                            struct FlowId *id,
                                            uint32_t internal_device,
+                                           uint8_t tcp_flags,
                                            vigor_time_t time);
 void flow_manager_expire(struct FlowManager *manager, vigor_time_t time);
 bool flow_manager_get_refresh_flow(struct FlowManager *manager,
-                                   struct FlowId *id, vigor_time_t time,
+                                   struct FlowId *id, uint8_t tcp_flags,
+                                   vigor_time_t time,
                                    uint32_t *internal_device);
 
 #endif //_FLOWMANAGER_H_INCLUDED_
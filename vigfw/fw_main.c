@@ -5,15 +5,18 @@
 #include "fw_config.h"
 #include "nf.h"
 #include "nf-log.h"
+#include "nf-profile.h"
 #include "nf-util.h"
 
 struct nf_config config;
 
-struct FlowManager *flow_manager;
+PER_CORE struct FlowManager *flow_manager;
 
 bool nf_init(void) {
   flow_manager = flow_manager_allocate(
-      config.wan_device, config.expiration_time, config.max_flows);
+      config.wan_device, config.expiration_time,
+      config.half_open_expiration_time, config.closing_expiration_time,
+      config.source_quota, config.evict_half_open, config.max_flows);
   return flow_manager != NULL;
 }
 
@@ -39,6 +42,15 @@ int nf_process(uint16_t device, uint8_t* buffer, uint16_t packet_length, vigor_t
     return device;
   }
 
+  uint8_t tcp_flags = 0;
+  if (config.track_tcp) {
+    struct tcp_flags_hdr *tcp_flags_header =
+        nf_then_get_tcp_flags_header(rte_ipv4_header, buffer);
+    if (tcp_flags_header != NULL) {
+      tcp_flags = tcp_flags_header->tcp_flags;
+    }
+  }
+
   NF_DEBUG("Forwarding an IPv4 packet on device %" PRIu16, device);
 
   uint16_t dst_device;
@@ -53,7 +65,7 @@ int nf_process(uint16_t device, uint8_t* buffer, uint16_t packet_length, vigor_t
     };
 
     uint32_t dst_device_long;
-    if (!flow_manager_get_refresh_flow(flow_manager, &id, now,
+    if (!flow_manager_get_refresh_flow(flow_manager, &id, tcp_flags, now,
                                        &dst_device_long)) {
       NF_DEBUG("Unknown external flow, dropping");
       return device;
@@ -67,7 +79,8 @@ int nf_process(uint16_t device, uint8_t* buffer, uint16_t packet_length, vigor_t
       .dst_ip = rte_ipv4_header->dst_addr,
       .protocol = rte_ipv4_header->next_proto_id,
     };
-    flow_manager_allocate_or_refresh_flow(flow_manager, &id, device, now);
+    flow_manager_allocate_or_refresh_flow(flow_manager, &id, device, tcp_flags,
+                                          now);
     dst_device = config.wan_device;
   }
 
@@ -1,4 +1,6 @@
 #include "lb_balancer.h"
+#include "nf-profile.h"
+#include "nf-telemetry.h"
 #include "state.h"
 
 #include "libvig/verified/map.h"
@@ -41,7 +43,8 @@ struct LoadBalancedBackend lb_get_backend(struct LoadBalancer *balancer,
                                           uint16_t wan_device) {
   int flow_index;
   struct LoadBalancedBackend backend;
-  if (map_get(balancer->state->flow_to_flow_id, flow, &flow_index) == 0) {
+  if (LoadBalancedFlow_map_get(balancer->state->flow_to_flow_id, flow,
+                               &flow_index) == 0) {
     int backend_index = 0;
     int found = cht_find_preferred_available_backend(
         (uint64_t)LoadBalancedFlow_hash(flow), balancer->state->cht,
@@ -60,11 +63,15 @@ struct LoadBalancedBackend lb_get_backend(struct LoadBalancer *balancer,
         *vec_flow_id_to_backend_id = backend_index;
         vector_return(balancer->state->flow_id_to_backend_id, flow_index,
                       (void *)vec_flow_id_to_backend_id);
-        map_put(balancer->state->flow_to_flow_id, vec_flow, flow_index);
+        LoadBalancedFlow_map_put(balancer->state->flow_to_flow_id, vec_flow,
+                                 flow_index);
         vector_return(balancer->state->flow_heap, flow_index,
                       vec_flow); // another half is in the map
 
-      } // Doesn't matter if we can't insert
+      } else {
+        // Doesn't matter if we can't insert
+        nf_telemetry_add(NF_COUNTER_ALLOC_FAILED, 1);
+      }
       struct LoadBalancedBackend *vec_backend;
       vector_borrow(balancer->state->backends, backend_index,
                     (void **)&vec_backend);
@@ -92,7 +99,8 @@ struct LoadBalancedBackend lb_get_backend(struct LoadBalancer *balancer,
       // could use `flow_key` just as well here, but
       // current impl of symbex models does not support
       // connecting a map with its keystore.
-      map_erase(balancer->state->flow_to_flow_id, flow, (void **)&flow_key);
+      LoadBalancedFlow_map_erase(balancer->state->flow_to_flow_id, flow,
+                                 (void **)&flow_key);
 
       dchain_free_index(balancer->state->flow_chain, flow_index);
       vector_return(balancer->state->flow_heap, flow_index, (void *)flow_key);
@@ -117,8 +125,8 @@ void lb_process_heartbit(struct LoadBalancer *balancer,
                          struct rte_ether_addr mac_addr, int nic,
                          vigor_time_t now) {
   int backend_index;
-  if (map_get(balancer->state->ip_to_backend_id, &flow->src_ip,
-              &backend_index) == 0) {
+  if (ip_addr_map_get(balancer->state->ip_to_backend_id, &flow->src_ip,
+                      &backend_index) == 0) {
     if (0 != dchain_allocate_new_index(balancer->state->active_backends,
                                        &backend_index, now)) {
       struct LoadBalancedBackend *new_backend;
@@ -133,7 +141,7 @@ void lb_process_heartbit(struct LoadBalancer *balancer,
       uint32_t *ip;
       vector_borrow(balancer->state->backend_ips, backend_index, (void **)&ip);
       *ip = flow->src_ip;
-      map_put(balancer->state->ip_to_backend_id, ip, backend_index);
+      ip_addr_map_put(balancer->state->ip_to_backend_id, ip, backend_index);
       vector_return(balancer->state->backend_ips, backend_index, (void *)ip);
     }
     // Otherwise ignore this backend, we are full.
@@ -152,9 +160,13 @@ void lb_expire_flows(struct LoadBalancer *balancer, vigor_time_t time) {
   uint64_t time_u = (uint64_t)time; // OK because of the two asserts
   vigor_time_t last_time =
       time_u - balancer->flow_expiration_time * 1000; // us to ns
-  expire_items_single_map(balancer->state->flow_chain,
-                          balancer->state->flow_heap,
-                          balancer->state->flow_to_flow_id, last_time);
+  int expired = expire_items_single_map(balancer->state->flow_chain,
+                                        balancer->state->flow_heap,
+                                        balancer->state->flow_to_flow_id,
+                                        last_time);
+  nf_telemetry_add(NF_COUNTER_EXPIRED, expired);
+  nf_telemetry_set(NF_COUNTER_FLOWS,
+                   map_size(balancer->state->flow_to_flow_id));
 }
 
 void lb_expire_backends(struct LoadBalancer *balancer, vigor_time_t time) {
@@ -4,11 +4,12 @@
 #include "lb_balancer.h"
 #include "nf.h"
 #include "nf-log.h"
+#include "nf-profile.h"
 #include "nf-util.h"
 
 struct nf_config config;
 
-struct LoadBalancer *balancer;
+PER_CORE struct LoadBalancer *balancer;
 
 bool nf_init(void) {
   balancer = lb_allocate_balancer(
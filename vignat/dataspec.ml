@@ -7,7 +7,9 @@ let containers = ["fm", Map ("FlowId", "max_flows", "");
                   "heap", DChain "max_flows";
                   "max_flows", Int;
                   "start_port", Int;
+                  "ports_per_ip", Int;
                   "ext_ip", UInt32;
+                  "ext_ip_count", UInt32;
                   "nat_device", UInt32;
                   "flow_emap", EMap ("FlowId", "fm", "fv", "heap")]
 
@@ -21,13 +21,20 @@ void nf_config_init(int argc, char **argv) {
     { "eth-dest", required_argument, NULL, 'm' },
     { "expire", required_argument, NULL, 't' },
     { "extip", required_argument, NULL, 'i' },
+    { "extip-count", required_argument, NULL, 'n' },
     { "lan-dev", required_argument, NULL, 'l' },
     { "max-flows", required_argument, NULL, 'f' },
+    { "ports-per-ip", required_argument, NULL, 'p' },
+    { "source-quota", required_argument, NULL, 'q' },
     { "starting-port", required_argument, NULL, 's' },
     { "wan", required_argument, NULL, 'w' },
     { NULL, 0, NULL, 0 }
   };
 
+  config.external_addr_count = 1;
+  config.ports_per_addr = 0; // all the ports from start_port on
+  config.source_quota = 0;
+
   config.device_macs =
       (struct rte_ether_addr *)calloc(nb_devices, sizeof(struct rte_ether_addr));
   config.endpoint_macs =
@@ -39,7 +46,7 @@ void nf_config_init(int argc, char **argv) {
   }
 
   int opt;
-  while ((opt = getopt_long(argc, argv, "m:e:t:i:l:f:p:s:w:", long_options,
+  while ((opt = getopt_long(argc, argv, "m:e:t:i:n:l:f:p:q:s:w:", long_options,
                             NULL)) != EOF) {
     unsigned device;
     switch (opt) {
@@ -70,6 +77,14 @@ void nf_config_init(int argc, char **argv) {
         }
         break;
 
+      case 'n':
+        config.external_addr_count =
+            nf_util_parse_int(optarg, "extip-count", 10, '\0');
+        if (config.external_addr_count == 0) {
+          PARSE_ERROR("External IP count must be strictly positive.\n");
+        }
+        break;
+
       case 'l':
         config.lan_main_device = nf_util_parse_int(optarg, "lan-dev", 10, '\0');
         if (config.lan_main_device >= nb_devices) {
@@ -84,6 +99,19 @@ void nf_config_init(int argc, char **argv) {
         }
         break;
 
+      case 'p':
+        config.ports_per_addr =
+            nf_util_parse_int(optarg, "ports-per-ip", 10, '\0');
+        if (config.ports_per_addr == 0) {
+          PARSE_ERROR("Ports per IP must be strictly positive.\n");
+        }
+        break;
+
+      case 'q':
+        config.source_quota =
+            nf_util_parse_int(optarg, "source-quota", 10, '\0');
+        break;
+
       case 's':
         config.start_port = nf_util_parse_int(optarg, "start-port", 10, '\0');
         break;
@@ -101,6 +129,44 @@ void nf_config_init(int argc, char **argv) {
     }
   }
 
+  if (config.ports_per_addr == 0) {
+    config.ports_per_addr = 65536 - config.start_port;
+  }
+  if (config.start_port + config.ports_per_addr > 65536) {
+    PARSE_ERROR("Port range [%" PRIu16 ", %" PRIu32 ") exceeds 65535.\n",
+                config.start_port, config.start_port + config.ports_per_addr);
+  }
+  if ((uint64_t)config.external_addr + config.external_addr_count >
+      UINT32_MAX + 1ull) {
+    PARSE_ERROR("External IP range exceeds 255.255.255.255.\n");
+  }
+  // Each core gets its own slice of the ports and of the flow table,
+  // see nf_init
+  unsigned nb_cores = nf_core_count();
+  if (config.max_flows % nb_cores != 0) {
+    PARSE_ERROR("%" PRIu32 " flows cannot be split over %u cores.\n",
+                config.max_flows, nb_cores);
+  }
+#ifdef CAPACITY_POW2
+  // The flow table of each core is a map, see map_allocate
+  uint32_t flows_per_core = config.max_flows / nb_cores;
+  if ((flows_per_core & (flows_per_core - 1)) != 0) {
+    PARSE_ERROR("%" PRIu32 " flows over %u cores make %" PRIu32 " flows per "
+                "core, which is not a power of 2.\n",
+                config.max_flows, nb_cores, flows_per_core);
+  }
+#endif // CAPACITY_POW2
+  // Each flow gets its own (external IP, external port) pair,
+  // see flow_manager_allocate_flow
+  if ((uint64_t)config.external_addr_count *
+          (config.ports_per_addr / nb_cores) <
+      config.max_flows / nb_cores) {
+    PARSE_ERROR("%" PRIu32 " IPs with %" PRIu32 " ports each cannot hold "
+                "%" PRIu32 " flows over %u cores.\n",
+                config.external_addr_count, config.ports_per_addr,
+                config.max_flows, nb_cores);
+  }
+
   // Reset getopt
   optind = 1;
 }
@@ -111,10 +177,16 @@ void nf_config_usage(void) {
           "\t--eth-dest <device>,<mac>: MAC address of the endpoint linked to "
           "a device.\n"
           "\t--expire <time>: flow expiration time (us).\n"
-          "\t--extip <ip>: external IP address.\n"
+          "\t--extip <ip>: first external IP address.\n"
+          "\t--extip-count <n>: number of consecutive external IP addresses, "
+          "default: 1.\n"
           "\t--lan-dev <device>: set device to be the main LAN device (for "
           "non-NAT).\n"
           "\t--max-flows <n>: flow table capacity.\n"
+          "\t--ports-per-ip <n>: number of external ports per external IP "
+          "address, default: all ports from the starting port.\n"
+          "\t--source-quota <n>: flows a source IP may open per second once "
+          "the flow table is half full, default: 0 (no limit).\n"
           "\t--starting-port <n>: start of the port range for external ports.\n"
           "\t--wan <device>: set device to be the external one.\n");
 }
@@ -129,6 +201,7 @@ void nf_config_print(void) {
   char *ext_ip_str = nf_rte_ipv4_to_str(config.external_addr);
   NF_INFO("External IP: %s", ext_ip_str);
   free(ext_ip_str);
+  NF_INFO("External IP count: %" PRIu32, config.external_addr_count);
 
   uint16_t nb_devices = rte_eth_dev_count_avail();
   for (uint16_t dev = 0; dev < nb_devices; dev++) {
@@ -143,8 +216,11 @@ void nf_config_print(void) {
   }
 
   NF_INFO("Starting port: %" PRIu16, config.start_port);
+  NF_INFO("Ports per IP: %" PRIu32, config.ports_per_addr);
   NF_INFO("Expiration time: %" PRIu32 "us", config.expiration_time);
   NF_INFO("Max flows: %" PRIu32, config.max_flows);
+  NF_INFO("Source quota: %" PRIu32, config.source_quota);
+  NF_INFO("Cores: %u", nf_core_count());
 
   NF_INFO("\n--- --- ------ ---\n");
 }
@@ -11,9 +11,13 @@ struct nf_config {
   // WAN device, i.e. external
   uint16_t wan_device;
 
-  // External IP address
+  // First external IP address, in host byte order
   uint32_t external_addr;
 
+  // Number of external IP addresses, i.e. the NAT uses
+  // [external_addr, external_addr + external_addr_count)
+  uint32_t external_addr_count;
+
   // MAC addresses of devices
   struct rte_ether_addr *device_macs;
 
@@ -21,12 +25,20 @@ struct nf_config {
   struct rte_ether_addr *endpoint_macs;
 
   // External port at which to start allocating flows
-  // i.e. ports will be allocated in [start_port, start_port + max_flows]
+  // i.e. ports will be allocated in [start_port, start_port + ports_per_addr)
+  // on each external address
   uint16_t start_port;
 
+  // Number of external ports per external address
+  uint32_t ports_per_addr;
+
   // Expiration time of flows in microseconds
   uint32_t expiration_time;
 
+  // Flows a source IP may open per second once the flow table is half full,
+  // 0 for no limit
+  uint32_t source_quota;
+
   // Size of the flow table
   uint32_t max_flows;
 };
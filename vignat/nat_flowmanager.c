@@ -5,51 +5,119 @@
 #include <string.h> //for memcpy
 #include <rte_ethdev.h>
 
+#include "libvig/unverified/count-min-sketch.h"
 #include "libvig/verified/double-chain.h"
 #include "libvig/verified/map.h"
 #include "libvig/verified/vector.h"
 #include "libvig/verified/expirator.h"
 
+#include "nf-profile.h"
+#include "nf-telemetry.h"
 #include "state.h"
 
+// Sources are counted in one-second periods, see flow_manager_admit
+#define SOURCE_SKETCH_WIDTH_LOG2 12
+#define SOURCE_SKETCH_PERIOD 1000000000 // nanoseconds
+
 struct FlowManager {
   struct State *state;
   uint32_t expiration_time; /*nanoseconds*/
+
+  // Admission control, see flow_manager_admit
+  struct CountMinSketch *sources;
+  uint32_t source_quota;
+  uint32_t flow_count;
+  uint32_t max_flows;
 };
 
 struct FlowManager *flow_manager_allocate(uint16_t starting_port,
-                                          uint32_t nat_ip, uint16_t nat_device,
+                                          uint32_t ports_per_ip,
+                                          uint32_t nat_ip,
+                                          uint32_t nat_ip_count,
+                                          uint16_t nat_device,
                                           uint32_t expiration_time,
+                                          uint32_t source_quota,
                                           uint64_t max_flows) {
   struct FlowManager *manager =
       (struct FlowManager *)malloc(sizeof(struct FlowManager));
   if (manager == NULL) {
     return NULL;
   }
-  manager->state = alloc_state(max_flows, starting_port, nat_ip, nat_device);
+  manager->state = alloc_state(max_flows, starting_port, ports_per_ip, nat_ip,
+                               nat_ip_count, nat_device);
   if (manager->state == NULL) {
     return NULL;
   }
 
   manager->expiration_time = expiration_time;
 
+  manager->sources = NULL;
+  if (source_quota != 0 &&
+      !cms_allocate(SOURCE_SKETCH_WIDTH_LOG2, SOURCE_SKETCH_PERIOD,
+                    &manager->sources)) {
+    return NULL;
+  }
+  manager->source_quota = source_quota;
+  manager->flow_count = 0;
+  manager->max_flows = max_flows;
+
   return manager;
 }
 
+static void flow_manager_index_to_external(struct FlowManager *manager,
+                                           int index, uint32_t *external_ip,
+                                           uint16_t *external_port) {
+  uint32_t ports_per_ip = manager->state->ports_per_ip;
+  *external_ip = manager->state->ext_ip + (uint32_t)index / ports_per_ip;
+  *external_port = manager->state->start_port + (uint32_t)index % ports_per_ip;
+}
+
+// Once the table is half full, a source that opened more than source_quota
+// flows in the current period cannot open new ones until the next period.
+// Below that occupancy nothing is refused, so a lone heavy but legitimate
+// host is not penalized.
+static bool flow_manager_admit(struct FlowManager *manager, struct FlowId *id,
+                               vigor_time_t time) {
+  if (manager->sources == NULL) {
+    return true;
+  }
+
+  return manager->flow_count < manager->max_flows / 2 ||
+         cms_estimate(manager->sources, id->src_ip, time) <
+             manager->source_quota;
+}
+
+// Counts a flow the source opened, once it got a slot in the table, so that
+// attempts refused because the table is full do not use up its quota
+static void flow_manager_admitted(struct FlowManager *manager,
+                                  struct FlowId *id, vigor_time_t time) {
+  if (manager->sources != NULL) {
+    cms_add(manager->sources, id->src_ip, time);
+  }
+}
+
 bool flow_manager_allocate_flow(struct FlowManager *manager, struct FlowId *id,
                                 uint16_t internal_device, vigor_time_t time,
+                                uint32_t *external_ip,
                                 uint16_t *external_port) {
+  if (!flow_manager_admit(manager, id, time)) {
+    return false;
+  }
+
   int index;
   if (dchain_allocate_new_index(manager->state->heap, &index, time) == 0) {
+    nf_telemetry_add(NF_COUNTER_ALLOC_FAILED, 1);
     return false;
   }
+  manager->flow_count++;
+  flow_manager_admitted(manager, id, time);
 
-  *external_port = manager->state->start_port + index;
+  flow_manager_index_to_external(manager, index, external_ip, external_port);
 
   struct FlowId *key = 0;
   vector_borrow(manager->state->fv, index, (void **)&key);
   memcpy((void *)key, (void *)id, sizeof(struct FlowId));
-  map_put(manager->state->fm, key, index);
+  FlowId_map_put(manager->state->fm, key, index);
   vector_return(manager->state->fv, index, key);
   return true;
 }
@@ -60,25 +128,60 @@ void flow_manager_expire(struct FlowManager *manager, vigor_time_t time) {
   uint64_t time_u = (uint64_t)time; // OK because of the two asserts
   vigor_time_t last_time =
       time_u - manager->expiration_time * 1000; // convert us to ns
-  expire_items_single_map(manager->state->heap, manager->state->fv,
-                          manager->state->fm, last_time);
+  int expired = expire_items_single_map(manager->state->heap, manager->state->fv,
+                                        manager->state->fm, last_time);
+  manager->flow_count -= expired;
+  nf_telemetry_add(NF_COUNTER_EXPIRED, expired);
+  nf_telemetry_set(NF_COUNTER_FLOWS, manager->flow_count);
 }
 
 bool flow_manager_get_internal(struct FlowManager *manager, struct FlowId *id,
-                               vigor_time_t time, uint16_t *external_port) {
+                               vigor_time_t time, uint32_t *external_ip,
+                               uint16_t *external_port) {
   int index;
-  if (map_get(manager->state->fm, id, &index) == 0) {
+  if (FlowId_map_get(manager->state->fm, id, &index) == 0) {
     return false;
   }
-  *external_port = index + manager->state->start_port;
+  flow_manager_index_to_external(manager, index, external_ip, external_port);
   dchain_rejuvenate_index(manager->state->heap, index, time);
   return true;
 }
 
+#ifndef KLEE_VERIFICATION
+bool flow_manager_get_internal_with_hash(struct FlowManager *manager,
+                                         struct FlowId *id, unsigned hash,
+                                         vigor_time_t time,
+                                         uint32_t *external_ip,
+                                         uint16_t *external_port) {
+  int index;
+  if (FlowId_map_get_with_hash(manager->state->fm, id, hash, &index) == 0) {
+    return false;
+  }
+  flow_manager_index_to_external(manager, index, external_ip, external_port);
+  dchain_rejuvenate_index(manager->state->heap, index, time);
+  return true;
+}
+#endif // KLEE_VERIFICATION
+
 bool flow_manager_get_external(struct FlowManager *manager,
-                               uint16_t external_port, vigor_time_t time,
-                               struct FlowId *out_flow) {
-  int index = external_port - manager->state->start_port;
+                               uint32_t external_ip, uint16_t external_port,
+                               vigor_time_t time, struct FlowId *out_flow) {
+  // Both offsets wrap around to large values if below the start of the range
+  uint32_t ip_offset = external_ip - manager->state->ext_ip;
+  uint32_t port_offset =
+      (uint16_t)(external_port - manager->state->start_port);
+  if ((ip_offset >= manager->state->ext_ip_count) |
+      (port_offset >= (uint32_t)manager->state->ports_per_ip)) {
+    return false;
+  }
+
+  uint64_t index_long =
+      (uint64_t)ip_offset * manager->state->ports_per_ip + port_offset;
+  if (index_long >= (uint64_t)manager->state->max_flows) {
+    return false;
+  }
+
+  int index = index_long;
   if (dchain_is_index_allocated(manager->state->heap, index) == 0) {
     return false;
   }
@@ -9,21 +9,40 @@
 
 struct FlowManager;
 
+// External (IP, port) pairs are derived from the flow index: the flow at
+// index i uses the address nat_ip + i / ports_per_ip and the port
+// starting_port + i % ports_per_ip, so looking a flow up from the WAN side
+// does not need another table. IPs are in host byte order.
+// If source_quota is not 0, once the table is half full each source IP may
+// only open source_quota flows per second, so that a single host cannot
+// exhaust the external ports.
 struct FlowManager *
-flow_manager_allocate(uint16_t starting_port, uint32_t nat_ip,
+flow_manager_allocate(uint16_t starting_port, uint32_t ports_per_ip,
+                      uint32_t nat_ip, uint32_t nat_ip_count,
                       uint16_t nat_device, /* NOTE: only required for verif to
                                               show that internal != external;
                                               can be removed once "our NAT" ==
                                               router + "only NAT" */
-                      uint32_t expiration_time, uint64_t max_flows);
+                      uint32_t expiration_time, uint32_t source_quota,
+                      uint64_t max_flows);
 
 bool flow_manager_allocate_flow(struct FlowManager *manager, struct FlowId *id,
                                 uint16_t internal_device, vigor_time_t time,
-                                uint16_t *external_port);
+                                uint32_t *external_ip, uint16_t *external_port);
 void flow_manager_expire(struct FlowManager *manager, vigor_time_t time);
 bool flow_manager_get_internal(struct FlowManager *manager, struct FlowId *id,
-                               vigor_time_t time, uint16_t *external_port);
+                               vigor_time_t time, uint32_t *external_ip,
+                               uint16_t *external_port);
+#ifndef KLEE_VERIFICATION
+// Same as flow_manager_get_internal, with FlowId_hash(id) already computed,
+// e.g. for a whole burst by FlowId_hash_bulk. Unverified.
+bool flow_manager_get_internal_with_hash(struct FlowManager *manager,
+                                         struct FlowId *id, unsigned hash,
+                                         vigor_time_t time,
+                                         uint32_t *external_ip,
+                                         uint16_t *external_port);
+#endif // KLEE_VERIFICATION
 bool flow_manager_get_external(struct FlowManager *manager,
-                               uint16_t external_port, vigor_time_t time,
-                               struct FlowId *out_flow);
+                               uint32_t external_ip, uint16_t external_port,
+                               vigor_time_t time, struct FlowId *out_flow);
 #endif //_FLOWMANAGER_H_INCLUDED_
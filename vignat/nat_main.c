@@ -1,22 +1,161 @@
 #include <stdlib.h>
+#include <string.h>
+
+#include <rte_byteorder.h>
 
 #include "nf.h"
 #include "flow.h.gen.h"
 #include "nat_flowmanager.h"
 #include "nat_config.h"
 #include "nf-log.h"
+#include "nf-profile.h"
 #include "nf-util.h"
 
 struct nf_config config;
 
-struct FlowManager *flow_manager;
+PER_CORE struct FlowManager *flow_manager;
+
+// With several cores, each one owns a disjoint slice of the external ports of
+// every external address, and a matching share of the flow table, since the
+// external port of a flow is derived from its index in the table. Replies are
+// then steered to the core owning their destination port, see nat_steer.
+static uint32_t nat_ports_per_core(void) {
+  return config.ports_per_addr / nf_core_count();
+}
+
+#ifndef KLEE_VERIFICATION
+// Finds the headers nf_process reads, for the unverified code that looks at
+// packets before it does; false if the packet is not TCP/UDP over IPv4
+static bool nat_peek_headers(uint8_t* buffer, uint16_t packet_length,
+                             struct rte_ipv4_hdr** ipv4_header_out,
+                             struct tcpudp_hdr** tcpudp_header_out) {
+  struct rte_ether_hdr *rte_ether_header = (struct rte_ether_hdr *)buffer;
+  if (packet_length < sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) ||
+      !nf_has_rte_ipv4_header(rte_ether_header)) {
+    return false;
+  }
+  struct rte_ipv4_hdr *rte_ipv4_header =
+      (struct rte_ipv4_hdr *)(rte_ether_header + 1);
+  size_t tcpudp_offset = sizeof(struct rte_ether_hdr) +
+                         (rte_ipv4_header->version_ihl & 0x0f) * WORD_SIZE;
+  if (!nf_has_tcpudp_header(rte_ipv4_header) ||
+      packet_length < tcpudp_offset + sizeof(struct tcpudp_hdr)) {
+    return false;
+  }
+  *ipv4_header_out = rte_ipv4_header;
+  *tcpudp_header_out = (struct tcpudp_hdr *)(buffer + tcpudp_offset);
+  return true;
+}
+#endif // KLEE_VERIFICATION
+
+// FlowId_hash_bulk only exists with packed keys, see codegen/main.ml
+#if defined(PACKED_KEYS) && !defined(KLEE_VERIFICATION)
+// The FlowIds of the LAN packets of the burst being processed, with their
+// hashes, which nat_hash_burst computes all at once so that nf_process need
+// not hash them one by one, see nf_set_burst_hook
+#define NAT_BURST_SIZE 64
+struct nat_burst {
+  uint8_t* buffers[NAT_BURST_SIZE];
+  struct FlowId ids[NAT_BURST_SIZE];
+  unsigned hashes[NAT_BURST_SIZE];
+  uint16_t count;
+  // nf_process gets the packets in the order of the burst, so it only
+  // needs to look from there
+  uint16_t next;
+};
+
+PER_CORE struct nat_burst nat_burst;
+
+static void nat_hash_burst(uint16_t* devices, uint8_t** buffers,
+                           uint16_t* packet_lengths, uint16_t count) {
+  void* keys[NAT_BURST_SIZE];
+  nat_burst.count = 0;
+  nat_burst.next = 0;
+  for (uint16_t n = 0; n < count && nat_burst.count < NAT_BURST_SIZE; n++) {
+    struct rte_ipv4_hdr *rte_ipv4_header;
+    struct tcpudp_hdr *tcpudp_header;
+    if (devices[n] == config.wan_device ||
+        !nat_peek_headers(buffers[n], packet_lengths[n], &rte_ipv4_header,
+                          &tcpudp_header)) {
+      continue;
+    }
+
+    // As in nf_process
+    struct FlowId *id = &nat_burst.ids[nat_burst.count];
+    memset(id, 0, sizeof(struct FlowId));
+    id->src_port = tcpudp_header->src_port;
+    id->dst_port = tcpudp_header->dst_port;
+    id->src_ip = rte_ipv4_header->src_addr;
+    id->dst_ip = rte_ipv4_header->dst_addr;
+    id->protocol = rte_ipv4_header->next_proto_id;
+    id->internal_device = devices[n];
+    nat_burst.buffers[nat_burst.count] = buffers[n];
+    keys[nat_burst.count] = id;
+    nat_burst.count++;
+  }
+  FlowId_hash_bulk(keys, nat_burst.count, nat_burst.hashes);
+}
+
+// Finds the hash nat_hash_burst computed for the packet in buffer, if the
+// packet is in the current burst and its FlowId is indeed id
+static bool nat_burst_hash(uint8_t* buffer, struct FlowId* id,
+                           unsigned* hash_out) {
+  while (nat_burst.next < nat_burst.count) {
+    uint16_t n = nat_burst.next++;
+    if (nat_burst.buffers[n] == buffer) {
+      *hash_out = nat_burst.hashes[n];
+      return FlowId_eq(&nat_burst.ids[n], id);
+    }
+  }
+  return false;
+}
+#endif // PACKED_KEYS
+
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+static int nat_steer(uint16_t device, uint8_t* buffer, uint16_t packet_length) {
+  struct rte_ipv4_hdr *rte_ipv4_header;
+  struct tcpudp_hdr *tcpudp_header;
+  if (device != config.wan_device ||
+      !nat_peek_headers(buffer, packet_length, &rte_ipv4_header,
+                        &tcpudp_header)) {
+    return -1;
+  }
+
+  // Same raw port as in flow_manager_get_external
+  uint32_t port_offset =
+      (uint16_t)(tcpudp_header->dst_port - config.start_port);
+  uint32_t core = port_offset / nat_ports_per_core();
+  return core < nf_core_count() ? (int)core : -1;
+}
+#endif // MULTICORE
 
 bool nf_init(void) {
+  uint32_t ports_per_core = nat_ports_per_core();
+  uint16_t first_port = config.start_port + nf_core_index() * ports_per_core;
+
   flow_manager = flow_manager_allocate(
-      config.start_port, config.external_addr, config.wan_device,
-      config.expiration_time, config.max_flows);
+      first_port, ports_per_core, config.external_addr,
+      config.external_addr_count, config.wan_device, config.expiration_time,
+      config.source_quota, config.max_flows / nf_core_count());
+  if (flow_manager == NULL) {
+    return false;
+  }
 
-  return flow_manager != NULL;
+#if defined(PACKED_KEYS) && !defined(KLEE_VERIFICATION)
+  nf_set_burst_hook(nat_hash_burst);
+#endif // PACKED_KEYS
+
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+  if (nf_core_count() > 1) {
+    nf_set_steering(nat_steer);
+    if (!nf_steer_dst_ports(config.wan_device, first_port, ports_per_core,
+                            nf_core_index())) {
+      NF_INFO("Core %u steers its replies in software", nf_core_index());
+    }
+  }
+#endif // MULTICORE
+
+  return true;
 }
 
 int nf_process(uint16_t device, uint8_t* buffer, uint16_t packet_length, vigor_time_t now) {
@@ -47,7 +186,9 @@ int nf_process(uint16_t device, uint8_t* buffer, uint16_t packet_length, vigor_t
     NF_DEBUG("Device %" PRIu16 " is external", device);
 
     struct FlowId internal_flow;
-    if (flow_manager_get_external(flow_manager, tcpudp_header->dst_port, now,
+    if (flow_manager_get_external(flow_manager,
+                                  rte_be_to_cpu_32(rte_ipv4_header->dst_addr),
+                                  tcpudp_header->dst_port, now,
                                   &internal_flow)) {
       NF_DEBUG("Found internal flow.");
       LOG_FLOWID(&internal_flow, NF_DEBUG);
@@ -80,12 +221,26 @@ int nf_process(uint16_t device, uint8_t* buffer, uint16_t packet_length, vigor_t
     NF_DEBUG("Device %" PRIu16 " is internal (not %" PRIu16 ")", device,
              config.wan_device);
 
+    uint32_t external_addr;
     uint16_t external_port;
-    if (!flow_manager_get_internal(flow_manager, &id, now, &external_port)) {
+    bool found;
+#if defined(PACKED_KEYS) && !defined(KLEE_VERIFICATION)
+    unsigned hash;
+    if (nat_burst_hash(buffer, &id, &hash)) {
+      found = flow_manager_get_internal_with_hash(flow_manager, &id, hash, now,
+                                                  &external_addr,
+                                                  &external_port);
+    } else
+#endif // PACKED_KEYS
+    {
+      found = flow_manager_get_internal(flow_manager, &id, now,
+                                        &external_addr, &external_port);
+    }
+    if (!found) {
       NF_DEBUG("New flow");
 
       if (!flow_manager_allocate_flow(flow_manager, &id, device, now,
-                                      &external_port)) {
+                                      &external_addr, &external_port)) {
         NF_DEBUG("No space for the flow, dropping");
         return device;
       }
@@ -93,7 +248,7 @@ int nf_process(uint16_t device, uint8_t* buffer, uint16_t packet_length, vigor_t
 
     NF_DEBUG("Forwarding from ext port:%d", external_port);
 
-    rte_ipv4_header->src_addr = config.external_addr;
+    rte_ipv4_header->src_addr = rte_cpu_to_be_32(external_addr);
     tcpudp_header->src_port = external_port;
     dst_device = config.wan_device;
   }
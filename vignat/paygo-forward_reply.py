@@ -8,8 +8,13 @@ if a_packet_received:
 h3 = pop_header(tcpudp, on_mismatch=([],[]))
 h2 = pop_header(ipv4, on_mismatch=([],[]))
 h1 = pop_header(ether, on_mismatch=([],[]))
-flow_indx = h3.dst_port - start_port
-if received_on_port == EXT_PORT and flow_emap.has_idx(flow_indx):
+# External addresses are kept in host byte order
+ext_addr = (((h2.daddr & 0xFF) << 24) | ((h2.daddr & 0xFF00) << 8) |
+            ((h2.daddr >> 8) & 0xFF00) | ((h2.daddr >> 24) & 0xFF))
+flow_indx = (ext_addr - ext_ip) * ports_per_ip + h3.dst_port - start_port
+if received_on_port == EXT_PORT and (ext_ip <= ext_addr and ext_addr < ext_ip + ext_ip_count and
+                                     start_port <= h3.dst_port and h3.dst_port < start_port + ports_per_ip and
+                                     flow_indx < max_flows and flow_emap.has_idx(flow_indx)):
     internal_flow = flow_emap.get_key(flow_indx)
     flow_emap.refresh_idx(flow_indx, now)
     if (internal_flow.dip == h2.saddr and
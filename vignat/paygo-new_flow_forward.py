@@ -1,6 +1,5 @@
 from state import flow_emap
 EXP_TIME = 10 * 1000
-EXT_IP_ADDR = ext_ip
 EXT_PORT = 1
 if a_packet_received:
     flow_emap.expire_all(now - EXP_TIME)
@@ -14,9 +13,14 @@ if (received_on_port != EXT_PORT and
     not flow_emap.full()):
     idx = the_index_allocated
     flow_emap.add(internal_flow_id, idx, now)
+    # The external (IP, port) pair is derived from the index
+    ext_addr = ext_ip + idx / ports_per_ip
+    ext_port = start_port + idx - (idx / ports_per_ip) * ports_per_ip
+    ext_addr_be = (((ext_addr & 0xFF) << 24) | ((ext_addr & 0xFF00) << 8) |
+                   ((ext_addr >> 8) & 0xFF00) | ((ext_addr >> 24) & 0xFF))
     return ([EXT_PORT],
             [ether(h1, saddr=..., daddr=...),
-             ipv4(h2, cksum=..., saddr=EXT_IP_ADDR),
-             tcpudp(h3, src_port=idx + start_port)])
+             ipv4(h2, cksum=..., saddr=ext_addr_be),
+             tcpudp(h3, src_port=ext_port)])
 else:
     pass
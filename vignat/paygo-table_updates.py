@@ -8,8 +8,13 @@ h2 = pop_header(ipv4, on_mismatch=([],[]))
 h1 = pop_header(ether, on_mismatch=([],[]))
 
 if received_on_port == EXT_PORT:
-    flow_indx = h3.dst_port - start_port
-    if flow_emap.has_idx(flow_indx): # Flow is present in the table
+    # External addresses are kept in host byte order
+    ext_addr = (((h2.daddr & 0xFF) << 24) | ((h2.daddr & 0xFF00) << 8) |
+                ((h2.daddr >> 8) & 0xFF00) | ((h2.daddr >> 24) & 0xFF))
+    flow_indx = (ext_addr - ext_ip) * ports_per_ip + h3.dst_port - start_port
+    if (ext_ip <= ext_addr and ext_addr < ext_ip + ext_ip_count and
+        start_port <= h3.dst_port and h3.dst_port < start_port + ports_per_ip and
+        flow_indx < max_flows and flow_emap.has_idx(flow_indx)): # Flow is present in the table
         flow_emap.refresh_idx(flow_indx, now)
 else: # packet from the internal network
     internal_flow_id = FlowIdc(h3.src_port, h3.dst_port, h2.saddr, h2.daddr, received_on_port, h2.npid)
@@ -15,7 +15,6 @@
 # outbound TCP non-SYN packets unspecified.
 from state import flow_emap
 EXP_TIME = 10 * 1000
-EXT_IP_ADDR = ext_ip
 EXT_PORT = 1
 
 if a_packet_received:
@@ -28,8 +27,14 @@ assert a_packet_received
 assert h1.type == 8 # big-endian 0x0800 -> IPv4
 assert h2.npid == 6 or h2.npid == 17 # 6/17 -> TCP/UDP
 if received_on_port == EXT_PORT:
-    flow_indx = h3.dst_port - start_port
-    if flow_emap.has_idx(flow_indx): # Flow is present in the table
+    # External addresses are kept in host byte order
+    ext_addr = (((h2.daddr & 0xFF) << 24) | ((h2.daddr & 0xFF00) << 8) |
+                ((h2.daddr >> 8) & 0xFF00) | ((h2.daddr >> 24) & 0xFF))
+    if (ext_addr < ext_ip or ext_ip + ext_ip_count <= ext_addr or
+        h3.dst_port < start_port or start_port + ports_per_ip <= h3.dst_port):
+        return ([],[])
+    flow_indx = (ext_addr - ext_ip) * ports_per_ip + h3.dst_port - start_port
+    if flow_indx < max_flows and flow_emap.has_idx(flow_indx): # Flow is present in the table
         internal_flow = flow_emap.get_key(flow_indx)
         flow_emap.refresh_idx(flow_indx, now)
         if (internal_flow.dip != h2.saddr or
@@ -48,17 +53,27 @@ else: # packet from the internal network
     if flow_emap.has(internal_flow_id): # flow present in the table
         idx = flow_emap.get(internal_flow_id)
         flow_emap.refresh_idx(idx, now)
+        # The external (IP, port) pair is derived from the index
+        ext_addr = ext_ip + idx / ports_per_ip
+        ext_port = start_port + idx - (idx / ports_per_ip) * ports_per_ip
+        ext_addr_be = (((ext_addr & 0xFF) << 24) | ((ext_addr & 0xFF00) << 8) |
+                       ((ext_addr >> 8) & 0xFF00) | ((ext_addr >> 24) & 0xFF))
         return ([EXT_PORT],
                 [ether(h1, saddr=..., daddr=...),
-                 ipv4(h2, cksum=..., saddr=EXT_IP_ADDR),
-                 tcpudp(h3, src_port=idx + start_port)])
+                 ipv4(h2, cksum=..., saddr=ext_addr_be),
+                 tcpudp(h3, src_port=ext_port)])
     else: # No flow in the table
         if flow_emap.full(): # flowtable overflow
             return ([],[])
         else:
             idx = the_index_allocated
             flow_emap.add(internal_flow_id, idx, now)
+            # The external (IP, port) pair is derived from the index
+            ext_addr = ext_ip + idx / ports_per_ip
+            ext_port = start_port + idx - (idx / ports_per_ip) * ports_per_ip
+            ext_addr_be = (((ext_addr & 0xFF) << 24) | ((ext_addr & 0xFF00) << 8) |
+                           ((ext_addr >> 8) & 0xFF00) | ((ext_addr >> 24) & 0xFF))
             return ([EXT_PORT],
                     [ether(h1, saddr=..., daddr=...),
-                     ipv4(h2, cksum=..., saddr=EXT_IP_ADDR),
-                     tcpudp(h3, src_port=idx + start_port)])
+                     ipv4(h2, cksum=..., saddr=ext_addr_be),
+                     tcpudp(h3, src_port=ext_port)])
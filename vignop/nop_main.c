@@ -1,6 +1,7 @@
 #include "nat_config.h"
 #include "nf.h"
 #include "nf-util.h"
+#include "nf-profile.h"
 
 struct nf_config config;
 
@@ -13,6 +13,7 @@ const uint16_t DEFAULT_WAN = 0;
 const uint64_t DEFAULT_RATE = 1000000; // 1MB/s
 const uint64_t DEFAULT_BURST = 100000; // 100kB
 const uint32_t DEFAULT_CAPACITY = 128; // IPs
+const uint8_t DEFAULT_YELLOW_DSCP = 1; // Lower effort, RFC 8622
 
 #define PARSE_ERROR(format, ...)          \
   nf_config_usage();                      \
@@ -26,6 +27,17 @@ void nf_config_init(int argc, char **argv) {
   config.rate = DEFAULT_RATE;             // B/s
   config.burst = DEFAULT_BURST;           // B
   config.dyn_capacity = DEFAULT_CAPACITY; // MAC addresses
+  config.subnets_fname[0] = '\0';         // everything is policed per IP
+  config.peak_rate = 0;                   // single rate
+  config.peak_burst = 0;
+  config.yellow_dscp = DEFAULT_YELLOW_DSCP;
+  config.wan_key = POLICER_KEY_DST_IP;
+  config.lan_key = POLICER_KEY_NONE;      // LAN to WAN is not policed
+  config.lan_capacity = DEFAULT_CAPACITY;
+  config.lan_rate = 0;                    // same as the WAN ones
+  config.lan_burst = 0;
+  config.lan_peak_rate = 0;
+  config.lan_peak_burst = 0;
 
   unsigned nb_devices = rte_eth_dev_count_avail();
 
@@ -34,11 +46,22 @@ void nf_config_init(int argc, char **argv) {
                                    { "rate", required_argument, NULL, 'r' },
                                    { "burst", required_argument, NULL, 'b' },
                                    { "capacity", required_argument, NULL, 'c' },
+                                   { "subnets", required_argument, NULL, 's' },
+                                   { "peak-rate", required_argument, NULL, 'R' },
+                                   { "peak-burst", required_argument, NULL, 'B' },
+                                   { "yellow-dscp", required_argument, NULL, 'd' },
+                                   { "wan-key", required_argument, NULL, 'k' },
+                                   { "lan-key", required_argument, NULL, 'K' },
+                                   { "lan-capacity", required_argument, NULL, 'C' },
+                                   { "lan-rate", required_argument, NULL, 'x' },
+                                   { "lan-burst", required_argument, NULL, 'y' },
+                                   { "lan-peak-rate", required_argument, NULL, 'X' },
+                                   { "lan-peak-burst", required_argument, NULL, 'Y' },
                                    { NULL, 0, NULL, 0 } };
 
   int opt;
-  while ((opt = getopt_long(argc, argv, "l:w:r:b:c:", long_options, NULL)) !=
-         EOF) {
+  while ((opt = getopt_long(argc, argv, "l:w:r:b:c:s:R:B:d:k:K:C:x:y:X:Y:",
+                            long_options, NULL)) != EOF) {
     switch (opt) {
       case 'l':
         config.lan_device = nf_util_parse_int(optarg, "lan", 10, '\0');
@@ -75,11 +98,114 @@ void nf_config_init(int argc, char **argv) {
         }
         break;
 
+      case 's':
+        strncpy(config.subnets_fname, optarg, CONFIG_FNAME_LEN - 1);
+        config.subnets_fname[CONFIG_FNAME_LEN - 1] = '\0';
+        break;
+
+      case 'R':
+        config.peak_rate = nf_util_parse_int(optarg, "peak-rate", 10, '\0');
+        break;
+
+      case 'B':
+        config.peak_burst = nf_util_parse_int(optarg, "peak-burst", 10, '\0');
+        break;
+
+      case 'd':
+        config.yellow_dscp = nf_util_parse_int(optarg, "yellow-dscp", 10, '\0');
+        if (config.yellow_dscp > 63) {
+          PARSE_ERROR("DSCP values are 6-bit.\n");
+        }
+        break;
+
+      case 'k':
+        if (!policer_key_parse(optarg, &config.wan_key)) {
+          PARSE_ERROR("Invalid WAN policing key.\n");
+        }
+        break;
+
+      case 'K':
+        if (!policer_key_parse(optarg, &config.lan_key)) {
+          PARSE_ERROR("Invalid LAN policing key.\n");
+        }
+        break;
+
+      case 'C':
+        config.lan_capacity =
+            nf_util_parse_int(optarg, "lan-capacity", 10, '\0');
+        if (config.lan_capacity <= 0) {
+          PARSE_ERROR("Flow table size must be strictly positive.\n");
+        }
+        break;
+
+      case 'x':
+        config.lan_rate = nf_util_parse_int(optarg, "lan-rate", 10, '\0');
+        if (config.lan_rate == 0) {
+          PARSE_ERROR("Policer rate must be strictly positive.\n");
+        }
+        break;
+
+      case 'y':
+        config.lan_burst = nf_util_parse_int(optarg, "lan-burst", 10, '\0');
+        if (config.lan_burst == 0) {
+          PARSE_ERROR("Policer burst size must be strictly positive.\n");
+        }
+        break;
+
+      case 'X':
+        config.lan_peak_rate =
+            nf_util_parse_int(optarg, "lan-peak-rate", 10, '\0');
+        break;
+
+      case 'Y':
+        config.lan_peak_burst =
+            nf_util_parse_int(optarg, "lan-peak-burst", 10, '\0');
+        break;
+
       default:
         PARSE_ERROR("Unknown option %c", opt);
     }
   }
 
+  config.refill_time = config.burst * VIGOR_TIME_SECONDS_MULTIPLIER / config.rate;
+
+  if (config.lan_rate == 0) {
+    config.lan_rate = config.rate;
+  }
+  if (config.lan_burst == 0) {
+    config.lan_burst = config.burst;
+  }
+
+  // Without a peak rate and burst, meters police at a single rate
+  config.wan_rates = (struct policer_rates){
+    .rate = config.rate,
+    .burst = config.burst,
+    .peak_rate = config.peak_rate == 0 ? config.rate : config.peak_rate,
+    .peak_burst = config.peak_burst == 0 ? config.burst : config.peak_burst,
+  };
+  config.lan_rates = (struct policer_rates){
+    .rate = config.lan_rate,
+    .burst = config.lan_burst,
+    .peak_rate =
+        config.lan_peak_rate == 0 ? config.lan_rate : config.lan_peak_rate,
+    .peak_burst =
+        config.lan_peak_burst == 0 ? config.lan_burst : config.lan_peak_burst,
+  };
+  // The verified policer has no such limits, only the meters do
+  if (!policer_rates_init(&config.wan_rates) &&
+      (config.wan_key != POLICER_KEY_DST_IP || config.peak_rate != 0 ||
+       config.peak_burst != 0)) {
+    PARSE_ERROR("The peak rate must be at least the rate, and both bursts "
+                "at most %" PRIu64 ".\n",
+                UINT64_MAX / 2 / VIGOR_TIME_SECONDS_MULTIPLIER);
+  }
+  if (!policer_rates_init(&config.lan_rates) &&
+      config.lan_key != POLICER_KEY_NONE) {
+    PARSE_ERROR("The LAN peak rate must be at least the LAN rate, and both "
+                "LAN bursts at most %" PRIu64 ".\n",
+                UINT64_MAX / 2 / VIGOR_TIME_SECONDS_MULTIPLIER);
+  }
+
   // Reset getopt
   optind = 1;
 }
@@ -96,9 +222,28 @@ void nf_config_usage(void) {
           "\t--burst <size>: policer burst size in bytes,"
           " default: %" PRIu64 ".\n"
           "\t--capacity <n>: policer table capacity,"
-          " default: %" PRIu32 ".\n",
+          " default: %" PRIu32 ".\n"
+          "\t--subnets <fname>: per-subnet policing rules, one"
+          " \"<prefix>/<length> <rate> <burst> [<peak rate> <peak burst>]\""
+          " per line, default: none.\n"
+          "\t--peak-rate <rate>: peak rate in bytes/s, to mark packets"
+          " between the rate and the peak rate yellow rather than drop them,"
+          " default: none.\n"
+          "\t--peak-burst <size>: peak burst size in bytes,"
+          " default: none.\n"
+          "\t--yellow-dscp <dscp>: DSCP of yellow packets,"
+          " default: %" PRIu8 ".\n"
+          "\t--wan-key <none|dst|src|flow>: what WAN to LAN packets are"
+          " policed by, default: dst.\n"
+          "\t--lan-key <none|dst|src|flow>: what LAN to WAN packets are"
+          " policed by, default: none.\n"
+          "\t--lan-capacity <n>: LAN to WAN policer table capacity,"
+          " default: %" PRIu32 ".\n"
+          "\t--lan-rate, --lan-burst, --lan-peak-rate, --lan-peak-burst:"
+          " the same as --rate, --burst, --peak-rate and --peak-burst for LAN"
+          " to WAN packets, default: the same values.\n",
           DEFAULT_LAN, DEFAULT_WAN, DEFAULT_RATE, DEFAULT_BURST,
-          DEFAULT_CAPACITY);
+          DEFAULT_CAPACITY, DEFAULT_YELLOW_DSCP, DEFAULT_CAPACITY);
 }
 
 void nf_config_print(void) {
@@ -108,7 +253,19 @@ void nf_config_print(void) {
   NF_INFO("WAN Device: %" PRIu16, config.wan_device);
   NF_INFO("Rate: %" PRIu64, config.rate);
   NF_INFO("Burst: %" PRIu64, config.burst);
+  NF_INFO("Refill time: %" PRIu64 "ns", config.refill_time);
   NF_INFO("Capacity: %" PRIu16, config.dyn_capacity);
+  NF_INFO("Subnets file: %s", config.subnets_fname);
+  NF_INFO("Peak rate: %" PRIu64, config.peak_rate);
+  NF_INFO("Peak burst: %" PRIu64, config.peak_burst);
+  NF_INFO("Yellow DSCP: %" PRIu8, config.yellow_dscp);
+  NF_INFO("WAN key: %s", policer_key_name(config.wan_key));
+  NF_INFO("LAN key: %s", policer_key_name(config.lan_key));
+  NF_INFO("LAN capacity: %" PRIu32, config.lan_capacity);
+  NF_INFO("LAN rate: %" PRIu64, config.lan_rate);
+  NF_INFO("LAN burst: %" PRIu64, config.lan_burst);
+  NF_INFO("LAN peak rate: %" PRIu64, config.lan_peak_rate);
+  NF_INFO("LAN peak burst: %" PRIu64, config.lan_peak_burst);
 
   NF_INFO("\n--- ------ ------ ---\n");
 }
@@ -3,6 +3,8 @@
 #include <stdint.h>
 
 #include "nf.h"
+#include "policer_meter.h"
+#include "policer_table.h"
 
 #define CONFIG_FNAME_LEN 512
 
@@ -19,6 +21,37 @@ struct nf_config {
   // Policer burst size in B
   uint64_t burst;
 
+  // Time to refill an empty bucket, i.e. burst / rate, in ns. Computed once
+  // so that packets need no division.
+  uint64_t refill_time;
+
+  // Peak rate in B/s and peak burst size in B of the two-rate three-color
+  // marker, see policer_meter.h; 0 for the single-rate policer
+  uint64_t peak_rate;
+  uint64_t peak_burst;
+
+  // DSCP given to yellow packets, which exceed the rate but not the peak rate
+  uint8_t yellow_dscp;
+
   // Size of the dynamic filtering table
   uint32_t dyn_capacity;
+
+  // What WAN to LAN packets are policed by; only POLICER_KEY_DST_IP with a
+  // single rate is verified, the rest goes through policer_table.h
+  enum policer_key wan_key;
+
+  // The same for LAN to WAN packets, with their own table and rates
+  enum policer_key lan_key;
+  uint32_t lan_capacity;
+  uint64_t lan_rate;
+  uint64_t lan_burst;
+  uint64_t lan_peak_rate;
+  uint64_t lan_peak_burst;
+
+  // The rates of each direction, peak included, checked by nf_config_init
+  struct policer_rates wan_rates;
+  struct policer_rates lan_rates;
+
+  // Per-subnet rates and bursts, see policer_subnets.h; empty for none
+  char subnets_fname[CONFIG_FNAME_LEN];
 };
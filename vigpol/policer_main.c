@@ -4,10 +4,19 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <rte_byteorder.h>
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+#  include <rte_hash_crc.h>
+#endif // MULTICORE
+
 #include "nf.h"
 #include "nf-util.h"
 #include "nf-log.h"
+#include "nf-profile.h"
+#include "nf-telemetry.h"
 #include "policer_config.h"
+#include "policer_meter.h"
+#include "policer_subnets.h"
 #include "state.h"
 
 #include "libvig/verified/double-chain.h"
@@ -17,23 +26,31 @@
 
 struct nf_config config;
 
-struct State *dynamic_ft;
+PER_CORE struct State *dynamic_ft;
+
+// Tables for what the verified state does not cover, see policer_table.h;
+// NULL when unused
+PER_CORE struct policer_table *wan_table;
+PER_CORE struct policer_table *lan_table;
 
 int policer_expire_entries(vigor_time_t time) {
   assert(time >= 0); // we don't support the past
-  vigor_time_t exp_time =
-      VIGOR_TIME_SECONDS_MULTIPLIER * config.burst / config.rate;
+  vigor_time_t exp_time = config.refill_time;
   uint64_t time_u = (uint64_t)time;
   // OK because time >= config.burst / config.rate >= 0
   vigor_time_t min_time = time_u - exp_time;
 
-  return expire_items_single_map(dynamic_ft->dyn_heap, dynamic_ft->dyn_keys,
-                                 dynamic_ft->dyn_map, min_time);
+  int expired = expire_items_single_map(dynamic_ft->dyn_heap,
+                                        dynamic_ft->dyn_keys,
+                                        dynamic_ft->dyn_map, min_time);
+  nf_telemetry_add(NF_COUNTER_EXPIRED, expired);
+  nf_telemetry_set(NF_COUNTER_FLOWS, map_size(dynamic_ft->dyn_map));
+  return expired;
 }
 
 bool policer_check_tb(uint32_t dst, uint16_t size, vigor_time_t time) {
   int index = -1;
-  int present = map_get(dynamic_ft->dyn_map, &dst, &index);
+  int present = ip_addr_map_get(dynamic_ft->dyn_map, &dst, &index);
   if (present) {
     dchain_rejuvenate_index(dynamic_ft->dyn_heap, index, time);
 
@@ -46,8 +63,8 @@ bool policer_check_tb(uint32_t dst, uint16_t size, vigor_time_t time) {
     assert(value->bucket_time >= 0);
     assert(value->bucket_time <= time_u);
     uint64_t time_diff = time_u - value->bucket_time;
-    if (time_diff <
-        config.burst * VIGOR_TIME_SECONDS_MULTIPLIER / config.rate) {
+    if (time_diff < config.refill_time) {
+      // Division by a constant, which compilers turn into a multiplication
       uint64_t added_tokens =
           time_diff * config.rate / VIGOR_TIME_SECONDS_MULTIPLIER;
 #pragma GCC diagnostic push
@@ -83,6 +100,7 @@ bool policer_check_tb(uint32_t dst, uint16_t size, vigor_time_t time) {
         dchain_allocate_new_index(dynamic_ft->dyn_heap, &index, time);
     if (!allocated) {
       NF_DEBUG("No more space in the policer table");
+      nf_telemetry_add(NF_COUNTER_ALLOC_FAILED, 1);
       return false;
     }
     uint32_t *key;
@@ -92,7 +110,7 @@ bool policer_check_tb(uint32_t dst, uint16_t size, vigor_time_t time) {
     *key = dst;
     value->bucket_size = config.burst - size;
     value->bucket_time = time;
-    map_put(dynamic_ft->dyn_map, key, index);
+    ip_addr_map_put(dynamic_ft->dyn_map, key, index);
     // the other half of the key is in the map
     vector_return(dynamic_ft->dyn_keys, index, key);
     vector_return(dynamic_ft->dyn_vals, index, value);
@@ -102,10 +120,127 @@ bool policer_check_tb(uint32_t dst, uint16_t size, vigor_time_t time) {
   }
 }
 
+// Rewrites the DSCP and patches the header checksum following RFC 1624,
+// HC' = ~(~HC + ~m + m'), with m the 16-bit word holding the version, the
+// IHL, the DSCP and the ECN bits, which are kept.
+static void policer_set_dscp(struct rte_ipv4_hdr *ipv4_header, uint8_t dscp) {
+  uint8_t tos = (dscp << 2) | (ipv4_header->type_of_service & 0x3);
+  if (tos == ipv4_header->type_of_service) {
+    return;
+  }
+
+  uint16_t old_word = (ipv4_header->version_ihl << 8) |
+                      ipv4_header->type_of_service;
+  ipv4_header->type_of_service = tos;
+  uint16_t new_word = (ipv4_header->version_ihl << 8) | tos;
+
+  uint32_t sum = (uint16_t)~rte_be_to_cpu_16(ipv4_header->hdr_checksum);
+  sum += (uint16_t)~old_word;
+  sum += new_word;
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  ipv4_header->hdr_checksum = rte_cpu_to_be_16((uint16_t)~sum);
+}
+
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+// Each core has its own meters, so the packets that share a meter must all
+// reach the same core, or every core would let the full rate through: WAN
+// packets go to the core of their subnet, or else of their WAN key, and LAN
+// packets to that of their LAN key.
+static int policer_steer(uint16_t device, uint8_t* buffer,
+                         uint16_t packet_length) {
+  struct rte_ether_hdr *rte_ether_header = (struct rte_ether_hdr *)buffer;
+  if (packet_length < sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) ||
+      !nf_has_rte_ipv4_header(rte_ether_header)) {
+    return -1;
+  }
+  struct rte_ipv4_hdr *rte_ipv4_header =
+      (struct rte_ipv4_hdr *)(rte_ether_header + 1);
+
+  enum policer_key key;
+  if (device == config.wan_device) {
+    int subnet = policer_subnets_lookup(rte_ipv4_header->dst_addr);
+    if (subnet != POLICER_NO_SUBNET) {
+      return subnet % nf_core_count();
+    }
+    key = config.wan_key;
+  } else if (device == config.lan_device) {
+    key = config.lan_key;
+  } else {
+    return -1;
+  }
+
+  uint32_t hash = 0;
+  switch (key) {
+    case POLICER_KEY_DST_IP:
+      hash = rte_hash_crc_4byte(rte_ipv4_header->dst_addr, 0);
+      break;
+    case POLICER_KEY_SRC_IP:
+      hash = rte_hash_crc_4byte(rte_ipv4_header->src_addr, 0);
+      break;
+    case POLICER_KEY_FLOW: {
+      hash = rte_hash_crc_4byte(rte_ipv4_header->src_addr,
+                                rte_ipv4_header->next_proto_id);
+      hash = rte_hash_crc_4byte(rte_ipv4_header->dst_addr, hash);
+      // Same ports as policer_table_color, 0 without a TCP or UDP header
+      size_t tcpudp_offset = sizeof(struct rte_ether_hdr) +
+                             (rte_ipv4_header->version_ihl & 0x0f) * WORD_SIZE;
+      if (nf_has_tcpudp_header(rte_ipv4_header) &&
+          packet_length >= tcpudp_offset + sizeof(struct tcpudp_hdr)) {
+        struct tcpudp_hdr *tcpudp_header =
+            (struct tcpudp_hdr *)(buffer + tcpudp_offset);
+        hash = rte_hash_crc_4byte(((uint32_t)tcpudp_header->src_port << 16) |
+                                      tcpudp_header->dst_port,
+                                  hash);
+      }
+      break;
+    }
+    case POLICER_KEY_NONE:
+      // Not policed, any core will do
+      return -1;
+  }
+  return (int)(((uint64_t)hash * nf_core_count()) >> 32);
+}
+#endif // MULTICORE
+
 bool nf_init(void) {
   unsigned capacity = config.dyn_capacity;
   dynamic_ft = alloc_state(capacity, rte_eth_dev_count_avail());
-  return dynamic_ft != NULL;
+  if (dynamic_ft == NULL) {
+    return false;
+  }
+
+  // The verified state polices WAN to LAN packets by destination IP, with a
+  // single rate; anything else needs a table
+  if (config.wan_key != POLICER_KEY_NONE &&
+      (config.wan_key != POLICER_KEY_DST_IP || config.peak_rate != 0 ||
+       config.peak_burst != 0)) {
+    wan_table = policer_table_alloc(config.wan_key, capacity,
+                                    &config.wan_rates);
+    if (wan_table == NULL) {
+      return false;
+    }
+  }
+  if (config.lan_key != POLICER_KEY_NONE) {
+    lan_table = policer_table_alloc(config.lan_key, config.lan_capacity,
+                                    &config.lan_rates);
+    if (lan_table == NULL) {
+      return false;
+    }
+  }
+
+  if (!policer_subnets_init(config.subnets_fname)) {
+    return false;
+  }
+
+#if defined(MULTICORE) && !defined(KLEE_VERIFICATION)
+  // After the subnets, which the steering function looks up
+  if (nf_core_count() > 1) {
+    nf_set_steering(policer_steer);
+  }
+#endif // MULTICORE
+
+  return true;
 }
 
 int nf_process(uint16_t device, uint8_t* buffer, uint16_t packet_length, vigor_time_t now) {
@@ -121,25 +256,56 @@ int nf_process(uint16_t device, uint8_t* buffer, uint16_t packet_length, vigor_t
   }
 
   policer_expire_entries(now);
+  if (wan_table != NULL) {
+    policer_table_expire(wan_table, now);
+  }
+  if (lan_table != NULL) {
+    policer_table_expire(lan_table, now);
+  }
 
+  enum policer_color color;
+  uint16_t dst_device;
   if (device == config.lan_device) {
-    // Simply forward outgoing packets.
-    NF_DEBUG("Outgoing packet. Not policing.");
-    return config.wan_device;
+    if (lan_table == NULL) {
+      // Simply forward outgoing packets.
+      NF_DEBUG("Outgoing packet. Not policing.");
+      return config.wan_device;
+    }
+    color = policer_table_color(lan_table, rte_ipv4_header, buffer,
+                                packet_length, now);
+    dst_device = config.wan_device;
   } else if (device == config.wan_device) {
-    // Police incoming packets.
-    bool fwd = policer_check_tb(rte_ipv4_header->dst_addr, packet_length, now);
-
-    if (fwd) {
-      NF_DEBUG("Incoming packet within policed rate. Forwarding.");
-      return config.lan_device;
+    // Police incoming packets, per subnet if one matches, otherwise by the
+    // WAN key.
+    int subnet = policer_subnets_lookup(rte_ipv4_header->dst_addr);
+    if (subnet != POLICER_NO_SUBNET) {
+      color = policer_subnets_color(subnet, packet_length, now);
+    } else if (wan_table != NULL) {
+      color = policer_table_color(wan_table, rte_ipv4_header, buffer,
+                                  packet_length, now);
+    } else if (config.wan_key == POLICER_KEY_NONE) {
+      color = POLICER_GREEN;
     } else {
-      NF_DEBUG("Incoming packet outside of policed rate. Dropping.");
-      return config.wan_device;
+      bool fwd =
+          policer_check_tb(rte_ipv4_header->dst_addr, packet_length, now);
+      color = fwd ? POLICER_GREEN : POLICER_RED;
     }
+    dst_device = config.lan_device;
   } else {
     // Drop any other packets.
     NF_DEBUG("Unknown port. Dropping.");
     return device;
   }
+
+  if (color == POLICER_RED) {
+    NF_DEBUG("Packet outside of policed rate. Dropping.");
+    return device;
+  }
+  if (color == POLICER_YELLOW) {
+    NF_DEBUG("Packet above the rate, within the peak rate. Marking.");
+    policer_set_dscp(rte_ipv4_header, config.yellow_dscp);
+  } else {
+    NF_DEBUG("Packet within policed rate. Forwarding.");
+  }
+  return dst_device;
 }
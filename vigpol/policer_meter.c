@@ -0,0 +1,69 @@
+#include "policer_meter.h"
+
+#include <stdlib.h>
+
+// A full bucket plus the tokens added during its refill time must fit in 64
+// bits, i.e. twice the largest bucket, see refill
+#define MAX_BURST (UINT64_MAX / 2 / VIGOR_TIME_SECONDS_MULTIPLIER)
+
+bool policer_rates_init(struct policer_rates *rates) {
+  if (rates->rate == 0 || rates->burst == 0 || rates->burst > MAX_BURST ||
+      rates->peak_rate < rates->rate || rates->peak_burst == 0 ||
+      rates->peak_burst > MAX_BURST) {
+    return false;
+  }
+
+  rates->refill_time =
+      rates->burst * VIGOR_TIME_SECONDS_MULTIPLIER / rates->rate;
+  rates->peak_refill_time =
+      rates->peak_burst * VIGOR_TIME_SECONDS_MULTIPLIER / rates->peak_rate;
+  return true;
+}
+
+struct policer_meter *policer_meters_alloc(unsigned count) {
+  return aligned_alloc(_Alignof(struct policer_meter),
+                       count * sizeof(struct policer_meter));
+}
+
+void policer_meter_init(struct policer_meter *meter,
+                        const struct policer_rates *rates, vigor_time_t time) {
+  meter->committed_tokens = rates->burst * VIGOR_TIME_SECONDS_MULTIPLIER;
+  meter->peak_tokens = rates->peak_burst * VIGOR_TIME_SECONDS_MULTIPLIER;
+  meter->time = time;
+}
+
+static inline uint64_t refill(uint64_t tokens, uint64_t time_diff,
+                              uint64_t rate, uint64_t burst,
+                              uint64_t refill_time) {
+  uint64_t max_tokens = burst * VIGOR_TIME_SECONDS_MULTIPLIER;
+  if (time_diff >= refill_time) {
+    return max_tokens;
+  }
+  // time_diff * rate < max_tokens, so the sum is below 2 * max_tokens
+  tokens += time_diff * rate;
+  return tokens < max_tokens ? tokens : max_tokens;
+}
+
+enum policer_color policer_meter_color(struct policer_meter *meter,
+                                       const struct policer_rates *rates,
+                                       uint16_t size, vigor_time_t time) {
+  uint64_t time_diff = (uint64_t)(time - meter->time);
+  meter->committed_tokens = refill(meter->committed_tokens, time_diff,
+                                   rates->rate, rates->burst,
+                                   rates->refill_time);
+  meter->peak_tokens = refill(meter->peak_tokens, time_diff, rates->peak_rate,
+                              rates->peak_burst, rates->peak_refill_time);
+  meter->time = time;
+
+  uint64_t size_tokens = (uint64_t)size * VIGOR_TIME_SECONDS_MULTIPLIER;
+  if (meter->peak_tokens < size_tokens) {
+    return POLICER_RED;
+  }
+  meter->peak_tokens -= size_tokens;
+
+  if (meter->committed_tokens < size_tokens) {
+    return POLICER_YELLOW;
+  }
+  meter->committed_tokens -= size_tokens;
+  return POLICER_GREEN;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libvig/verified/vigor-time.h"
+
+// Two-rate three-color marker, RFC 2698, in color-blind mode: a packet is
+// red if it exceeds the peak bucket, yellow if it only exceeds the committed
+// bucket, and green otherwise. With the same rate and burst for both
+// buckets, no packet is ever yellow, which makes it a single-rate policer.
+// This is an unverified extension of the policer; the verified per-IP
+// policer is policer_check_tb in policer_main.c.
+
+enum policer_color {
+  POLICER_GREEN,
+  POLICER_YELLOW,
+  POLICER_RED,
+};
+
+struct policer_rates {
+  // Committed information rate in B/s and committed burst size in B
+  uint64_t rate;
+  uint64_t burst;
+
+  // Peak information rate in B/s and peak burst size in B
+  uint64_t peak_rate;
+  uint64_t peak_burst;
+
+  // Time to refill each bucket from empty in ns, set by policer_rates_init
+  uint64_t refill_time;
+  uint64_t peak_refill_time;
+};
+
+// Tokens are counted in 1/VIGOR_TIME_SECONDS_MULTIPLIER bytes, so that
+// refilling is a multiplication by the rate with no rounding, however often
+// packets come, and with no division. This bounds the burst sizes, see
+// policer_rates_init.
+// Meters are aligned so that each one sits within a single cache line.
+struct policer_meter {
+  uint64_t committed_tokens;
+  uint64_t peak_tokens;
+  vigor_time_t time;
+} __attribute__((aligned(32)));
+
+static_assert(sizeof(struct policer_meter) == 32,
+              "struct policer_meter must fit evenly in a cache line");
+
+// Checks the rates and bursts, and computes the refill times
+bool policer_rates_init(struct policer_rates *rates);
+
+// Allocates count meters, aligned as they should be, or returns NULL
+struct policer_meter *policer_meters_alloc(unsigned count);
+
+// Starts with both buckets full
+void policer_meter_init(struct policer_meter *meter,
+                        const struct policer_rates *rates, vigor_time_t time);
+
+enum policer_color policer_meter_color(struct policer_meter *meter,
+                                       const struct policer_rates *rates,
+                                       uint16_t size, vigor_time_t time);
@@ -0,0 +1,156 @@
+#include "policer_subnets.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <rte_byteorder.h>
+#include <rte_debug.h>
+
+#include "libvig/verified/boilerplate-util.h"
+#include "libvig/verified/lpm-dir-24-8.h"
+
+#include "nf-log.h"
+
+// File parsing and the per-prefix meters are not part of the verified NF
+#if defined(KLEE_VERIFICATION) || defined(NFOS)
+
+bool policer_subnets_init(const char *fname) { return true; }
+
+int policer_subnets_lookup(uint32_t dst) { return POLICER_NO_SUBNET; }
+
+enum policer_color policer_subnets_color(int subnet, uint16_t size,
+                                         vigor_time_t time) {
+  return POLICER_RED;
+}
+
+#else // KLEE_VERIFICATION || NFOS
+
+// The rules and the LPM table that maps prefixes to them are read-only once
+// loaded, and shared by all cores; the table holds indices in subnets.
+static struct lpm *subnet_table;
+static struct policer_rates *subnets;
+static unsigned subnet_count;
+
+static PER_CORE struct policer_meter *subnet_meters;
+
+static bool add_subnet(unsigned a, unsigned b, unsigned c, unsigned d,
+                       unsigned prefixlen, struct policer_rates rates) {
+  if (a > 255 || b > 255 || c > 255 || d > 255 || prefixlen > lpm_PLEN_MAX) {
+    return false;
+  }
+
+  if (!policer_rates_init(&rates)) {
+    return false;
+  }
+
+  // Prefixes map to rule indices, which must fit in an LPM value
+  if (subnet_count > MAX_NEXT_HOP_VALUE) {
+    NF_INFO("Too many subnets, at most %u", MAX_NEXT_HOP_VALUE + 1);
+    return false;
+  }
+
+  struct policer_rates *grown =
+      realloc(subnets, (subnet_count + 1) * sizeof(struct policer_rates));
+  if (grown == NULL) {
+    rte_exit(EXIT_FAILURE, "Could not allocate the subnets");
+  }
+  subnets = grown;
+
+  uint32_t prefix = (a << 24) | (b << 16) | (c << 8) | d;
+  if (!lpm_update_elem(subnet_table, prefix, prefixlen, subnet_count)) {
+    rte_exit(EXIT_FAILURE, "Could not add the subnet %u.%u.%u.%u/%u", a, b, c,
+             d, prefixlen);
+  }
+
+  subnets[subnet_count] = rates;
+  ++subnet_count;
+  return true;
+}
+
+static void read_subnets_from_file(const char *fname) {
+  FILE *subnets_file = fopen(fname, "r");
+  if (subnets_file == NULL) {
+    rte_exit(EXIT_FAILURE, "Error opening the subnets file: %s", fname);
+  }
+
+  if (!lpm_allocate(&subnet_table)) {
+    rte_exit(EXIT_FAILURE, "Could not allocate the subnets table");
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), subnets_file) != NULL) {
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+
+    unsigned a, b, c, d, prefixlen;
+    struct policer_rates rates;
+    int result = sscanf(line,
+                        "%u.%u.%u.%u/%u %" SCNu64 " %" SCNu64 " %" SCNu64
+                        " %" SCNu64,
+                        &a, &b, &c, &d, &prefixlen, &rates.rate, &rates.burst,
+                        &rates.peak_rate, &rates.peak_burst);
+    if (result == 7) {
+      // Single rate
+      rates.peak_rate = rates.rate;
+      rates.peak_burst = rates.burst;
+    }
+    if ((result != 7 && result != 9) ||
+        !add_subnet(a, b, c, d, prefixlen, rates)) {
+      NF_INFO("Invalid subnet: %s, skip", line);
+      continue;
+    }
+  }
+
+  fclose(subnets_file);
+  NF_INFO("Loaded %u subnets", subnet_count);
+}
+
+bool policer_subnets_init(const char *fname) {
+  if (fname[0] == '\0') {
+    // No subnets, everything is policed per IP
+    return true;
+  }
+
+  // nf_init runs on one core at a time, the first one reads the file
+  if (subnet_table == NULL) {
+    read_subnets_from_file(fname);
+  }
+
+  if (subnet_count == 0) {
+    return true;
+  }
+
+  subnet_meters = policer_meters_alloc(subnet_count);
+  if (subnet_meters == NULL) {
+    return false;
+  }
+  // Meters start full, as do the per-IP buckets
+  for (unsigned i = 0; i < subnet_count; ++i) {
+    policer_meter_init(&subnet_meters[i], &subnets[i], 0);
+  }
+  return true;
+}
+
+int policer_subnets_lookup(uint32_t dst) {
+  // Not subnet_meters, which is only set on the cores that ran nf_init
+  if (subnet_count == 0) {
+    return POLICER_NO_SUBNET;
+  }
+
+  int subnet = lpm_lookup_elem(subnet_table, rte_be_to_cpu_32(dst));
+  // Also covers INVALID, i.e. no matching prefix
+  if (subnet < 0 || (unsigned)subnet >= subnet_count) {
+    return POLICER_NO_SUBNET;
+  }
+  return subnet;
+}
+
+enum policer_color policer_subnets_color(int subnet, uint16_t size,
+                                         vigor_time_t time) {
+  return policer_meter_color(&subnet_meters[subnet], &subnets[subnet], size,
+                             time);
+}
+
+#endif // KLEE_VERIFICATION || NFOS
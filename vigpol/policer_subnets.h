@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libvig/verified/vigor-time.h"
+
+#include "policer_meter.h"
+
+// Subnet policing, an unverified extension of the policer: a file of
+// "<prefix>/<length> <rate> <burst> [<peak rate> <peak burst>]" rules, with
+// the rates in B/s and the bursts in B, gives each prefix one meter, shared
+// by all the destinations within it and found by longest prefix match.
+// Rules without a peak rate and burst only mark packets green or red, see
+// policer_meter.h. Destinations that match no rule are policed per IP, as
+// without the file.
+// Rules are only read by the DPDK build; with KLEE_VERIFICATION or NFOS
+// there are none, so the verified per-IP policer is all that runs.
+
+#define POLICER_NO_SUBNET (-1)
+
+// Reads the rules the first time it is called; every core gets its own
+// meters. An empty fname means no rules.
+bool policer_subnets_init(const char *fname);
+
+// Returns the rule matching dst, in network byte order, or POLICER_NO_SUBNET.
+// Any core can call it once a core read the rules, e.g. to steer packets.
+int policer_subnets_lookup(uint32_t dst);
+
+enum policer_color policer_subnets_color(int subnet, uint16_t size,
+                                         vigor_time_t time);
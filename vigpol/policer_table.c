@@ -0,0 +1,158 @@
+#include "policer_table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libvig/unverified/containers-free.h"
+#include "libvig/verified/double-chain.h"
+#include "libvig/verified/expirator.h"
+#include "libvig/verified/map.h"
+#include "libvig/verified/vector.h"
+
+#include "flow.h.gen.h"
+#include "nf-log.h"
+#include "nf-profile.h"
+#include "nf-telemetry.h"
+#include "nf-util.h"
+
+struct policer_table {
+  // IP keys are FlowIds with only the IP set, so that every table has the
+  // same key type
+  struct Map *map;
+  struct Vector *keys;
+  struct DoubleChain *heap;
+  struct policer_meter *meters;
+  struct policer_rates rates;
+  enum policer_key key;
+  uint64_t expiration_time;
+};
+
+static const char *const key_names[] = {
+  [POLICER_KEY_NONE] = "none",
+  [POLICER_KEY_DST_IP] = "dst",
+  [POLICER_KEY_SRC_IP] = "src",
+  [POLICER_KEY_FLOW] = "flow",
+};
+
+bool policer_key_parse(const char *name, enum policer_key *key_out) {
+  for (unsigned i = 0; i < sizeof(key_names) / sizeof(key_names[0]); ++i) {
+    if (strcmp(name, key_names[i]) == 0) {
+      *key_out = (enum policer_key)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *policer_key_name(enum policer_key key) { return key_names[key]; }
+
+struct policer_table *policer_table_alloc(enum policer_key key,
+                                          unsigned capacity,
+                                          const struct policer_rates *rates) {
+  struct policer_table *table = malloc(sizeof(struct policer_table));
+  if (table == NULL) {
+    return NULL;
+  }
+
+  if (map_allocate(FlowId_eq, FlowId_hash, capacity, &table->map) == 0) {
+    goto err_table;
+  }
+  if (vector_allocate(sizeof(struct FlowId), capacity, FlowId_allocate,
+                      &table->keys) == 0) {
+    goto err_map;
+  }
+  if (dchain_allocate(capacity, &table->heap) == 0) {
+    goto err_keys;
+  }
+#if defined(SPECIALIZED_MAPS) && !defined(KLEE_VERIFICATION)
+  map_specialize(table->map, &FlowId_map_ops);
+#endif
+
+  table->meters = policer_meters_alloc(capacity);
+  if (table->meters == NULL) {
+    goto err_heap;
+  }
+
+  table->rates = *rates;
+  table->key = key;
+  // An idle entry is the same as a new one once both buckets are full
+  table->expiration_time = rates->refill_time > rates->peak_refill_time
+                               ? rates->refill_time
+                               : rates->peak_refill_time;
+  return table;
+
+err_heap:
+  dchain_free(table->heap);
+err_keys:
+  vector_free(table->keys);
+err_map:
+  map_free(table->map);
+err_table:
+  free(table);
+  return NULL;
+}
+
+int policer_table_expire(struct policer_table *table, vigor_time_t time) {
+  uint64_t time_u = (uint64_t)time;
+  if (time_u < table->expiration_time) {
+    return 0;
+  }
+  int expired = expire_items_single_map(table->heap, table->keys, table->map,
+                                        time_u - table->expiration_time);
+  nf_telemetry_add(NF_COUNTER_EXPIRED, expired);
+  return expired;
+}
+
+enum policer_color policer_table_color(struct policer_table *table,
+                                       struct rte_ipv4_hdr *ipv4_header,
+                                       uint8_t *buffer, uint16_t size,
+                                       vigor_time_t time) {
+  struct FlowId id;
+  memset(&id, 0, sizeof(id));
+  switch (table->key) {
+    case POLICER_KEY_DST_IP:
+      id.dst_ip = ipv4_header->dst_addr;
+      break;
+    case POLICER_KEY_SRC_IP:
+      id.src_ip = ipv4_header->src_addr;
+      break;
+    case POLICER_KEY_FLOW: {
+      id.src_ip = ipv4_header->src_addr;
+      id.dst_ip = ipv4_header->dst_addr;
+      id.protocol = ipv4_header->next_proto_id;
+      struct tcpudp_hdr *tcpudp_header =
+          nf_then_get_tcpudp_header(ipv4_header, buffer);
+      if (tcpudp_header != NULL) {
+        id.src_port = tcpudp_header->src_port;
+        id.dst_port = tcpudp_header->dst_port;
+      }
+      break;
+    }
+    case POLICER_KEY_NONE:
+      return POLICER_GREEN;
+  }
+
+  int index = -1;
+  int present = FlowId_map_get(table->map, &id, &index);
+  if (present) {
+    dchain_rejuvenate_index(table->heap, index, time);
+  } else {
+    int allocated = dchain_allocate_new_index(table->heap, &index, time);
+    if (!allocated) {
+      NF_DEBUG("No more space in the policer table");
+      nf_telemetry_add(NF_COUNTER_ALLOC_FAILED, 1);
+      return POLICER_RED;
+    }
+    struct FlowId *key;
+    vector_borrow(table->keys, index, (void **)&key);
+    *key = id;
+    FlowId_map_put(table->map, key, index);
+    // the other half of the key is in the map
+    vector_return(table->keys, index, key);
+    policer_meter_init(&table->meters[index], &table->rates, time);
+    NF_DEBUG("  New flow.");
+  }
+
+  return policer_meter_color(&table->meters[index], &table->rates, size,
+                             time);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <rte_ip.h>
+
+#include "libvig/verified/vigor-time.h"
+
+#include "policer_meter.h"
+
+// Policing tables for the keys and directions the verified policer does not
+// cover, which only polices WAN to LAN packets by destination IP. Each table
+// has its own capacity and rates, and one meter per key; entries expire once
+// their buckets are full again. Not verified.
+
+enum policer_key {
+  POLICER_KEY_NONE,
+  POLICER_KEY_DST_IP,
+  POLICER_KEY_SRC_IP,
+  // 5-tuple; packets that are neither TCP nor UDP have no ports
+  POLICER_KEY_FLOW,
+};
+
+// Parses "none", "dst", "src" or "flow"
+bool policer_key_parse(const char *name, enum policer_key *key_out);
+const char *policer_key_name(enum policer_key key);
+
+struct policer_table;
+
+// rates must have been checked with policer_rates_init
+struct policer_table *policer_table_alloc(enum policer_key key,
+                                          unsigned capacity,
+                                          const struct policer_rates *rates);
+
+int policer_table_expire(struct policer_table *table, vigor_time_t time);
+
+// buffer is the packet, right after its IPv4 header was read; the L4 header
+// is only read for POLICER_KEY_FLOW
+enum policer_color policer_table_color(struct policer_table *table,
+                                       struct rte_ipv4_hdr *ipv4_header,
+                                       uint8_t *buffer, uint16_t size,
+                                       vigor_time_t time);
@@ -4,19 +4,25 @@ set -euo pipefail
 
 SCRIPT_DIR=$(cd $(dirname ${BASH_SOURCE[0]}) && pwd)
 
+# What the receiving side of send_traffic got, as tcpdump -v prints it, and
+# what iperf printed on the sending side
+CAPTURE=$(mktemp)
+CLIENT_OUTPUT=$(mktemp)
+
 function cleanup {
   sudo killall policer 2>/dev/null || true
   sudo killall iperf 2>/dev/null || true
+  sudo killall tcpdump 2>/dev/null || true
   sudo ip netns delete lan 2>/dev/null || true
   sudo ip netns delete wan 2>/dev/null || true
+  rm -f "$CAPTURE" "$CLIENT_OUTPUT"
 }
 trap cleanup EXIT
 
 
-function test_policer {
-  RATE=$1
-  BURST=$2
-
+# Starts the policer with the given options, then moves each of its devices
+# to a namespace of the same name: the LAN at 10.0.0.1, the WAN at 10.0.0.2
+function start_policer {
   sudo taskset -c 8 \
       ./build/app/policer \
         --vdev "net_tap0,iface=test_wan" \
@@ -24,14 +30,13 @@ function test_policer {
         --no-shconf -- \
         --lan 3 \
         --wan 2 \
-        --rate $RATE \
-        --burst $BURST \
         --capacity 65536 \
+        "$@" \
         >/dev/null 2>/dev/null &
   NF_PID=$!
 
-  while [ ! -f /sys/class/net/test_lan/tun_flags -o
-          ! -f /sys/class/net/test_lan/tun_flags ]; do
+  while [ ! -f /sys/class/net/test_lan/tun_flags -o \
+          ! -f /sys/class/net/test_wan/tun_flags ]; do
     echo "Waiting for NF to launch...";
     sleep 1;
   done
@@ -49,20 +54,94 @@ function test_policer {
 
   sudo ip netns exec lan arp -i test_lan -s 10.0.0.2 $WAN_MAC
   sudo ip netns exec wan arp -i test_wan -s 10.0.0.1 $LAN_MAC
+}
+
+function stop_policer {
+  sudo killall policer
+  wait $NF_PID 2>/dev/null || true
+
+  sudo ip netns delete lan
+  sudo ip netns delete wan
+}
+
+# Sends 10s of UDP at 1 Mbit/s, i.e. 125000 B/s, from namespace $1 to
+# namespace $2 at IP $3, and keeps what $2 receives in CAPTURE
+function send_traffic {
+  FROM=$1
+  TO=$2
+  DST_IP=$3
+
+  sudo ip netns exec $TO tcpdump -i test_$TO -Q in -n -l -v udp \
+      >"$CAPTURE" 2>/dev/null &
+  TCPDUMP_PID=$!
 
-  sudo ip netns exec lan iperf -us -i 1 &
+  sudo ip netns exec $TO iperf -us -i 1 &
   SERVER_PID=$!
+  sleep 1
 
-  sudo ip netns exec wan iperf -uc 10.0.0.1 -t 10 >/dev/null
+  sudo ip netns exec $FROM iperf -uc $DST_IP -t 10 >"$CLIENT_OUTPUT"
 
   sudo killall iperf
   wait $SERVER_PID 2>/dev/null || true
+  sudo killall tcpdump
+  wait $TCPDUMP_PID 2>/dev/null || true
+}
 
-  sudo killall policer
-  wait $NF_PID 2>/dev/null || true
+# Number of lines of CAPTURE that match $1
+function count_captured {
+  grep -c "$1" "$CAPTURE" || true
+}
 
-  sudo ip netns delete lan
-  sudo ip netns delete wan
+
+function test_policer {
+  RATE=$1
+  BURST=$2
+
+  start_policer --rate $RATE --burst $BURST
+  send_traffic wan lan 10.0.0.1
+  stop_policer
+}
+
+# Past the burst, the traffic exceeds the rate but not the peak rate, so it
+# must arrive marked with the yellow DSCP rather than be dropped, and with a
+# header checksum that still matches
+function test_marker {
+  YELLOW_DSCP=10
+
+  start_policer --rate 12500 --burst 500000 \
+                --peak-rate 250000 --peak-burst 1000000 \
+                --yellow-dscp $YELLOW_DSCP
+  send_traffic wan lan 10.0.0.1
+  stop_policer
+
+  # The ToS byte is the DSCP followed by the 2 ECN bits, which iperf leaves
+  # at 0
+  YELLOW=$(count_captured "tos $(printf '0x%x' $((YELLOW_DSCP << 2))),")
+  BAD_CHECKSUMS=$(count_captured 'bad cksum')
+  echo "trTCM: $YELLOW yellow packets, $BAD_CHECKSUMS bad checksums"
+  if [ "$YELLOW" -eq 0 -o "$BAD_CHECKSUMS" -ne 0 ]; then
+    echo "trTCM test failed" 1>&2
+    exit 1
+  fi
+}
+
+# LAN to WAN packets go through the LAN table, here by source IP: past the
+# burst, only the LAN rate, a tenth of the traffic, gets through
+function test_lan_policer {
+  start_policer --lan-key src --lan-capacity 1024 \
+                --lan-rate 12500 --lan-burst 500000
+  send_traffic lan wan 10.0.0.2
+  stop_policer
+
+  SENT=$(grep -o 'Sent [0-9]* datagrams' "$CLIENT_OUTPUT" | grep -o '[0-9]*')
+  RECEIVED=$(count_captured '^IP ')
+  echo "LAN policer: $RECEIVED of $SENT packets forwarded"
+  # The burst and 10s at the rate are 625000 B, about 420 full-size frames
+  # of the about 890 iperf sends
+  if [ "$RECEIVED" -eq 0 -o $((RECEIVED * 4)) -gt $((SENT * 3)) ]; then
+    echo "LAN policer test failed" 1>&2
+    exit 1
+  fi
 }
 
 
@@ -70,5 +149,7 @@ make clean
 make ADDITIONAL_FLAGS="-DSTOP_ON_RX_0 -g" -j$(nproc)
 
 test_policer 12500 500000
+test_marker
+test_lan_policer
 
 echo "Done."
@@ -0,0 +1,10 @@
+open Data_spec
+open Core
+open Ir
+
+let containers = ["routes", LPM ""]
+
+let constraints = []
+
+let gen_custom_includes = ref []
+let gen_records = ref []
@@ -0,0 +1,3 @@
+objConstructors = {}
+typeConstructors = {}
+stateObjects = {'routes' : lpm}
@@ -0,0 +1,16 @@
+open Core
+open Str
+open Fspec_api
+open Ir
+open Common_fspec
+
+module Iface : Fspec_api.Spec =
+struct
+let containers = ["routes", LPM ""]
+
+let records = String.Map.of_alist_exn []
+end
+
+(* Register the module *)
+let () =
+  Fspec_api.spec := Some (module Iface) ;
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <rte_ether.h>
+
+#define CONFIG_FNAME_LEN 512
+
+struct nf_config {
+  // MAC addresses of devices
+  struct rte_ether_addr *device_macs;
+
+  // MAC addresses of the next hops the devices are linked to
+  struct rte_ether_addr *endpoint_macs;
+
+  // The routing table file name
+  char routes_fname[CONFIG_FNAME_LEN];
+};
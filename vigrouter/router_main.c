@@ -0,0 +1,181 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_byteorder.h>
+#include <rte_ethdev.h>
+
+#include "libvig/verified/lpm-dir-24-8.h"
+
+#include "nf.h"
+#include "nf-util.h"
+#include "nf-log.h"
+#include "nf-profile.h"
+#include "router_config.h"
+#include "state.h"
+
+struct nf_config config;
+
+PER_CORE struct State *router_state;
+
+// File parsing, is not really the kind of code we want to verify.
+#ifdef KLEE_VERIFICATION
+static void read_routes_from_file(struct lpm *routes) {}
+
+static void read_routes_from_array(struct lpm *routes) {}
+
+#else // KLEE_VERIFICATION
+
+static bool add_route(struct lpm *routes, unsigned a, unsigned b, unsigned c,
+                      unsigned d, unsigned prefixlen, unsigned device) {
+  if (a > 255 || b > 255 || c > 255 || d > 255 || prefixlen > lpm_PLEN_MAX) {
+    return false;
+  }
+
+  if (device >= rte_eth_dev_count_avail()) {
+    NF_INFO("Device %u does not exist, skip", device);
+    return false;
+  }
+
+  uint32_t prefix = (a << 24) | (b << 16) | (c << 8) | d;
+  if (!lpm_update_elem(routes, prefix, prefixlen, device)) {
+    rte_exit(EXIT_FAILURE, "Could not add the route %u.%u.%u.%u/%u", a, b, c,
+             d, prefixlen);
+  }
+  return true;
+}
+
+#  ifndef NFOS
+static void read_routes_from_file(struct lpm *routes) {
+  if (config.routes_fname[0] == '\0') {
+    // No routes
+    return;
+  }
+
+  FILE *routes_file = fopen(config.routes_fname, "r");
+  if (routes_file == NULL) {
+    rte_exit(EXIT_FAILURE, "Error opening the routes file: %s",
+             config.routes_fname);
+  }
+
+  unsigned count = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), routes_file) != NULL) {
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+
+    unsigned a, b, c, d, prefixlen, device;
+    int result = sscanf(line, "%u.%u.%u.%u/%u %u", &a, &b, &c, &d, &prefixlen,
+                        &device);
+    if (result != 6) {
+      NF_INFO("Invalid route: %s, skip", line);
+      continue;
+    }
+
+    if (!add_route(routes, a, b, c, d, prefixlen, device)) {
+      NF_INFO("Invalid route: %s, skip", line);
+      continue;
+    }
+    ++count;
+  }
+
+  fclose(routes_file);
+  NF_INFO("Loaded %u routes", count);
+}
+#  endif // NFOS
+
+struct {
+  const char prefix[16];
+  const unsigned prefixlen;
+  const unsigned device;
+} static_routes[] = {
+  { "0.0.0.0", 0, 1 },
+};
+
+static void read_routes_from_array(struct lpm *routes) {
+  unsigned number_of_entries = sizeof(static_routes) / sizeof(static_routes[0]);
+
+  for (unsigned idx = 0; idx < number_of_entries; idx++) {
+    unsigned a, b, c, d;
+    if (sscanf(static_routes[idx].prefix, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 ||
+        !add_route(routes, a, b, c, d, static_routes[idx].prefixlen,
+                   static_routes[idx].device)) {
+      NF_INFO("Invalid route: %s/%u, skip", static_routes[idx].prefix,
+              static_routes[idx].prefixlen);
+    }
+  }
+}
+
+#endif // KLEE_VERIFICATION
+
+// Decrements the TTL and patches the header checksum accordingly, following
+// RFC 1624: HC' = ~(~HC + ~m + m'), with m the 16-bit word holding the TTL
+// and the protocol. This avoids summing the whole header again.
+static void router_decrement_ttl(struct rte_ipv4_hdr *ipv4_header) {
+  uint16_t old_word = (ipv4_header->time_to_live << 8) |
+                      ipv4_header->next_proto_id;
+  ipv4_header->time_to_live--;
+  uint16_t new_word = (ipv4_header->time_to_live << 8) |
+                      ipv4_header->next_proto_id;
+
+  uint32_t sum = (uint16_t)~rte_be_to_cpu_16(ipv4_header->hdr_checksum);
+  sum += (uint16_t)~old_word;
+  sum += new_word;
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  ipv4_header->hdr_checksum = rte_cpu_to_be_16((uint16_t)~sum);
+}
+
+bool nf_init(void) {
+  router_state = alloc_state();
+  if (router_state == NULL) {
+    return false;
+  }
+
+#ifdef NFOS
+  read_routes_from_array(router_state->routes);
+#else
+  read_routes_from_file(router_state->routes);
+#endif
+  return true;
+}
+
+int nf_process(uint16_t device, uint8_t* buffer, uint16_t packet_length, vigor_time_t now) {
+  // Mark now as unused, routes do not expire
+  (void)now;
+
+  struct rte_ether_hdr *rte_ether_header = nf_then_get_rte_ether_header(buffer);
+  uint8_t *ip_options;
+  struct rte_ipv4_hdr *rte_ipv4_header =
+      nf_then_get_rte_ipv4_header(rte_ether_header, buffer, &ip_options);
+  if (rte_ipv4_header == NULL) {
+    NF_DEBUG("Not IPv4, dropping");
+    return device;
+  }
+
+  if (rte_ipv4_header->time_to_live <= 1) {
+    NF_DEBUG("TTL expired, dropping");
+    return device;
+  }
+
+  int route = lpm_lookup_elem(router_state->routes,
+                              rte_be_to_cpu_32(rte_ipv4_header->dst_addr));
+  // Also covers INVALID, i.e. no route. Routing a packet back to the device
+  // it came from means dropping it, that is how nf_process signals a drop.
+  if (route < 0 || route >= rte_eth_dev_count_avail() || route == device) {
+    NF_DEBUG("No route, dropping");
+    return device;
+  }
+
+  uint16_t dst_device = route;
+  concretize_devices(&dst_device, rte_eth_dev_count_avail());
+
+  router_decrement_ttl(rte_ipv4_header);
+
+  rte_ether_header->s_addr = config.device_macs[dst_device];
+  rte_ether_header->d_addr = config.endpoint_macs[dst_device];
+
+  return dst_device;
+}
@@ -0,0 +1,30 @@
+from state import routes
+# The number of devices at verification time, NF_DEVICES in Makefile.dpdk
+DEVICES_COUNT = 2
+# What routes.lookup returns without a matching route, see lpm-dir-24-8.h
+INVALID = 0xFFFF
+
+h2 = pop_header(ipv4, on_mismatch=([],[]))
+h1 = pop_header(ether, on_mismatch=([],[]))
+
+# Malformed IPv4
+if (h2.vihl & 15) < 5 or packet_size - 14 < (((h2.len & 0xFF) << 8) | ((h2.len & 0xFF00) >> 8)):
+    return ([],[])
+
+if h2.ttl <= 1:
+    return ([],[])
+
+out_port = routes.lookup(h2.daddr)
+# No route
+if out_port == INVALID:
+    return ([],[])
+
+# A route to a device that does not exist
+if DEVICES_COUNT <= out_port:
+    return ([],[])
+
+if out_port == received_on_port:
+    return ([],[])
+
+return ([out_port],[ether(h1, saddr=..., daddr=...),
+                    ipv4(h2, ttl=h2.ttl - 1, cksum=...)])